@@ -0,0 +1,49 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "preprocessor.h"
+
+// Генерация адаптеров для интерфейсов из заголовков:
+// ./adapterGenerator <каталог вывода> <целевой класс> <заголовок целевого класса> <заголовок>... [--stamp <файл>]
+// Адаптеры с неизменившимся текстом не перезаписываются; файл-отметка обновляется всегда
+int main(int argc, char** argv) {
+    AdapterOptions options;
+    std::vector<std::string> headers;
+    std::string stamp;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--stamp" && i + 1 < argc) {
+            stamp = argv[++i];
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() < 4) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <output dir> <target class> <target header> <header>... [--stamp <file>]" << std::endl;
+        return 2;
+    }
+    options.outputDir = positional[0];
+    options.targetClass = positional[1];
+    options.targetHeader = positional[2];
+    headers.assign(positional.begin() + 3, positional.end());
+
+    auto start = std::chrono::steady_clock::now();
+    GeneratorResult result = AdapterGenerator::Run(headers, options);
+    double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for (const auto& error : result.errors) {
+        std::cerr << error << std::endl;
+    }
+    std::cout << "Adapters: " << result.interfaces << " interfaces, " << result.written << " written, "
+              << result.unchanged << " unchanged (" << millis << " ms)" << std::endl;
+    if (!result.errors.empty()) {
+        return 1;
+    }
+    if (!stamp.empty()) {
+        std::ofstream(stamp, std::ios::trunc) << result.interfaces << "\n";
+    }
+    return 0;
+}
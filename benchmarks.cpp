@@ -0,0 +1,968 @@
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "exception_queue.h"
+#include "commandStats.h"
+#include "coroutineScheduler.h"
+#include "spaceship.h"
+#include "movement.h"
+#include "changeVelocity.h"
+#include "burnFuelCommand.h"
+#include "rotateAndChangeVelocity.h"
+#include "parallelExecutor.h"
+#include "world.h"
+#include "deltaCodec.h"
+#include "collision.h"
+#include "journal.h"
+#include "safequeue.h"
+#include "cpuAffinity.h"
+#include "components.h"
+#include "coalescer.h"
+#include "macroCommand.h"
+#include "commandScript.h"
+#include "trajectoryPredictor.h"
+#include "preprocessor.h"
+#include "sharedRing.h"
+#include <regex>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include "moveWithFuel.h"
+#include <cstdio>
+#include <random>
+#include <sys/wait.h>
+
+// Время выполнения функции в наносекундах
+template <typename F>
+double measureNanos(F&& func) {
+    auto start = std::chrono::steady_clock::now();
+    func();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+// Пустая команда: измеряем только накладные расходы очереди
+class NopCommand : public Command {
+public:
+    void Execute() override {}
+
+    std::string GetName() const override {
+        return "NopCommand";
+    }
+};
+
+// Накладные расходы статистики команд на одну команду
+void benchmarkCommandStats() {
+    const int commandsNumber = 1000000;
+    auto cmd = std::make_shared<NopCommand>();
+
+    auto run = [&](bool statsEnabled) {
+        CommandStats::Instance().SetEnabled(statsEnabled);
+        CommandQueue queue;
+        for (int i = 0; i < commandsNumber; ++i) {
+            queue.AddCommand(cmd);
+        }
+        return measureNanos([&] { queue.ProcessCommands(); }) / commandsNumber;
+    };
+
+    run(true);  // Прогрев
+    double disabled = run(false);
+    double enabled = run(true);
+    std::cout << "CommandQueue, stats disabled: " << disabled << " ns/command\n";
+    std::cout << "CommandQueue, stats enabled:  " << enabled << " ns/command\n";
+    std::cout << "Stats overhead: " << enabled - disabled << " ns/command\n";
+}
+
+Behavior cruise(SpaceShip& ship, int ticks) {
+    for (int i = 0; i < ticks; ++i) {
+        Movement::Move(ship);
+        co_await NextTick();
+    }
+}
+
+// Долгое движение: новая команда на каждый тик, корутина на весь полет и повторяющаяся команда
+void benchmarkCoroutineBehaviors() {
+    const int shipsNumber = 10000;
+    const int ticks = 100;
+    CommandStats::Instance().SetEnabled(false);
+
+    std::vector<SpaceShip> ships(shipsNumber, SpaceShip(Vector(0, 0), 0));
+    for (auto& ship : ships) {
+        ship.setVelocity(Vector(1, 1));
+    }
+
+    CommandQueue commandQueue;
+    double perTickCommands = measureNanos([&] {
+        for (int tick = 0; tick < ticks; ++tick) {
+            for (auto& ship : ships) {
+                commandQueue.AddCommand(std::make_shared<MoveCommand>(ship));
+            }
+            commandQueue.ProcessCommands();
+        }
+    }) / ticks;
+
+    CommandQueue coroutineQueue;
+    double perTickCoroutines = measureNanos([&] {
+        for (auto& ship : ships) {
+            coroutineQueue.Spawn(cruise(ship, ticks));
+        }
+        for (int tick = 0; tick <= ticks; ++tick) {
+            coroutineQueue.ProcessCommands();
+        }
+    }) / ticks;
+
+    std::cout << shipsNumber << " ships, " << ticks << " ticks\n";
+    std::cout << "Command per ship per tick: " << perTickCommands / 1e3 << " us/tick\n";
+    CommandQueue repeatQueue;
+    std::vector<RepeatHandle> handles;
+    for (auto& ship : ships) {
+        handles.push_back(repeatQueue.AddRepeating(std::make_shared<MoveCommand>(ship)));
+    }
+    double perTickRepeating = measureNanos([&] {
+        for (int tick = 0; tick < ticks; ++tick) {
+            repeatQueue.ProcessCommands();
+        }
+    }) / ticks;
+
+    std::cout << "Coroutine per ship:        " << perTickCoroutines / 1e3 << " us/tick\n";
+    std::cout << "Repeating command:         " << perTickRepeating / 1e3 << " us/tick\n";
+    CommandStats::Instance().SetEnabled(true);
+}
+
+// Тик из 100k команд над 10k кораблями в параллельном режиме на 1..32 потоках
+void benchmarkParallelQueue() {
+    const int shipsNumber = 10000;
+    const int ticks = 20;
+    CommandStats::Instance().SetEnabled(false);
+
+    std::vector<SpaceShip> ships(shipsNumber, SpaceShip(Vector(0, 0), 0));
+    std::vector<std::shared_ptr<Command>> tick;
+    for (auto& ship : ships) {
+        ship.setFuel(1e9);
+        for (int i = 0; i < 2; ++i) {
+            tick.push_back(std::make_shared<ChangeVelocityCommand>(ship, Vector(1, 2)));
+            tick.push_back(std::make_shared<RotateAndChangeVelocity>(ship, 15, Vector()));
+            tick.push_back(std::make_shared<MoveCommand>(ship));
+            tick.push_back(std::make_shared<BurnFuelCommand>(ship, 1));
+            tick.push_back(std::make_shared<RotateAndChangeVelocity>(ship, -15, Vector()));
+        }
+    }
+
+    std::cout << tick.size() << " commands per tick, " << std::thread::hardware_concurrency()
+              << " hardware threads\n";
+    double serialTime = 0;
+    for (size_t threads : {1, 2, 4, 8, 16, 32}) {
+        ParallelExecutor executor(threads);
+        CommandQueue queue;
+        queue.SetParallelExecutor(&executor);
+        double total = 0;
+        for (int t = 0; t < ticks; ++t) {
+            for (const auto& cmd : tick) {
+                queue.AddCommand(cmd);
+            }
+            total += measureNanos([&] { queue.ProcessCommands(); });
+        }
+        double perTick = total / ticks;
+        if (threads == 1) {
+            serialTime = perTick;
+        }
+        std::cout << threads << " threads: " << perTick / 1e6 << " ms/tick, speedup "
+                  << serialTime / perTick << "\n";
+    }
+    CommandStats::Instance().SetEnabled(true);
+}
+
+// Рассылка состояния 100k кораблей, из которых движется 1%: пакет изменений против полного снимка
+void benchmarkDeltaBroadcast() {
+    const int shipsNumber = 100000;
+    const int ticks = 50;
+    World world;
+    for (int i = 0; i < shipsNumber; ++i) {
+        EntityId id = world.AddShip(Vector(i % 1000, i / 1000), 0);
+        if (i % 100 == 0) {
+            world.Ship(id).setVelocity(Vector(0.5, -0.25));
+        }
+    }
+    DeltaEncoder deltaEncoder;
+    DeltaEncoder fullEncoder;
+    deltaEncoder.EncodeFull(world, 0);
+    world.ClearDirty();
+
+    double deltaTime = 0, fullTime = 0;
+    size_t deltaBytes = 0, fullBytes = 0;
+    for (int tick = 1; tick <= ticks; ++tick) {
+        for (int i = 0; i < shipsNumber; i += 100) {
+            Movement::Move(world.Ship(i));
+        }
+        deltaTime += measureNanos([&] { deltaBytes += deltaEncoder.Encode(world, tick).size(); });
+        fullTime += measureNanos([&] { fullBytes += fullEncoder.EncodeFull(world, tick).size(); });
+        world.ClearDirty();
+    }
+    std::cout << shipsNumber << " ships, 1% moving\n";
+    std::cout << "Delta packet: " << deltaBytes / ticks << " bytes, " << deltaTime / ticks / 1e3 << " us/tick\n";
+    std::cout << "Full packet:  " << fullBytes / ticks << " bytes, " << fullTime / ticks / 1e3 << " us/tick\n";
+}
+
+// Шаг движения через интерфейс Movable& против шаблонного пути для SpaceShip
+void benchmarkDevirtualizedMove() {
+    const int shipsNumber = 100000;
+    const int ticks = 100;
+    std::vector<SpaceShip> ships(shipsNumber, SpaceShip(Vector(0, 0), 0));
+    std::vector<Movable*> movables;
+    for (auto& ship : ships) {
+        ship.setVelocity(Vector(1, 0.5));
+        movables.push_back(&ship);
+    }
+
+    double virtualTime = measureNanos([&] {
+        for (int tick = 0; tick < ticks; ++tick) {
+            for (Movable* movable : movables) {
+                Movement::Move(*movable);
+            }
+        }
+    });
+    double templateTime = measureNanos([&] {
+        for (int tick = 0; tick < ticks; ++tick) {
+            for (auto& ship : ships) {
+                Movement::Move(ship);
+            }
+        }
+    });
+    double calls = static_cast<double>(shipsNumber) * ticks;
+    std::cout << "Virtual path:  " << virtualTime / calls << " ns/move\n";
+    std::cout << "Template path: " << templateTime / calls << " ns/move\n";
+    std::cout << "Check: " << ships[0].getPosition() << "\n";
+}
+
+// Непрерывное обнаружение столкновений: 100k кораблей, случайные скорости
+void benchmarkSweptCollisions() {
+    const int shipsNumber = 100000;
+    const int ticks = 20;
+    const double side = 20000;  // Около 4 кв. единиц на корабль радиуса 1 (плотность ~0.8%)
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> coordinate(0, side);
+    std::uniform_real_distribution<double> speed(-5, 5);
+
+    World world;
+    for (int i = 0; i < shipsNumber; ++i) {
+        EntityId id = world.AddShip(Vector(coordinate(random), coordinate(random)), 0);
+        world.Ship(id).setVelocity(Vector(speed(random), speed(random)));
+    }
+    CommandQueue queue;
+    CollisionDetector detector(1.0);
+    // Столкновения только считаем: корабли продолжают движение
+    detector.SetCommandFactory([](World&, const Collision&) { return std::make_shared<NopCommand>(); });
+
+    detector.Step(world, queue);  // Прогрев: первичная сортировка
+    queue.ProcessCommands();
+
+    double moveTime = 0;
+    double detectTime = 0;
+    size_t collisions = 0;
+    for (int tick = 0; tick < ticks; ++tick) {
+        detector.BeginStep(world);
+        moveTime += measureNanos([&] { world.MoveShips(); });
+        detectTime += measureNanos([&] { collisions += detector.Detect(world, queue); });
+        queue.ProcessCommands();
+    }
+    double perShip = static_cast<double>(shipsNumber) * ticks;
+    std::cout << "Move step:       " << moveTime / perShip << " ns/ship\n";
+    std::cout << "Swept detection: " << detectTime / perShip << " ns/ship\n";
+    std::cout << "Collisions per tick: " << collisions / ticks << "\n";
+}
+
+// Журнал команд: стоимость записи в очереди и скорость повтора
+void benchmarkCommandJournal() {
+    const std::string path = "journal_benchmark.ssj";
+    const int shipsNumber = 1000;
+    const int ticks = 1000;
+    World world;
+    for (int i = 0; i < shipsNumber; ++i) {
+        world.Ship(world.AddShip(Vector(i, 0), 0)).setFuel(1e9);
+    }
+
+    auto run = [&](CommandJournal* journal) {
+        CommandQueue queue;
+        queue.SetRecorder(journal);
+        return measureNanos([&] {
+            for (int tick = 0; tick < ticks; ++tick) {
+                for (EntityId id = 0; id < shipsNumber; ++id) {
+                    SpaceShip& ship = world.Ship(id);
+                    if (tick % 8 == 0) {
+                        queue.AddCommand(std::make_shared<ChangeVelocityCommand>(ship, Vector(tick % 5, id % 3)));
+                    }
+                    queue.AddCommand(std::make_shared<MoveWithFuelCommand>(ship, 0.5));
+                }
+                queue.ProcessCommands();
+            }
+        });
+    };
+
+    double commands = shipsNumber * (ticks + ticks / 8.0);
+    run(nullptr);  // Прогрев
+    double plain = run(nullptr);
+    CommandJournal journal(world);
+    journal.Open(path);
+    double recorded = run(&journal);
+    journal.Close();
+    uint64_t checksum = WorldChecksum(world);
+
+    World replayed;
+    ReplayResult result = JournalReplay().Run(path, replayed);
+    std::cout << "Queue without journal: " << plain / commands << " ns/command\n";
+    std::cout << "Queue with journal:    " << recorded / commands << " ns/command\n";
+    std::cout << "Journal size: " << journal.BytesWritten() / commands << " bytes/command\n";
+    std::cout << "Replay: " << result.records / result.seconds / 1e6 << " M commands/s, checksum "
+              << (result.checksum == checksum ? "matches" : "DIFFERS") << "\n";
+    std::remove(path.c_str());
+}
+
+// Задержка от addTask до начала выполнения задачи в SafeQueue для каждого способа ожидания.
+// Между задачами или пачками задач рабочий поток успевает дойти до ожидания
+void benchmarkSafeQueueWait() {
+    std::streambuf* log = std::cerr.rdbuf(nullptr);  // Отладочный вывод очереди не измеряем
+    auto nowNanos = [] {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                         std::chrono::steady_clock::now().time_since_epoch()).count());
+    };
+
+    auto run = [&](WaitStrategy strategy, int bursts, int burstSize, std::chrono::microseconds gap) {
+        LatencyHistogram latency;  // Пишет только рабочий поток
+        {
+            SafeQueue queue;
+            queue.setWaitStrategy(strategy);
+            queue.start();
+            for (int burst = 0; burst < bursts; ++burst) {
+                for (int i = 0; i < burstSize; ++i) {
+                    uint64_t enqueued = nowNanos();
+                    queue.addTask([&latency, enqueued, &nowNanos] { latency.Record(nowNanos() - enqueued); });
+                }
+                auto until = std::chrono::steady_clock::now() + gap;
+                while (std::chrono::steady_clock::now() < until) {
+                    std::this_thread::yield();
+                }
+            }
+            queue.softStop();
+        }
+        std::cout << "  p50 " << latency.Percentile(50) << " ns, p99 " << latency.Percentile(99) << " ns, p99.9 "
+                  << latency.Percentile(99.9) << " ns, max " << latency.Max() << " ns\n";
+    };
+
+    const std::pair<const char*, WaitStrategy> strategies[] = {
+        {"Park", WaitStrategy::Park},
+        {"SpinThenPark", WaitStrategy::SpinThenPark},
+    };
+    for (const auto& [name, strategy] : strategies) {
+        std::cout << name << ", single tasks every 20 us:\n";
+        run(strategy, 5000, 1, std::chrono::microseconds(20));
+        std::cout << name << ", bursts of 32 tasks every 200 us:\n";
+        run(strategy, 500, 32, std::chrono::microseconds(200));
+    }
+    std::cerr.rdbuf(log);
+}
+
+// Тик нескольких миров, по миру на поток: без закрепления (миры созданы главным потоком)
+// и с закреплением потоков за процессорами (каждый мир создан своим потоком на своем узле NUMA)
+void benchmarkWorkerAffinity() {
+    const size_t threads = std::min<size_t>(8, std::max<unsigned>(2, std::thread::hardware_concurrency()));
+    const int shipsPerWorld = 50000;
+    const int ticks = 200;
+    auto populate = [&](std::unique_ptr<World>& world) {
+        world = std::make_unique<World>();
+        for (int i = 0; i < shipsPerWorld; ++i) {
+            world->Ship(world->AddShip(Vector(i, 0), 0)).setVelocity(Vector(1, 1));
+        }
+    };
+
+    auto run = [&](const char* name, bool pinned) {
+        std::vector<std::vector<int>> cpuSets;
+        if (pinned) {
+            cpuSets = CpuTopology::WorkerCpuSets(threads);
+            PinCurrentThread(cpuSets[0]);
+        }
+        ParallelExecutor executor(threads, cpuSets);
+        std::vector<std::unique_ptr<World>> worlds(threads);
+        if (pinned) {
+            executor.RunPerThread([&](size_t thread) { populate(worlds[thread]); });  // Первое касание памяти
+        } else {
+            for (auto& world : worlds) {
+                populate(world);
+            }
+        }
+
+        LatencyHistogram tickNs;
+        for (int tick = 0; tick < ticks; ++tick) {
+            double nanos = measureNanos([&] {
+                executor.RunPerThread([&](size_t thread) {
+                    worlds[thread]->MoveShips();
+                    worlds[thread]->ClearDirty();
+                });
+            });
+            tickNs.Record(static_cast<uint64_t>(nanos));
+        }
+        if (pinned) {
+            UnpinCurrentThread();
+        }
+        std::cout << name << ": mean " << tickNs.Sum() / tickNs.Count() / 1000 << " us, p99 "
+                  << tickNs.Percentile(99) / 1000 << " us per tick\n";
+    };
+
+    std::cout << threads << " worlds x " << shipsPerWorld << " ships, " << CpuTopology::Nodes().size()
+              << " NUMA node(s), " << std::thread::hardware_concurrency() << " CPU(s)\n";
+    run("Unpinned, worlds allocated by main thread", false);
+    run("Pinned, worlds allocated by owning worker", true);
+}
+
+// Команды с прямой ссылкой на корабль против команд с хэндлом (проверка поколения при каждом выполнении)
+// и шаг движения по плотному массиву кораблей после удаления половины мира
+void benchmarkShipHandles() {
+    const int shipsNumber = 100000;
+    const int ticks = 50;
+    World world;
+    for (int i = 0; i < shipsNumber; ++i) {
+        world.AddShip(Vector(i, 0), 0);
+    }
+    std::vector<std::shared_ptr<Command>> direct;
+    std::vector<std::shared_ptr<Command>> handles;
+    for (EntityId id = 0; id < shipsNumber; ++id) {
+        direct.push_back(std::make_shared<ChangeVelocityCommand>(world.Ship(id), Vector(1, 0)));
+        handles.push_back(std::make_shared<ChangeVelocityCommand>(world.Ref(id), Vector(0, 1)));
+    }
+    double directTime = measureNanos([&] {
+        for (int tick = 0; tick < ticks; ++tick) {
+            for (auto& cmd : direct) {
+                cmd->Execute();
+            }
+        }
+    });
+    double handleTime = measureNanos([&] {
+        for (int tick = 0; tick < ticks; ++tick) {
+            for (auto& cmd : handles) {
+                cmd->Execute();
+            }
+        }
+    });
+    double calls = static_cast<double>(shipsNumber) * ticks;
+    std::cout << "Direct reference: " << directTime / calls << " ns/command\n";
+    std::cout << "Handle:           " << handleTime / calls << " ns/command\n";
+
+    for (EntityId id = 0; id < shipsNumber; id += 2) {
+        world.RemoveShip(world.Handle(id));
+    }
+    double moveTime = measureNanos([&] {
+        for (int tick = 0; tick < ticks; ++tick) {
+            world.MoveShips();
+        }
+    });
+    std::cout << "MoveShips after removing half: " << moveTime / (static_cast<double>(world.Count()) * ticks)
+              << " ns/ship, " << world.Count() << " ships\n";
+}
+
+// Шаг движения мира, где почти все корабли летят по инерции: пошаговое движение против ленивого
+void benchmarkLazyMotion() {
+    const int shipsNumber = 100000;
+    const int ticks = 200;
+    auto run = [&](const char* name, bool lazyMotion) {
+        World world;
+        world.SetLazyMotion(lazyMotion);
+        for (int i = 0; i < shipsNumber; ++i) {
+            world.Ship(world.AddShip(Vector(i, 0), 0)).setVelocity(Vector(1, i % 7 == 0 ? 0.1 : 0.5));
+        }
+        double nanos = measureNanos([&] {
+            for (int tick = 0; tick < ticks; ++tick) {
+                world.MoveShips();
+                world.ClearDirty();
+            }
+        });
+        std::cout << name << ": " << nanos / ticks / 1000 << " us/tick, check " << world.Ship(7).getPosition()
+                  << "\n";
+    };
+    run("Step by step", false);
+    run("Lazy        ", true);
+}
+
+// Шаг движения мира, где движется 1% кораблей: стоимость тика зависит от числа движущихся
+void benchmarkActiveSet() {
+    const int ticks = 200;
+    for (int shipsNumber : {10000, 100000, 1000000}) {
+        World world;
+        for (int i = 0; i < shipsNumber; ++i) {
+            EntityId id = world.AddShip(Vector(i, 0), 0);
+            if (i % 100 == 0) {
+                world.Ship(id).setVelocity(Vector(0.1, 0.2));
+            }
+        }
+        double nanos = measureNanos([&] {
+            for (int tick = 0; tick < ticks; ++tick) {
+                world.MoveShips();
+            }
+        });
+        std::cout << shipsNumber << " ships, " << world.SteppingCount() << " moving: " << nanos / ticks / 1000
+                  << " us/tick\n";
+    }
+}
+
+// Клиенты шлют по нескольку команд на корабль за тик: очередь напрямую против слияния перед очередью
+void benchmarkCommandCoalescing() {
+    const int shipsNumber = 10000;
+    const int ticks = 50;
+    auto run = [&](const char* name, bool coalesce) {
+        World world;
+        for (int i = 0; i < shipsNumber; ++i) {
+            world.Ship(world.AddShip(Vector(i, 0), 0)).setFuel(1e9);
+        }
+        CommandQueue queue;
+        CommandCoalescer coalescer(queue);
+        auto add = [&](std::shared_ptr<Command> cmd) {
+            if (coalesce) {
+                coalescer.AddCommand(std::move(cmd));
+            } else {
+                queue.AddCommand(std::move(cmd));
+            }
+        };
+        double ingestNanos = 0;
+        double processNanos = 0;
+        for (int tick = 0; tick < ticks; ++tick) {
+            ingestNanos += measureNanos([&] {
+                for (EntityId id = 0; id < shipsNumber; ++id) {
+                    for (int input = 0; input < 4; ++input) {
+                        add(std::make_shared<ChangeVelocityCommand>(world.Ref(id), Vector(input, tick)));
+                    }
+                    add(std::make_shared<BurnFuelCommand>(world.Ref(id), 1));
+                    add(std::make_shared<BurnFuelCommand>(world.Ref(id), 2));
+                }
+                coalescer.Flush();
+            });
+            processNanos += measureNanos([&] { queue.ProcessCommands(); });
+        }
+        std::cout << name << ": ingest " << ingestNanos / ticks / 1000 << " us/tick, process "
+                  << processNanos / ticks / 1000 << " us/tick, elided " << coalescer.Elided() << " of "
+                  << coalescer.Received() << ", check " << world.Ship(7).getFuel() << "\n";
+    };
+    run("Queue only", false);
+    run("Coalesced ", true);
+}
+
+// Шаг движения с топливом: корабли SpaceShip против системы над плотными массивами компонентов.
+// Половина сущностей — неподвижные астероиды (только положение): система их не обходит
+void benchmarkComponentSystems() {
+    const int entities = 100000;
+    const int ticks = 100;
+    std::vector<SpaceShip> ships(entities / 2, SpaceShip(Vector(0, 0), 0));
+    for (auto& ship : ships) {
+        ship.setVelocity(Vector(1, 0.5));
+        ship.setFuel(1e9);
+    }
+    ComponentRegistry registry;
+    for (int i = 0; i < entities; ++i) {
+        EntityId id = registry.Create();
+        registry.Add(id, PositionComponent{Vector(0, 0)});
+        if (i % 2 == 0) {
+            registry.Add(id, VelocityComponent{Vector(1, 0.5)});
+            registry.Add(id, FuelComponent{1e9});
+        }
+    }
+
+    double shipTime = measureNanos([&] {
+        for (int tick = 0; tick < ticks; ++tick) {
+            for (auto& ship : ships) {
+                MoveWithFuelCommand(ship, 1).Execute();
+            }
+        }
+    });
+    double systemTime = measureNanos([&] {
+        for (int tick = 0; tick < ticks; ++tick) {
+            MoveWithFuelCommand::MoveAll(registry, 1);
+        }
+    });
+    double moves = static_cast<double>(entities / 2) * ticks;
+    std::cout << "SpaceShip commands: " << shipTime / moves << " ns/move\n";
+    std::cout << "Component system:   " << systemTime / moves << " ns/move\n";
+    std::cout << "Check: " << ships[0].getPosition() << " " << registry.Get<PositionComponent>(0).value << "\n";
+}
+
+// Один и тот же сценарий (проверка топлива, поворот, четыре шага с топливом, смена скорости):
+// MacroCommand из объектов-команд на каждый корабль против общего байткода
+void benchmarkCommandScripts() {
+    const int shipsNumber = 10000;
+    const int ticks = 50;
+    auto makeShips = [&] {
+        std::vector<SpaceShip> ships(shipsNumber, SpaceShip(Vector(0, 0), 0));
+        for (auto& ship : ships) {
+            ship.setVelocity(Vector(1, 0.5));
+            ship.setFuel(1e9);
+        }
+        return ships;
+    };
+
+    std::vector<SpaceShip> macroShips = makeShips();
+    std::vector<MacroCommand> macros;
+    macros.reserve(shipsNumber);
+    double buildNanos = measureNanos([&] {
+        for (auto& ship : macroShips) {
+            std::vector<std::shared_ptr<Command>> commands = {std::make_shared<CheckFuelCommand>(ship, 4),
+                                                              std::make_shared<RotateAndChangeVelocity>(ship, 1, Vector())};
+            for (int step = 0; step < 4; ++step) {
+                commands.push_back(std::make_shared<MoveWithFuelCommand>(ship, 1));
+            }
+            commands.push_back(std::make_shared<ChangeVelocityCommand>(ship, Vector(1, 0.5)));
+            macros.emplace_back(commands);
+        }
+    });
+    double macroNanos = measureNanos([&] {
+        for (int tick = 0; tick < ticks; ++tick) {
+            for (auto& macro : macros) {
+                macro.Execute();
+            }
+        }
+    });
+
+    std::vector<SpaceShip> scriptShips = makeShips();
+    std::shared_ptr<const CompiledScript> script;
+    double compileNanos = measureNanos([&] {
+        script = std::make_shared<const CompiledScript>(ScriptCompiler::Compile(
+            "check_fuel 4\nrotate 1\nrepeat 4\nmove_with_fuel 1\nend\nvelocity 1 0.5\n"));
+    });
+    double scriptNanos = measureNanos([&] {
+        for (int tick = 0; tick < ticks; ++tick) {
+            for (auto& ship : scriptShips) {
+                ScriptInterpreter::Run(*script, ship);
+            }
+        }
+    });
+
+    double runs = static_cast<double>(shipsNumber) * ticks;
+    // Разовый приказ: MacroCommand собирается для каждого корабля, байткод уже готов
+    std::cout << "MacroCommand: build " << buildNanos / shipsNumber << " ns/ship, execute " << macroNanos / runs
+              << " ns/run, one-shot " << buildNanos / shipsNumber + macroNanos / runs << " ns\n";
+    std::cout << "Script:       compile " << compileNanos / 1000 << " us once (" << script->code.size()
+              << " instructions), execute " << scriptNanos / runs << " ns/run, one-shot " << scriptNanos / runs
+              << " ns\n";
+    std::cout << "Check: " << macroShips[7].getPosition() << " " << scriptShips[7].getPosition() << "\n";
+}
+
+// Положения всех кораблей на K тиков вперед: копии кораблей и Movement::Move против пакетного предсказания.
+// Большой буфер (10000 × 60, 9.6 МБ) упирается в пропускную способность памяти при любом способе
+void benchmarkTrajectoryPrediction() {
+    auto run = [](int shipsNumber, size_t ticks) {
+        const int repeats = 20000000 / (shipsNumber * static_cast<int>(ticks)) + 1;
+        World world;
+        CommandQueue queue;
+        for (int i = 0; i < shipsNumber; ++i) {
+            EntityId id = world.AddShip(Vector(i, 0), 0);
+            world.Ship(id).setVelocity(Vector(0.5, i % 7 - 3));
+            if (i % 10 == 0) {
+                queue.AddCommand(std::make_shared<RotateAndChangeVelocity>(world.Ref(id), 15, Vector()));
+            }
+        }
+
+        std::vector<Vector> copied(ticks * shipsNumber);
+        double copyNanos = measureNanos([&] {
+            for (int repeat = 0; repeat < repeats; ++repeat) {
+                for (EntityId id = 0; id < static_cast<EntityId>(shipsNumber); ++id) {
+                    SpaceShip ship(world.Ship(id));
+                    for (size_t tick = 0; tick < ticks; ++tick) {
+                        copied[tick * shipsNumber + id] = Movement::Move(ship).getPosition();
+                    }
+                }
+            }
+        });
+
+        TrajectoryPredictor predictor;
+        predictor.Predict(world, ticks, queue);  // Буферы выделяются один раз, как и copied
+        double batchNanos = measureNanos([&] {
+            for (int repeat = 0; repeat < repeats; ++repeat) {
+                predictor.Predict(world, ticks, queue);
+            }
+        });
+
+        double positions = static_cast<double>(shipsNumber) * ticks * repeats;
+        std::cout << shipsNumber << " ships x " << ticks << " ticks: copies + Move " << copyNanos / positions
+                  << " ns/position (pending commands ignored), batched " << batchNanos / positions
+                  << " ns/position, check " << copied[(ticks - 1) * shipsNumber + 1] << " "
+                  << predictor.At(ticks, 1) << "\n";
+    };
+    run(1000, 16);
+    run(10000, 60);
+}
+
+// 32 потока сжигают топливо одного корабля: CAS на фиксированной точке против мьютекса на корабль
+void benchmarkFuelContention() {
+    const int threadsNumber = 32;
+    const int burnsPerThread = 200000;
+
+    struct LockedFuel {
+        std::mutex mutex;
+        double fuel = 0;
+
+        bool TryBurn(double amount) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (fuel < amount) {
+                return false;
+            }
+            fuel -= amount;
+            return true;
+        }
+    };
+
+    auto run = [&](int threads, auto&& burn) {
+        std::vector<std::thread> workers;
+        return measureNanos([&] {
+            for (int t = 0; t < threads; ++t) {
+                workers.emplace_back([&] {
+                    for (int i = 0; i < burnsPerThread; ++i) {
+                        burn();
+                    }
+                });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }) / (static_cast<double>(threads) * burnsPerThread);
+    };
+
+    for (int threads : {1, threadsNumber}) {
+        SpaceShip ship(Vector(0, 0), 0);
+        ship.setFuel(1e9);
+        BurnFuelCommand burn(ship, 1);
+        double casNanos = run(threads, [&] { burn.Execute(); });
+
+        LockedFuel locked;
+        locked.fuel = 1e9;
+        double mutexNanos = run(threads, [&] { locked.TryBurn(1); });
+
+        std::cout << threads << " threads: atomic BurnFuelCommand " << casNanos << " ns/burn, mutex " << mutexNanos
+                  << " ns/burn, check " << ship.getFuel() << " " << locked.fuel << "\n";
+    }
+}
+
+// Разбор movable.h: токенизатор генератора адаптеров против прежнего поиска регулярными выражениями
+// (регулярное выражение на каждый метод, только первый абстрактный класс, список методов задан вручную)
+void benchmarkAdapterGenerator() {
+    const int repeats = 2000;
+    std::ifstream file("movable.h");
+    if (!file.is_open()) {
+        file.open("../movable.h");
+    }
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (content.empty()) {
+        std::cout << "movable.h not found: run from the source or build directory\n";
+        return;
+    }
+
+    size_t regexFound = 0;
+    double regexNanos = measureNanos([&] {
+        const std::vector<std::string> methods = {"Vector getPosition()", "void setPosition(Vector newValue)",
+                                                  "Vector getVelocity()"};
+        for (int repeat = 0; repeat < repeats; ++repeat) {
+            std::regex classRegex(R"(class\s+(\w+)\s*\{\s*public\s*:\s*virtual)");
+            std::smatch match;
+            if (std::regex_search(content, match, classRegex)) {
+                for (const auto& method : methods) {
+                    std::regex methodRegex(R"((\w+)\s+(\w+)\s*\(([^)]*)\))");
+                    std::smatch methodMatch;
+                    regexFound += std::regex_match(method, methodMatch, methodRegex);
+                }
+            }
+        }
+    });
+
+    size_t tokenizerFound = 0;
+    double tokenizerNanos = measureNanos([&] {
+        for (int repeat = 0; repeat < repeats; ++repeat) {
+            for (const auto& info : InterfaceParser::Parse(HeaderTokenizer::Tokenize(content))) {
+                tokenizerFound += info.methods.size();
+            }
+        }
+    });
+
+    std::cout << "std::regex:  " << regexNanos / repeats / 1000 << " us/header, " << regexFound / repeats
+              << " methods of 1 interface\n";
+    std::cout << "Tokenizer:   " << tokenizerNanos / repeats / 1000 << " us/header, " << tokenizerFound / repeats
+              << " methods of all interfaces\n";
+}
+
+// Передача команд между процессами через кольцо в разделяемой памяти: один и два процесса-производителя,
+// без пакетной публикации и с ней; для сравнения — то же кольцо между потоками и SafeQueue::addTask.
+// Потребитель (этот процесс) читает записи и суммирует их, чтобы чтение не выбрасывалось
+void benchmarkSharedRing() {
+    const int records = 2000000;
+    const uint32_t capacity = 4096;
+    const std::string name = "/spaceship_ring_bench_" + std::to_string(getpid());
+
+    auto produce = [](SharedCommandRing& ring, uint32_t batch, int count) {
+        RingProducer producer(ring, batch);
+        for (int i = 0; i < count; ++i) {
+            CommandRecord record = CommandRecord::ChangeVelocity(ShipHandle{static_cast<EntityId>(i & 1023), 0},
+                                                                 Vector(i, 1));
+            record.steps = i;
+            producer.Push(record);
+        }
+    };
+
+    auto consume = [](SharedCommandRing& ring, size_t total) {
+        RingConsumer consumer(ring);
+        uint64_t sum = 0;
+        size_t received = 0;
+        uint32_t spins = 0;
+        while (received < total) {
+            size_t polled = consumer.Poll([&](const CommandRecord& record) { sum += record.steps; });
+            received += polled;
+            if (polled == 0) {
+                SharedCommandRing::Wait(spins);
+            } else {
+                spins = 0;
+            }
+        }
+        return sum;
+    };
+
+    auto crossProcess = [&](const char* label, RingMode mode, int producers, uint32_t batch) {
+        SharedCommandRing ring;
+        if (!ring.Create(name, capacity, mode)) {
+            std::cout << label << ": " << ring.Error() << "\n";
+            return;
+        }
+        uint64_t sum = 0;
+        std::vector<pid_t> children;
+        double nanos = measureNanos([&] {
+            for (int p = 0; p < producers; ++p) {
+                pid_t child = fork();
+                if (child == 0) {
+                    SharedCommandRing shared;
+                    if (!shared.Open(name)) {
+                        _exit(1);
+                    }
+                    produce(shared, batch, records / producers);
+                    _exit(0);
+                }
+                children.push_back(child);
+            }
+            sum = consume(ring, static_cast<size_t>(records / producers) * producers);
+        });
+        for (pid_t child : children) {
+            waitpid(child, nullptr, 0);
+        }
+        SharedCommandRing::Unlink(name);
+        std::cout << label << ": " << nanos / records << " ns/record, check " << sum << "\n";
+    };
+
+    crossProcess("Process -> process, SPSC, batch 1 ", RingMode::SingleProducer, 1, 1);
+    crossProcess("Process -> process, SPSC, batch 32", RingMode::SingleProducer, 1, 32);
+    crossProcess("2 processes -> process, MPSC, batch 32", RingMode::MultiProducer, 2, 32);
+
+    {
+        SharedCommandRing ring;
+        if (ring.Create(name, capacity, RingMode::SingleProducer)) {
+            uint64_t sum = 0;
+            double nanos = measureNanos([&] {
+                std::thread producer([&] { produce(ring, 32, records); });
+                sum = consume(ring, records);
+                producer.join();
+            });
+            SharedCommandRing::Unlink(name);
+            std::cout << "Thread -> thread, same ring, batch 32: " << nanos / records << " ns/record, check " << sum
+                      << "\n";
+        }
+    }
+
+    std::streambuf* log = std::cerr.rdbuf(nullptr);  // Отладочный вывод очереди не измеряем
+    uint64_t sum = 0;
+    double nanos = measureNanos([&] {
+        SafeQueue queue;
+        queue.start();
+        std::thread producer([&] {
+            for (int i = 0; i < records; ++i) {
+                queue.addTask([&sum, i] { sum += i; });
+            }
+        });
+        producer.join();
+        queue.softStop();
+    });
+    std::cerr.rdbuf(log);
+    std::cout << "Thread -> SafeQueue::addTask: " << nanos / records << " ns/task, check " << sum << "\n";
+
+    // Полный путь: запись -> команда -> CommandQueue
+    World world;
+    for (int i = 0; i < 1024; ++i) {
+        world.AddShip(Vector(i, 0), 0);
+    }
+    SharedCommandRing ring;
+    if (ring.Create(name, capacity, RingMode::SingleProducer)) {
+        const int commands = records / 4;
+        CommandQueue queue;
+        RingCommandFeeder feeder(ring, world);
+        size_t added = 0;
+        pid_t child = -1;
+        double feedNanos = measureNanos([&] {
+            child = fork();
+            if (child == 0) {
+                SharedCommandRing shared;
+                if (!shared.Open(name)) {
+                    _exit(1);
+                }
+                produce(shared, 32, commands);
+                _exit(0);
+            }
+            uint32_t spins = 0;
+            while (added < static_cast<size_t>(commands)) {
+                size_t fed = feeder.Feed(queue, 1024);
+                added += fed;
+                queue.ProcessCommands();
+                if (fed == 0) {
+                    SharedCommandRing::Wait(spins);
+                }
+            }
+        });
+        waitpid(child, nullptr, 0);
+        SharedCommandRing::Unlink(name);
+        std::cout << "Process -> RingCommandFeeder -> CommandQueue: " << feedNanos / commands
+                  << " ns/command (decode + execute), check " << world.Ship(1023).getVelocity() << "\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    std::map<std::string, std::function<void()>> benchmarks = {
+        {"commandStats", benchmarkCommandStats},
+        {"coroutineBehaviors", benchmarkCoroutineBehaviors},
+        {"parallelQueue", benchmarkParallelQueue},
+        {"deltaBroadcast", benchmarkDeltaBroadcast},
+        {"devirtualizedMove", benchmarkDevirtualizedMove},
+        {"sweptCollisions", benchmarkSweptCollisions},
+        {"commandJournal", benchmarkCommandJournal},
+        {"safeQueueWait", benchmarkSafeQueueWait},
+        {"workerAffinity", benchmarkWorkerAffinity},
+        {"componentSystems", benchmarkComponentSystems},
+        {"shipHandles", benchmarkShipHandles},
+        {"lazyMotion", benchmarkLazyMotion},
+        {"activeSet", benchmarkActiveSet},
+        {"commandCoalescing", benchmarkCommandCoalescing},
+        {"commandScripts", benchmarkCommandScripts},
+        {"trajectoryPrediction", benchmarkTrajectoryPrediction},
+        {"fuelContention", benchmarkFuelContention},
+        {"adapterGenerator", benchmarkAdapterGenerator},
+        {"sharedRing", benchmarkSharedRing},
+    };
+
+    if (argc < 2) {
+        for (const auto& [name, benchmark] : benchmarks) {
+            std::cout << "=== " << name << "\n";
+            benchmark();
+        }
+        return 0;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        auto it = benchmarks.find(argv[i]);
+        if (it == benchmarks.end()) {
+            std::cerr << "Unknown benchmark: " << argv[i] << std::endl;
+            return 1;
+        }
+        std::cout << "=== " << it->first << "\n";
+        it->second();
+    }
+    return 0;
+}
@@ -1,21 +1,57 @@
 #pragma once
-#include "spaceship.h"
+#include <vector>
+#include "world.h"
+#include "components.h"
 #include "exception_queue.h"
 #include <stdexcept>
 
 class BurnFuelCommand : public Command {
 private:
-    SpaceShip& ship;
+    ShipRef ship;
     double fuelToBurn;
+    int64_t unitsToBurn;  // Перевод в фиксированную точку один раз, при создании
 
 public:
-    BurnFuelCommand(SpaceShip& ship, double fuel) : ship(ship), fuelToBurn(fuel) {}
+    BurnFuelCommand(ShipRef ship, double fuel)
+        : ship(ship), fuelToBurn(fuel), unitsToBurn(SpaceShip::toFuelUnits(fuel)) {}
 
+    // Безопасно при одновременном сжигании из нескольких потоков: см. SpaceShip::tryBurnFuelUnits
     void Execute() override {
-        ship.burnFuel(fuelToBurn);
+        if (!ship.Get().tryBurnFuelUnits(unitsToBurn)) {
+            throw std::runtime_error("Not enough fuel to burn.");
+        }
+    }
+
+    // Системный вариант: сжигает fuel у всех сущностей с топливом. Сущности, у которых топлива
+    // не хватает, не меняются и добавляются в lacking. Возвращает количество сжегших
+    static size_t BurnAll(ComponentRegistry& registry, double fuel, std::vector<EntityId>* lacking = nullptr) {
+        SparseSet<FuelComponent>& storage = registry.Storage<FuelComponent>();
+        std::vector<FuelComponent>& data = storage.Data();
+        size_t burned = 0;
+        for (size_t i = 0; i < data.size(); ++i) {
+            if (data[i].amount >= fuel) {
+                data[i].amount -= fuel;
+                ++burned;
+            } else if (lacking) {
+                lacking->push_back(storage.Entities()[i]);
+            }
+        }
+        return burned;
+    }
+
+    double GetFuel() const {
+        return fuelToBurn;
     }
 
     std::string GetName() const override {
         return "BurnFuelCommand";
     }
+
+    const void* GetTarget() const override {
+        return ship.TryGet();
+    }
+
+    TargetKey GetTargetKey() const override {
+        return ship.Key();
+    }
 };
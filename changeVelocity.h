@@ -1,22 +1,34 @@
 #pragma once
-#include "spaceship.h"
+#include "world.h"
 #include "vector.h"
 #include "exception_queue.h"
 
 class ChangeVelocityCommand : public Command {
 private:
-    SpaceShip& ship;
+    ShipRef ship;
     Vector newVelocity;
 
 public:
-    ChangeVelocityCommand(SpaceShip& ship, const Vector& velocity)
+    ChangeVelocityCommand(ShipRef ship, const Vector& velocity)
         : ship(ship), newVelocity(velocity) {}
 
     void Execute() override {
-        ship.setVelocity(newVelocity);
+        ship.Get().setVelocity(newVelocity);
+    }
+
+    const Vector& GetVelocity() const {
+        return newVelocity;
     }
 
     std::string GetName() const override {
         return "ChangeVelocityCommand";
     }
+
+    const void* GetTarget() const override {
+        return ship.TryGet();
+    }
+
+    TargetKey GetTargetKey() const override {
+        return ship.Key();
+    }
 };
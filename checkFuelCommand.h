@@ -1,23 +1,59 @@
 #pragma once
-#include "spaceship.h"
+#include <vector>
+#include "world.h"
+#include "components.h"
 #include "exception_queue.h"
 #include <stdexcept>
 
 class CheckFuelCommand : public Command {
 private:
-    SpaceShip& ship;
+    ShipRef ship;
     double requiredFuel;
+    int64_t requiredUnits;
 
 public:
-    CheckFuelCommand(SpaceShip& ship, double fuel) : ship(ship), requiredFuel(fuel) {}
+    CheckFuelCommand(ShipRef ship, double fuel)
+        : ship(ship), requiredFuel(fuel), requiredUnits(SpaceShip::toFuelUnits(fuel)) {}
 
     void Execute() override {
-        if (ship.getFuel() < requiredFuel) {
+        if (ship.Get().getFuelUnits() < requiredUnits) {
             throw std::runtime_error("Not enough fuel to execute the command.");
         }
     }
 
+    // Системный вариант: сущности, у которых меньше fuel топлива, добавляются в lacking.
+    // Возвращает количество таких сущностей
+    static size_t CheckAll(const ComponentRegistry& registry, double fuel, std::vector<EntityId>& lacking) {
+        const SparseSet<FuelComponent>& storage = registry.Storage<FuelComponent>();
+        const std::vector<FuelComponent>& data = storage.Data();
+        size_t found = 0;
+        for (size_t i = 0; i < data.size(); ++i) {
+            if (data[i].amount < fuel) {
+                lacking.push_back(storage.Entities()[i]);
+                ++found;
+            }
+        }
+        return found;
+    }
+
+    double GetRequiredFuel() const {
+        return requiredFuel;
+    }
+
     std::string GetName() const override {
         return "CheckFuelCommand";
     }
+
+    const void* GetTarget() const override {
+        return ship.TryGet();
+    }
+
+    TargetKey GetTargetKey() const override {
+        return ship.Key();
+    }
 };
+
+// Ожидание корутиной-командой нужного запаса топлива
+inline auto WaitFuel(const SpaceShip& ship, double fuel) {
+    return WaitUntil([&ship, fuel] { return ship.getFuel() >= fuel; });
+}
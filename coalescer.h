@@ -0,0 +1,235 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+#include "exception_queue.h"
+#include "changeVelocity.h"
+#include "burnFuelCommand.h"
+#include "rotateAndChangeVelocity.h"
+
+// Команды одной сущности, занимающие одну запись очереди. Выполняются по порядку;
+// исключение команды не останавливает следующие. Ошибки собираются и бросаются вместе после всех команд
+// (CommandFailures): обработчик очереди передает каждую в HandleException — как у отдельных записей.
+// Сама запись очередь не трогает, поэтому может выполняться в полосе параллельного режима
+class CoalescedCommand : public Command {
+private:
+    std::vector<std::shared_ptr<Command>> commands;
+    size_t failures = 0;
+
+public:
+    explicit CoalescedCommand(std::vector<std::shared_ptr<Command>> commands) : commands(std::move(commands)) {}
+
+    void AddCommand(std::shared_ptr<Command> cmd) {
+        commands.push_back(std::move(cmd));
+    }
+
+    void Execute() override {
+        std::vector<CommandFailures::Failure> errors;
+        for (const auto& cmd : commands) {
+            try {
+                cmd->Execute();
+            } catch (const std::exception&) {
+                errors.push_back(CommandFailures::Failure{cmd, std::current_exception()});
+            }
+        }
+        failures = errors.size();
+        if (!errors.empty()) {
+            throw CommandFailures(std::move(errors));
+        }
+    }
+
+    const std::vector<std::shared_ptr<Command>>& GetCommands() const {
+        return commands;
+    }
+
+    // Команды, бросившие исключение при последнем выполнении
+    size_t Failures() const {
+        return failures;
+    }
+
+    std::string GetName() const override {
+        return "CoalescedCommand";
+    }
+
+    // Цель определяется при разборе очереди, а не при сборке записи: адрес корабля к тому времени
+    // может смениться. Все команды записи обязаны указывать на одну и ту же сущность
+    const void* GetTarget() const override {
+        const void* target = commands.empty() ? nullptr : commands.front()->GetTarget();
+        for (const auto& cmd : commands) {
+            if (cmd->GetTarget() != target) {
+                return nullptr;
+            }
+        }
+        return target;
+    }
+
+    TargetKey GetTargetKey() const override {
+        return commands.empty() ? TargetKey{} : commands.front()->GetTargetKey();
+    }
+};
+
+// Слияние команд одного корабля за тик перед очередью.
+// Соседние (в порядке команд этого корабля) команды одного типа:
+//   ChangeVelocityCommand — побеждает последняя, предыдущие не выполняются;
+//   BurnFuelCommand, RotateAndChangeVelocity — собираются в одну запись очереди (CoalescedCommand).
+// Сложение топлива или углов в одну команду изменило бы округление и исход нехватки топлива,
+// поэтому такие команды выполняются по очереди внутри записи, а ошибки каждой обрабатывает очередь.
+// Команда без цели — барьер: через нее команды не сливаются.
+// Записи ищутся по GetTargetKey(), а не по адресу: удаление и добавление кораблей между командами
+// тика переносят корабли в памяти, и по адресу слились бы команды разных кораблей.
+// Прямую ссылку на корабль (ключ — адрес) нельзя сопоставить с хэндлом, поэтому смена вида ключа — тоже барьер
+class CommandCoalescer {
+public:
+    explicit CommandCoalescer(CommandQueue& queue) : queue(queue) {}
+
+    CommandCoalescer(const CommandCoalescer&) = delete;
+    CommandCoalescer& operator=(const CommandCoalescer&) = delete;
+
+    void AddCommand(std::shared_ptr<Command> cmd) {
+        ++received;
+        if (!cmd->GetTarget()) {
+            pending.push_back(Entry{std::move(cmd), Other, nullptr});
+            ForgetTargets();  // Барьер: прежние записи больше не находятся
+            return;
+        }
+        Kind kind = kinds.Get(typeid(*cmd));
+        TargetKey target = cmd->GetTargetKey();
+        bool byHandle = target.second != 0;
+        if (byHandle != handleKeys) {
+            ForgetTargets();
+            handleKeys = byHandle;
+        }
+        TargetSlot& slot = Find(target);
+        if (kind != Other && slot.stamp == stamp && pending[slot.index].kind == kind) {
+            Entry& entry = pending[slot.index];
+            if (kind == Velocity) {
+                entry.cmd = std::move(cmd);
+                ++superseded;
+                return;
+            }
+            if (!entry.batch) {
+                std::vector<std::shared_ptr<Command>> commands;
+                commands.reserve(4);
+                commands.push_back(std::move(entry.cmd));
+                entry.batch = std::make_shared<CoalescedCommand>(std::move(commands));
+                entry.cmd = entry.batch;
+            }
+            entry.batch->AddCommand(std::move(cmd));
+            ++merged;
+            return;
+        }
+        if (slot.stamp != stamp) {
+            slot = TargetSlot{target, 0, stamp};
+            ++targets;
+        }
+        slot.index = static_cast<uint32_t>(pending.size());
+        pending.push_back(Entry{std::move(cmd), kind, nullptr});
+    }
+
+    // Передача собранного за тик в очередь; вызывается перед CommandQueue::ProcessCommands.
+    // Возвращает количество переданных записей
+    size_t Flush() {
+        size_t flushed = pending.size();
+        for (Entry& entry : pending) {
+            queue.AddCommand(std::move(entry.cmd));
+        }
+        pending.clear();
+        ForgetTargets();
+        return flushed;
+    }
+
+    uint64_t Received() const {
+        return received;
+    }
+
+    // Команды, замененные более поздней и не выполненные
+    uint64_t Superseded() const {
+        return superseded;
+    }
+
+    // Команды, выполненные внутри чужой записи очереди
+    uint64_t Merged() const {
+        return merged;
+    }
+
+    // Сэкономленные записи очереди
+    uint64_t Elided() const {
+        return superseded + merged;
+    }
+
+private:
+    enum Kind : uint8_t {
+        Other,
+        Velocity,
+        Burn,
+        Rotate,
+    };
+
+    struct Entry {
+        std::shared_ptr<Command> cmd;
+        Kind kind;
+        std::shared_ptr<CoalescedCommand> batch;  // Запись уже собрана из нескольких команд
+    };
+
+    // Последняя запись цели после барьера. Открытая адресация; сброс — смена метки, без очистки таблицы
+    struct TargetSlot {
+        TargetKey target;
+        uint32_t index = 0;
+        uint32_t stamp = 0;  // Запись действительна, если совпадает с текущей меткой
+    };
+
+    TargetSlot& Find(const TargetKey& target) {
+        if (targets * 2 >= table.size()) {
+            Grow();
+        }
+        size_t mask = table.size() - 1;
+        size_t index = Hash(target) & mask;
+        while (table[index].stamp == stamp && table[index].target != target) {
+            index = (index + 1) & mask;
+        }
+        return table[index];
+    }
+
+    static size_t Hash(const TargetKey& key) {
+        uint64_t hash = (reinterpret_cast<uintptr_t>(key.first) >> 4) * 0x9E3779B97F4A7C15ull ^ key.second;
+        hash *= 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(hash >> 32);
+    }
+
+    void ForgetTargets() {
+        targets = 0;
+        if (++stamp == 0) {  // Переполнение метки: старые ячейки стираются явно
+            table.assign(table.size(), TargetSlot());
+            stamp = 1;
+        }
+    }
+
+    // Таблица растет вдвое; живые записи переносятся, устаревшие отбрасываются
+    void Grow() {
+        std::vector<TargetSlot> old = std::move(table);
+        table.assign(old.empty() ? 1024 : old.size() * 2, TargetSlot());
+        targets = 0;
+        for (const TargetSlot& slot : old) {
+            if (slot.stamp == stamp) {
+                Find(slot.target) = slot;
+                ++targets;
+            }
+        }
+    }
+
+    CommandQueue& queue;
+    std::vector<Entry> pending;
+    std::vector<TargetSlot> table;
+    size_t targets = 0;  // Занятые ячейки с текущей меткой
+    bool handleKeys = true;  // Ключи записей после барьера — хэндлы, а не адреса
+    uint32_t stamp = 1;
+    TypeKindCache<Kind> kinds{Other,
+                              {{&typeid(ChangeVelocityCommand), Velocity},
+                               {&typeid(BurnFuelCommand), Burn},
+                               {&typeid(RotateAndChangeVelocity), Rotate}}};
+    uint64_t received = 0;
+    uint64_t superseded = 0;
+    uint64_t merged = 0;
+};
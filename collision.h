@@ -0,0 +1,354 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "world.h"
+#include "exception_queue.h"
+
+// Столкновение за шаг движения. time — доля шага [0, 1], в которую объекты коснулись.
+// Для препятствия second — номер препятствия
+struct Collision {
+    EntityId first = 0;
+    EntityId second = 0;
+    bool obstacle = false;
+    double time = 0;
+    Vector firstContact;   // Положение first в момент его самого раннего касания за шаг
+    Vector secondContact;
+};
+
+// Обработка столкновения по умолчанию: корабли останавливаются в точке касания, не пролетая сквозь.
+// Команда выполняется на следующем тике после обнаружения, поэтому корабли держатся хэндлами:
+// корабль, удаленный в промежутке, дает std::out_of_range при выполнении, как у остальных команд
+class CollisionCommand : public Command {
+private:
+    Collision collision;
+    ShipRef first;
+    ShipRef second;  // Для препятствия совпадает с first
+
+public:
+    CollisionCommand(World& world, const Collision& collision)
+        : collision(collision), first(world.Ref(collision.first)),
+          second(collision.obstacle ? first : world.Ref(collision.second)) {}
+
+    void Execute() override {
+        SpaceShip& firstShip = first.Get();  // Оба хэндла проверяются до изменений
+        SpaceShip& secondShip = second.Get();
+        firstShip.setPosition(collision.firstContact);
+        if (!collision.obstacle) {
+            secondShip.setPosition(collision.secondContact);
+        }
+    }
+
+    const Collision& GetCollision() const {
+        return collision;
+    }
+
+    // false — один из кораблей удален, Execute завершится ошибкой
+    bool ShipsAlive() const {
+        return first.TryGet() && second.TryGet();
+    }
+
+    std::string GetName() const override {
+        return "CollisionCommand";
+    }
+
+    const void* GetTarget() const override {
+        return collision.obstacle ? first.TryGet() : nullptr;
+    }
+
+    TargetKey GetTargetKey() const override {
+        return collision.obstacle ? first.Key() : TargetKey{};
+    }
+};
+
+// Непрерывное обнаружение столкновений: корабль за шаг заметает отрезок от старой позиции к новой,
+// поэтому быстрые корабли не проскакивают друг сквозь друга и сквозь препятствия.
+// Широкая фаза — сортировка и проход по оси X (sort-and-sweep) по рамкам заметаемых областей.
+// Порядок сохраняется между шагами и досортировывается вставками: при плавном движении это почти линейно.
+// Узкая фаза — заметаемые круги друг с другом и с прямоугольниками препятствий.
+class CollisionDetector {
+public:
+    using CommandFactory = std::function<std::shared_ptr<Command>(World&, const Collision&)>;
+
+    explicit CollisionDetector(double defaultRadius = 1.0) : defaultRadius(defaultRadius) {}
+
+    void SetRadius(EntityId id, double radius) {
+        if (radii.size() <= id) {
+            radii.resize(id + 1, defaultRadius);
+        }
+        radii[id] = radius;
+    }
+
+    // Неподвижное препятствие-прямоугольник
+    size_t AddObstacle(const Vector& min, const Vector& max) {
+        obstacles.push_back(Box{std::min(min.X, max.X), std::max(min.X, max.X), std::min(min.Y, max.Y),
+                                std::max(min.Y, max.Y)});
+        return obstacles.size() - 1;
+    }
+
+    // Своя команда для события столкновения (по умолчанию — CollisionCommand)
+    void SetCommandFactory(CommandFactory factory) {
+        commandFactory = std::move(factory);
+    }
+
+    // Запоминает положения кораблей до шага движения
+    void BeginStep(const World& world) {
+        starts.resize(world.Size());
+        for (EntityId id = 0; id < world.Size(); ++id) {
+            starts[id] = world.IsAlive(id) ? world.Ship(id).getPosition() : Vector();
+        }
+    }
+
+    // Ищет столкновения на отрезках от BeginStep до текущих положений и ставит события в очередь
+    // по возрастанию времени касания. Возвращает количество событий
+    size_t Detect(World& world, CommandQueue& queue) {
+        BuildBoxes(world);
+        SortOrder();
+        Sweep();
+        std::sort(collisions.begin(), collisions.end(), [](const Collision& a, const Collision& b) {
+            if (a.time != b.time) {
+                return a.time < b.time;
+            }
+            if (a.first != b.first) {
+                return a.first < b.first;
+            }
+            return a.obstacle == b.obstacle ? a.second < b.second : !a.obstacle;
+        });
+        for (Collision& collision : collisions) {
+            collision.firstContact = ContactPoint(collision.first);
+            if (!collision.obstacle) {
+                collision.secondContact = ContactPoint(collision.second);
+            }
+            queue.AddCommand(commandFactory ? commandFactory(world, collision)
+                                            : std::make_shared<CollisionCommand>(world, collision));
+        }
+        return collisions.size();
+    }
+
+    // Шаг движения мира с обнаружением столкновений
+    size_t Step(World& world, CommandQueue& queue) {
+        BeginStep(world);
+        world.MoveShips();
+        return Detect(world, queue);
+    }
+
+    const std::vector<Collision>& LastCollisions() const {
+        return collisions;
+    }
+
+private:
+    struct Box {
+        double minX;
+        double maxX;
+        double minY;
+        double maxY;
+    };
+
+    struct Entry {
+        double minX = 0;
+        uint32_t index = 0;
+    };
+
+    double Radius(EntityId id) const {
+        return id < radii.size() ? radii[id] : defaultRadius;
+    }
+
+    Vector ContactPoint(EntityId id) const {
+        return starts[id] + displacements[id] * earliest[id];
+    }
+
+    void BuildBoxes(const World& world) {
+        size_t ships = world.Size();
+        starts.resize(ships, Vector());
+        displacements.resize(ships);
+        earliest.assign(ships, 1.0);
+        boxes.resize(ships + obstacles.size());
+        const double infinity = std::numeric_limits<double>::infinity();
+        for (EntityId id = 0; id < ships; ++id) {
+            if (!world.IsAlive(id)) {
+                // Пустая рамка удаленного корабля уходит в конец порядка и ни с чем не пересекается
+                displacements[id] = Vector();
+                boxes[id] = Box{infinity, -infinity, infinity, -infinity};
+                continue;
+            }
+            Vector end = world.Ship(id).getPosition();
+            Vector start = starts[id];
+            double radius = Radius(id);
+            displacements[id] = end - start;
+            boxes[id] = Box{std::min(start.X, end.X) - radius, std::max(start.X, end.X) + radius,
+                            std::min(start.Y, end.Y) - radius, std::max(start.Y, end.Y) + radius};
+        }
+        std::copy(obstacles.begin(), obstacles.end(), boxes.begin() + ships);
+        shipCount = ships;
+        collisions.clear();
+    }
+
+    // Ключи обновляются на месте и досортировываются вставками (данные лежат подряд);
+    // при сильном перемешивании — обычная сортировка
+    void SortOrder() {
+        if (order.size() != boxes.size()) {
+            order.resize(boxes.size());
+            for (uint32_t i = 0; i < order.size(); ++i) {
+                order[i].index = i;
+            }
+        }
+        for (Entry& entry : order) {
+            entry.minX = boxes[entry.index].minX;
+        }
+        size_t shifts = 0;
+        size_t limit = 8 * order.size() + 64;
+        for (size_t i = 1; i < order.size(); ++i) {
+            Entry key = order[i];
+            size_t j = i;
+            while (j > 0 && key.minX < order[j - 1].minX) {
+                order[j] = order[j - 1];
+                --j;
+                if (++shifts > limit) {
+                    order[j] = key;
+                    std::sort(order.begin(), order.end(),
+                              [](const Entry& a, const Entry& b) { return a.minX < b.minX; });
+                    return;
+                }
+            }
+            order[j] = key;
+        }
+    }
+
+    // Рамки копируются в порядке сортировки по отдельным массивам: внутренний цикл читает память подряд
+    // и без ветвлений отбрасывает кандидатов, не пересекающихся по Y
+    void Sweep() {
+        size_t count = order.size();
+        sortedMaxX.resize(count);
+        sortedMinY.resize(count);
+        sortedMaxY.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            const Box& box = boxes[order[i].index];
+            sortedMaxX[i] = box.maxX;
+            sortedMinY[i] = box.minY;
+            sortedMaxY[i] = box.maxY;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            double maxX = sortedMaxX[i];
+            double minY = sortedMinY[i];
+            double maxY = sortedMaxY[i];
+            for (size_t k = i + 1; k < count && order[k].minX <= maxX; ++k) {
+                if ((sortedMaxY[k] >= minY) & (sortedMinY[k] <= maxY)) {
+                    TestPair(order[i].index, order[k].index);
+                }
+            }
+        }
+    }
+
+    // Узкая фаза для пары, чьи рамки пересекаются
+    void TestPair(uint32_t a, uint32_t b) {
+        bool obstacleA = a >= shipCount;
+        bool obstacleB = b >= shipCount;
+        if (obstacleA && obstacleB) {
+            return;
+        }
+        double time;
+        if (obstacleA || obstacleB) {
+            EntityId ship = obstacleA ? b : a;
+            uint32_t obstacle = (obstacleA ? a : b) - static_cast<uint32_t>(shipCount);
+            if (SweptCircleBox(ship, obstacles[obstacle], time)) {
+                Record(Collision{ship, obstacle, true, time, Vector(), Vector()});
+            }
+        } else if (SweptCircles(a, b, time)) {
+            Record(Collision{std::min(a, b), std::max(a, b), false, time, Vector(), Vector()});
+        }
+    }
+
+    void Record(const Collision& collision) {
+        earliest[collision.first] = std::min(earliest[collision.first], collision.time);
+        if (!collision.obstacle) {
+            earliest[collision.second] = std::min(earliest[collision.second], collision.time);
+        }
+        collisions.push_back(collision);
+    }
+
+    // Круги движутся равномерно: |p + t*d| = R, t в [0, 1]
+    bool SweptCircles(EntityId a, EntityId b, double& time) const {
+        Vector p = starts[a] - starts[b];
+        Vector d = displacements[a] - displacements[b];
+        double radius = Radius(a) + Radius(b);
+        double c = p.X * p.X + p.Y * p.Y - radius * radius;
+        double qa = d.X * d.X + d.Y * d.Y;
+        double qb = 2 * (p.X * d.X + p.Y * d.Y);
+        if (qa == 0 || qb >= 0) {
+            return false;  // Не сближаются: касающиеся или пересекающиеся корабли могут разлететься
+        }
+        if (c <= 0) {
+            time = 0;  // Пересекались уже в начале шага и продолжают сближаться
+            return true;
+        }
+        double discriminant = qb * qb - 4 * qa * c;
+        if (discriminant < 0) {
+            return false;
+        }
+        time = (-qb - std::sqrt(discriminant)) / (2 * qa);
+        return time <= 1;
+    }
+
+    // Центр круга как луч против прямоугольника, расширенного на радиус (углы считаются прямыми)
+    bool SweptCircleBox(EntityId ship, const Box& box, double& time) const {
+        double radius = Radius(ship);
+        const double start[2] = {starts[ship].X, starts[ship].Y};
+        const double delta[2] = {displacements[ship].X, displacements[ship].Y};
+        const double low[2] = {box.minX - radius, box.minY - radius};
+        const double high[2] = {box.maxX + radius, box.maxY + radius};
+        double enter = 0;
+        double exit = 1;
+        for (int axis = 0; axis < 2; ++axis) {
+            if (delta[axis] == 0) {
+                if (start[axis] < low[axis] || start[axis] > high[axis]) {
+                    return false;
+                }
+                continue;
+            }
+            double t1 = (low[axis] - start[axis]) / delta[axis];
+            double t2 = (high[axis] - start[axis]) / delta[axis];
+            enter = std::max(enter, std::min(t1, t2));
+            exit = std::min(exit, std::max(t1, t2));
+            if (enter > exit) {
+                return false;
+            }
+        }
+        if (enter == 0) {
+            // Касание или пересечение в начале шага: удар, только если корабль движется внутрь
+            // по оси наименьшего проникновения, иначе он уходит от препятствия
+            double depth[2];
+            for (int axis = 0; axis < 2; ++axis) {
+                depth[axis] = std::min(start[axis] - low[axis], high[axis] - start[axis]);
+            }
+            int axis = depth[0] <= depth[1] ? 0 : 1;
+            bool nearLow = start[axis] - low[axis] <= high[axis] - start[axis];
+            if (nearLow ? delta[axis] <= 0 : delta[axis] >= 0) {
+                return false;
+            }
+        }
+        time = enter;
+        return true;
+    }
+
+    double defaultRadius;
+    std::vector<double> radii;
+    std::vector<Box> obstacles;
+    CommandFactory commandFactory;
+
+    // Состояние шага; буферы переиспользуются
+    std::vector<Vector> starts;
+    std::vector<Vector> displacements;
+    std::vector<double> earliest;
+    std::vector<Box> boxes;  // Сначала корабли, затем препятствия
+    std::vector<Entry> order;  // Порядок по левому краю рамки, сохраняется между шагами
+    std::vector<double> sortedMaxX;
+    std::vector<double> sortedMinY;
+    std::vector<double> sortedMaxY;
+    std::vector<Collision> collisions;
+    size_t shipCount = 0;
+};
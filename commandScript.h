@@ -0,0 +1,474 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "world.h"
+#include "exception_queue.h"
+#include "movement.h"
+#include "changeVelocity.h"
+#include "checkFuelCommand.h"
+#include "burnFuelCommand.h"
+#include "moveWithFuel.h"
+#include "rotateAndChangeVelocity.h"
+
+// Сценарий команд корабля — замена MacroCommand, которую не нужно собирать из объектов для каждого корабля.
+// Текст компилируется один раз в байткод; один байткод выполняется для любого числа кораблей.
+//
+// Формат: одна инструкция в строке, '#' — комментарий до конца строки.
+//   check_fuel A | burn A | move_with_fuel A | velocity A B | move | rotate A | rotate_steps A
+//   set v A | add v A | sub v A | mul v A     — переменная v объявляется первым set
+//   repeat A ... end                          — A раз (дробная часть отбрасывается)
+//   while A op B ... end
+//   if A op B ... [else ...] end              — op: < <= > >= == !=
+// Аргумент A, B — число, переменная или значение корабля: fuel, x, y, vx, vy, rotation, direction
+enum class ScriptOp : uint8_t {
+    LoadShip,      // r[a] = значение корабля b (ScriptValue)
+    Copy,          // r[a] = r[b]
+    Add,           // r[a] = r[b] + r[c]
+    Sub,           // r[a] = r[b] - r[c]
+    Mul,           // r[a] = r[b] * r[c]
+    CheckFuel,     // CheckFuelCommand(r[a])
+    BurnFuel,      // BurnFuelCommand(r[a])
+    MoveWithFuel,  // MoveWithFuelCommand(r[a])
+    SetVelocity,   // ChangeVelocityCommand(r[a], r[b])
+    Move,          // Movement::Move
+    Rotate,        // RotateAndChangeVelocity(r[a] градусов)
+    RotateSteps,   // RotateAndChangeVelocity(r[a] направлений)
+    Jump,          // pc = operand
+    JumpUnless,    // если не (r[a] c r[b]) — pc = operand; c — ScriptCompare
+    LoopEnter,     // если r[a] < 1 — pc = operand
+    LoopNext,      // r[a] -= 1; если r[a] >= 1 — pc = operand
+    Halt,
+};
+
+enum class ScriptValue : uint8_t {
+    Fuel,
+    X,
+    Y,
+    VelocityX,
+    VelocityY,
+    Rotation,
+    Direction,
+};
+
+enum class ScriptCompare : uint8_t {
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    Equal,
+    NotEqual,
+};
+
+// 8 байт на инструкцию: код, три регистра и операнд (адрес перехода)
+struct ScriptInstruction {
+    ScriptOp op;
+    uint8_t a = 0;
+    uint8_t b = 0;
+    uint8_t c = 0;
+    int32_t operand = 0;
+};
+
+static_assert(sizeof(ScriptInstruction) == 8, "ScriptInstruction must stay compact");
+
+// Регистры: r0, r1 — временные для значений корабля, затем переменные и счетчики циклов.
+// Константы занимают регистры с конца (constants[i] — в r[RegisterCount - 1 - i]) и загружаются
+// один раз при запуске, поэтому числа в аргументах не требуют отдельных инструкций
+struct CompiledScript {
+    static constexpr int RegisterCount = 64;
+    static constexpr int TempCount = 2;
+
+    std::vector<ScriptInstruction> code;
+    std::vector<double> constants;
+    std::vector<uint32_t> lines;  // Строка текста для каждой инструкции (сообщения об ошибках)
+    int registers = TempCount;    // Временные, переменные и счетчики циклов
+};
+
+class ScriptCompiler {
+public:
+    // Ошибка разбора — std::invalid_argument с номером строки
+    static CompiledScript Compile(const std::string& text) {
+        ScriptCompiler compiler;
+        std::istringstream input(text);
+        std::string line;
+        while (std::getline(input, line)) {
+            ++compiler.line;
+            compiler.CompileLine(line.substr(0, line.find('#')));
+        }
+        if (!compiler.blocks.empty()) {
+            compiler.Fail("missing 'end'");
+        }
+        compiler.Emit(ScriptOp::Halt);
+        return std::move(compiler.script);
+    }
+
+private:
+    enum BlockKind {
+        If,
+        Else,
+        While,
+        Repeat,
+    };
+
+    struct Block {
+        BlockKind kind;
+        size_t jumpAt;     // Переход, который нужно направить на конец блока
+        size_t loopStart;  // Начало тела (Repeat) или проверки условия (While)
+        uint8_t counter;
+    };
+
+    CompiledScript script;
+    std::map<std::string, uint8_t> variables;
+    std::vector<Block> blocks;
+    uint32_t line = 0;
+
+    [[noreturn]] void Fail(const std::string& message) const {
+        throw std::invalid_argument("Script line " + std::to_string(line) + ": " + message);
+    }
+
+    size_t Emit(ScriptOp op, uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, int32_t operand = 0) {
+        script.code.push_back(ScriptInstruction{op, a, b, c, operand});
+        script.lines.push_back(line);
+        return script.code.size() - 1;
+    }
+
+    int32_t Here() const {
+        return static_cast<int32_t>(script.code.size());
+    }
+
+    uint8_t AllocateRegister() {
+        if (script.registers + script.constants.size() >= CompiledScript::RegisterCount) {
+            Fail("too many variables, loops and constants");
+        }
+        return static_cast<uint8_t>(script.registers++);
+    }
+
+    static const std::map<std::string, ScriptValue>& ShipValues() {
+        static const std::map<std::string, ScriptValue> shipValues = {
+            {"fuel", ScriptValue::Fuel},           {"x", ScriptValue::X},
+            {"y", ScriptValue::Y},                 {"vx", ScriptValue::VelocityX},
+            {"vy", ScriptValue::VelocityY},        {"rotation", ScriptValue::Rotation},
+            {"direction", ScriptValue::Direction},
+        };
+        return shipValues;
+    }
+
+    // Регистр со значением аргумента; значения корабля загружаются во временный регистр temp
+    uint8_t Operand(const std::string& token, uint8_t temp) {
+        char* end = nullptr;
+        double number = std::strtod(token.c_str(), &end);
+        if (!token.empty() && *end == '\0') {
+            size_t index = 0;
+            while (index < script.constants.size() && script.constants[index] != number) {
+                ++index;
+            }
+            if (index == script.constants.size()) {
+                if (script.registers + script.constants.size() >= CompiledScript::RegisterCount) {
+                    Fail("too many variables, loops and constants");
+                }
+                script.constants.push_back(number);
+            }
+            return static_cast<uint8_t>(CompiledScript::RegisterCount - 1 - index);
+        }
+        auto value = ShipValues().find(token);
+        if (value != ShipValues().end()) {
+            Emit(ScriptOp::LoadShip, temp, static_cast<uint8_t>(value->second));
+            return temp;
+        }
+        auto variable = variables.find(token);
+        if (variable == variables.end()) {
+            Fail("unknown value '" + token + "'");
+        }
+        return variable->second;
+    }
+
+    ScriptCompare Compare(const std::string& token) const {
+        static const std::map<std::string, ScriptCompare> compares = {
+            {"<", ScriptCompare::Less},     {"<=", ScriptCompare::LessEqual}, {">", ScriptCompare::Greater},
+            {">=", ScriptCompare::GreaterEqual}, {"==", ScriptCompare::Equal}, {"!=", ScriptCompare::NotEqual},
+        };
+        auto found = compares.find(token);
+        if (found == compares.end()) {
+            Fail("unknown comparison '" + token + "'");
+        }
+        return found->second;
+    }
+
+    // Условие A op B: переход на конец блока, если оно ложно. Возвращает адрес перехода
+    size_t Condition(const std::vector<std::string>& args) {
+        uint8_t left = Operand(args[0], 0);
+        uint8_t right = Operand(args[2], 1);
+        return Emit(ScriptOp::JumpUnless, left, right, static_cast<uint8_t>(Compare(args[1])));
+    }
+
+    void Patch(size_t at) {
+        script.code[at].operand = Here();
+    }
+
+    void CompileLine(const std::string& text) {
+        std::istringstream tokens(text);
+        std::string name;
+        if (!(tokens >> name)) {
+            return;
+        }
+        std::vector<std::string> args;
+        for (std::string arg; tokens >> arg;) {
+            args.push_back(arg);
+        }
+        auto expect = [&](size_t count) {
+            if (args.size() != count) {
+                Fail("'" + name + "' expects " + std::to_string(count) + " arguments");
+            }
+        };
+
+        static const std::map<std::string, ScriptOp> unaryCommands = {
+            {"check_fuel", ScriptOp::CheckFuel}, {"burn", ScriptOp::BurnFuel},
+            {"move_with_fuel", ScriptOp::MoveWithFuel}, {"rotate", ScriptOp::Rotate},
+            {"rotate_steps", ScriptOp::RotateSteps},
+        };
+        static const std::map<std::string, ScriptOp> arithmetic = {
+            {"add", ScriptOp::Add}, {"sub", ScriptOp::Sub}, {"mul", ScriptOp::Mul},
+        };
+
+        if (auto command = unaryCommands.find(name); command != unaryCommands.end()) {
+            expect(1);
+            Emit(command->second, Operand(args[0], 0));
+        } else if (name == "velocity") {
+            expect(2);
+            uint8_t x = Operand(args[0], 0);
+            Emit(ScriptOp::SetVelocity, x, Operand(args[1], 1));
+        } else if (name == "move") {
+            expect(0);
+            Emit(ScriptOp::Move);
+        } else if (name == "set") {
+            expect(2);
+            uint8_t value = Operand(args[1], 0);
+            auto variable = variables.find(args[0]);
+            if (variable == variables.end()) {
+                const std::string& variableName = args[0];
+                if (!(std::isalpha(static_cast<unsigned char>(variableName[0])) || variableName[0] == '_') ||
+                    ShipValues().count(variableName)) {
+                    Fail("'" + variableName + "' cannot be a variable");
+                }
+                variable = variables.emplace(variableName, AllocateRegister()).first;
+            }
+            Emit(ScriptOp::Copy, variable->second, value);
+        } else if (auto op = arithmetic.find(name); op != arithmetic.end()) {
+            expect(2);
+            auto variable = variables.find(args[0]);
+            if (variable == variables.end()) {
+                Fail("'" + name + "' needs a variable");
+            }
+            Emit(op->second, variable->second, variable->second, Operand(args[1], 1));
+        } else if (name == "repeat") {
+            expect(1);
+            uint8_t counter = AllocateRegister();
+            Emit(ScriptOp::Copy, counter, Operand(args[0], 0));
+            size_t enter = Emit(ScriptOp::LoopEnter, counter);
+            blocks.push_back(Block{Repeat, enter, static_cast<size_t>(Here()), counter});
+        } else if (name == "while") {
+            expect(3);
+            size_t start = static_cast<size_t>(Here());
+            blocks.push_back(Block{While, Condition(args), start, 0});
+        } else if (name == "if") {
+            expect(3);
+            blocks.push_back(Block{If, Condition(args), 0, 0});
+        } else if (name == "else") {
+            expect(0);
+            if (blocks.empty() || blocks.back().kind != If) {
+                Fail("'else' without 'if'");
+            }
+            size_t skip = Emit(ScriptOp::Jump);
+            Patch(blocks.back().jumpAt);
+            blocks.back() = Block{Else, skip, 0, 0};
+        } else if (name == "end") {
+            expect(0);
+            if (blocks.empty()) {
+                Fail("'end' without block");
+            }
+            Block block = blocks.back();
+            blocks.pop_back();
+            if (block.kind == Repeat) {
+                Emit(ScriptOp::LoopNext, block.counter, 0, 0, static_cast<int32_t>(block.loopStart));
+            } else if (block.kind == While) {
+                Emit(ScriptOp::Jump, 0, 0, 0, static_cast<int32_t>(block.loopStart));
+            }
+            Patch(block.jumpAt);
+        } else {
+            Fail("unknown instruction '" + name + "'");
+        }
+    }
+};
+
+// Регистровый интерпретатор байткода. Регистры лежат на стеке, команды создаются на стеке:
+// выполнение ничего не выделяет, пока команда не бросит исключение.
+// Регистры переменных обнуляются при входе: переменная, заданная только в невыполненной ветке if, равна 0
+class ScriptInterpreter {
+public:
+    // Защита от бесконечного while: сценарий, выполнивший больше инструкций, прерывается
+    static constexpr uint64_t DefaultStepLimit = 1 << 20;
+
+    // Как MacroCommand: исключение команды останавливает сценарий и превращается в std::runtime_error
+    // (очередь повторит сценарий целиком). Превышение лимита — std::range_error, без повтора.
+    // Возвращает количество выполненных инструкций
+    static uint64_t Run(const CompiledScript& script, SpaceShip& ship, uint64_t stepLimit = DefaultStepLimit) {
+        double r[CompiledScript::RegisterCount];
+        std::fill(r + CompiledScript::TempCount, r + script.registers, 0.0);  // Временные пишутся до чтения
+        for (size_t i = 0; i < script.constants.size(); ++i) {
+            r[CompiledScript::RegisterCount - 1 - i] = script.constants[i];
+        }
+        const ScriptInstruction* code = script.code.data();
+        size_t pc = 0;
+        uint64_t steps = 0;
+        try {
+            for (;;) {
+                if (++steps > stepLimit) {
+                    break;
+                }
+                const ScriptInstruction& in = code[pc++];
+                switch (in.op) {
+                    case ScriptOp::LoadShip:
+                        r[in.a] = ShipValue(ship, static_cast<ScriptValue>(in.b));
+                        break;
+                    case ScriptOp::Copy:
+                        r[in.a] = r[in.b];
+                        break;
+                    case ScriptOp::Add:
+                        r[in.a] = r[in.b] + r[in.c];
+                        break;
+                    case ScriptOp::Sub:
+                        r[in.a] = r[in.b] - r[in.c];
+                        break;
+                    case ScriptOp::Mul:
+                        r[in.a] = r[in.b] * r[in.c];
+                        break;
+                    case ScriptOp::CheckFuel:
+                        CheckFuelCommand(ship, r[in.a]).Execute();
+                        break;
+                    case ScriptOp::BurnFuel:
+                        BurnFuelCommand(ship, r[in.a]).Execute();
+                        break;
+                    case ScriptOp::MoveWithFuel:
+                        MoveWithFuelCommand(ship, r[in.a]).Execute();
+                        break;
+                    case ScriptOp::SetVelocity:
+                        ChangeVelocityCommand(ship, Vector(r[in.a], r[in.b])).Execute();
+                        break;
+                    case ScriptOp::Move:
+                        Movement::Move(ship);
+                        break;
+                    case ScriptOp::Rotate:
+                        RotateAndChangeVelocity(ship, r[in.a], Vector()).Execute();
+                        break;
+                    case ScriptOp::RotateSteps:
+                        RotateAndChangeVelocity(ship, DirectionSteps(static_cast<int>(std::lround(r[in.a]))), Vector())
+                            .Execute();
+                        break;
+                    case ScriptOp::Jump:
+                        pc = static_cast<size_t>(in.operand);
+                        break;
+                    case ScriptOp::JumpUnless:
+                        if (!Holds(r[in.a], r[in.b], static_cast<ScriptCompare>(in.c))) {
+                            pc = static_cast<size_t>(in.operand);
+                        }
+                        break;
+                    case ScriptOp::LoopEnter:
+                        if (r[in.a] < 1) {
+                            pc = static_cast<size_t>(in.operand);
+                        }
+                        break;
+                    case ScriptOp::LoopNext:
+                        r[in.a] -= 1;
+                        if (r[in.a] >= 1) {
+                            pc = static_cast<size_t>(in.operand);
+                        }
+                        break;
+                    case ScriptOp::Halt:
+                        return steps;
+                }
+            }
+        } catch (const std::exception& ex) {
+            throw std::runtime_error("Script stopped at line " + std::to_string(script.lines[pc - 1]) + ": " +
+                                     ex.what());
+        }
+        throw std::range_error("Script step limit exceeded at line " + std::to_string(script.lines[pc]));
+    }
+
+private:
+    static double ShipValue(const SpaceShip& ship, ScriptValue value) {
+        switch (value) {
+            case ScriptValue::Fuel:
+                return ship.getFuel();
+            case ScriptValue::X:
+                return ship.getPosition().X;
+            case ScriptValue::Y:
+                return ship.getPosition().Y;
+            case ScriptValue::VelocityX:
+                return ship.getVelocity().X;
+            case ScriptValue::VelocityY:
+                return ship.getVelocity().Y;
+            case ScriptValue::Rotation:
+                return ship.getRotation();
+            case ScriptValue::Direction:
+                return ship.getDirection();
+        }
+        return 0;
+    }
+
+    static bool Holds(double left, double right, ScriptCompare compare) {
+        switch (compare) {
+            case ScriptCompare::Less:
+                return left < right;
+            case ScriptCompare::LessEqual:
+                return left <= right;
+            case ScriptCompare::Greater:
+                return left > right;
+            case ScriptCompare::GreaterEqual:
+                return left >= right;
+            case ScriptCompare::Equal:
+                return left == right;
+            case ScriptCompare::NotEqual:
+                return left != right;
+        }
+        return false;
+    }
+};
+
+// Выполнение сценария для одного корабля через очередь. Байткод общий для всех кораблей
+class ScriptCommand : public Command {
+private:
+    std::shared_ptr<const CompiledScript> script;
+    ShipRef ship;
+
+public:
+    ScriptCommand(std::shared_ptr<const CompiledScript> script, ShipRef ship)
+        : script(std::move(script)), ship(ship) {}
+
+    void Execute() override {
+        ScriptInterpreter::Run(*script, ship.Get());
+    }
+
+    const CompiledScript& GetScript() const {
+        return *script;
+    }
+
+    std::string GetName() const override {
+        return "ScriptCommand";
+    }
+
+    const void* GetTarget() const override {
+        return ship.TryGet();
+    }
+
+    TargetKey GetTargetKey() const override {
+        return ship.Key();
+    }
+};
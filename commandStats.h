@@ -0,0 +1,411 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#include <cxxabi.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Читаемое имя типа (используется для задач SafeQueue, у которых нет GetName())
+inline std::string DemangledName(const std::type_info& type) {
+    int status = 0;
+    char* name = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+    std::string result = (status == 0 && name) ? name : type.name();
+    std::free(name);
+    return result;
+}
+
+// Дешевые часы для замеров: TSC на x86, steady_clock на остальных платформах
+class StatsClock {
+public:
+    static uint64_t Now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Сколько наносекунд в одном тике (калибруется один раз при первом обращении)
+    static double NanosPerTick() {
+        static const double ratio = Calibrate();
+        return ratio;
+    }
+
+    static uint64_t ToNanos(uint64_t ticks) {
+        return static_cast<uint64_t>(ticks * NanosPerTick());
+    }
+
+private:
+    static double Calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+        auto wallStart = std::chrono::steady_clock::now();
+        uint64_t tscStart = __rdtsc();
+        while (std::chrono::steady_clock::now() - wallStart < std::chrono::milliseconds(2)) {
+        }
+        uint64_t tscEnd = __rdtsc();
+        auto wallEnd = std::chrono::steady_clock::now();
+        double nanos = std::chrono::duration<double, std::nano>(wallEnd - wallStart).count();
+        return tscEnd > tscStart ? nanos / static_cast<double>(tscEnd - tscStart) : 1.0;
+#else
+        return 1.0;
+#endif
+    }
+};
+
+// Гистограмма задержек в стиле HDR: интервалы растут степенями двойки,
+// каждый из них поделен на SubBuckets равных частей (относительная точность ~12%)
+class LatencyHistogram {
+public:
+    static constexpr int SubBucketBits = 3;
+    static constexpr int SubBuckets = 1 << SubBucketBits;
+    static constexpr int BucketCount = (64 - SubBucketBits + 1) * SubBuckets;
+
+    static int BucketIndex(uint64_t value) {
+        if (value < static_cast<uint64_t>(SubBuckets)) {
+            return static_cast<int>(value);
+        }
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - SubBucketBits;
+        return (shift + 1) * SubBuckets + static_cast<int>((value >> shift) - SubBuckets);
+    }
+
+    // Нижняя (включительно) граница интервала
+    static uint64_t BucketLowerBound(int index) {
+        if (index < SubBuckets) {
+            return static_cast<uint64_t>(index);
+        }
+        int shift = index / SubBuckets - 1;
+        uint64_t sub = static_cast<uint64_t>(index % SubBuckets + SubBuckets);
+        return sub << shift;
+    }
+
+    // Верхняя (не включительно) граница интервала
+    static uint64_t BucketUpperBound(int index) {
+        if (index < SubBuckets) {
+            return static_cast<uint64_t>(index) + 1;
+        }
+        int shift = index / SubBuckets - 1;
+        uint64_t sub = static_cast<uint64_t>(index % SubBuckets + SubBuckets);
+        return (sub + 1) << shift;
+    }
+
+    void Record(uint64_t value) {
+        buckets[BucketIndex(value)]++;
+        count++;
+        sum += value;
+        maxValue = std::max(maxValue, value);
+    }
+
+    void AddBucket(int index, uint64_t n) {
+        buckets[index] += n;
+        count += n;
+    }
+
+    void Merge(const LatencyHistogram& other) {
+        for (int i = 0; i < BucketCount; ++i) {
+            buckets[i] += other.buckets[i];
+        }
+        count += other.count;
+        sum += other.sum;
+        maxValue = std::max(maxValue, other.maxValue);
+    }
+
+    // Значение перцентиля (0..100) — верхняя граница интервала, в который он попал
+    uint64_t Percentile(double percentile) const {
+        if (count == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(count));
+        rank = std::min(std::max<uint64_t>(rank, 1), count);
+        uint64_t seen = 0;
+        for (int i = 0; i < BucketCount; ++i) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                return BucketUpperBound(i) - 1;
+            }
+        }
+        return maxValue;
+    }
+
+    uint64_t CountBelow(uint64_t bound) const {
+        uint64_t result = 0;
+        for (int i = 0; i < BucketCount && BucketUpperBound(i) <= bound; ++i) {
+            result += buckets[i];
+        }
+        return result;
+    }
+
+    uint64_t Count() const { return count; }
+    uint64_t Sum() const { return sum; }
+    uint64_t Max() const { return maxValue; }
+    void SetSum(uint64_t value) { sum = value; }
+    void SetMax(uint64_t value) { maxValue = value; }
+
+private:
+    std::array<uint64_t, BucketCount> buckets{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t maxValue = 0;
+};
+
+// Счетчики одного типа команды в одном потоке.
+// Пишет только поток-владелец (relaxed load + store, без lock-префикса), читает агрегатор.
+struct CommandTypeCounters {
+    const std::type_info* type = nullptr;
+    std::string name;
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<uint64_t> retried{0};
+    std::atomic<uint64_t> latencySum{0};
+    std::atomic<uint64_t> latencyMax{0};
+    std::array<std::atomic<uint64_t>, LatencyHistogram::BucketCount> latency{};
+
+    static void Bump(std::atomic<uint64_t>& counter, uint64_t delta = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+};
+
+// Статистика потока: список типов команд, которые этот поток выполнял
+class ThreadCommandStats {
+public:
+    template <typename NameFn>
+    CommandTypeCounters& Find(const std::type_info& type, NameFn&& name) {
+        if (last && last->type == &type) {
+            return *last;
+        }
+        for (const auto& counters : types) {
+            if (counters->type == &type) {
+                last = counters.get();
+                return *last;
+            }
+        }
+        auto counters = std::make_unique<CommandTypeCounters>();
+        counters->type = &type;
+        counters->name = name();
+        std::lock_guard<std::mutex> lock(mutex);
+        types.push_back(std::move(counters));
+        last = types.back().get();
+        return *last;
+    }
+
+    template <typename Visitor>
+    void Visit(Visitor&& visit) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& counters : types) {
+            visit(*counters);
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<CommandTypeCounters>> types;
+    CommandTypeCounters* last = nullptr;
+    mutable std::mutex mutex;  // Защищает только список типов, не сами счетчики
+};
+
+// Агрегированная статистика по типу команды
+struct CommandTypeStats {
+    std::string name;
+    uint64_t executed = 0;
+    uint64_t failed = 0;
+    uint64_t retried = 0;
+    LatencyHistogram latencyNs;
+};
+
+// Реестр статистики команд: счетчики ведутся по потокам, сводятся по запросу
+class CommandStats {
+public:
+    static CommandStats& Instance() {
+        static CommandStats instance;
+        return instance;
+    }
+
+    void SetEnabled(bool value) { enabled.store(value, std::memory_order_relaxed); }
+    bool Enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    ThreadCommandStats& Local() {
+        // Указатель без динамической инициализации: обращение к нему не требует проверки guard
+        static thread_local ThreadCommandStats* local = nullptr;
+        if (!local) {
+            local = Register();
+        }
+        return *local;
+    }
+
+    // Снимок: счетчики всех потоков, сведенные по имени команды
+    std::vector<CommandTypeStats> Snapshot() const {
+        std::vector<CommandTypeStats> result;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& thread : threads) {
+            thread->Visit([&](const CommandTypeCounters& counters) {
+                auto it = std::find_if(result.begin(), result.end(),
+                                       [&](const CommandTypeStats& s) { return s.name == counters.name; });
+                if (it == result.end()) {
+                    result.push_back(CommandTypeStats{counters.name});
+                    it = result.end() - 1;
+                }
+                it->executed += counters.executed.load(std::memory_order_relaxed);
+                it->failed += counters.failed.load(std::memory_order_relaxed);
+                it->retried += counters.retried.load(std::memory_order_relaxed);
+
+                LatencyHistogram histogram;
+                for (int i = 0; i < LatencyHistogram::BucketCount; ++i) {
+                    uint64_t n = counters.latency[i].load(std::memory_order_relaxed);
+                    if (n) {
+                        histogram.AddBucket(i, n);
+                    }
+                }
+                histogram.SetSum(counters.latencySum.load(std::memory_order_relaxed));
+                histogram.SetMax(counters.latencyMax.load(std::memory_order_relaxed));
+                it->latencyNs.Merge(histogram);
+            });
+        }
+        std::sort(result.begin(), result.end(),
+                  [](const CommandTypeStats& a, const CommandTypeStats& b) { return a.name < b.name; });
+        return result;
+    }
+
+    // Выгрузка в текстовом формате Prometheus
+    bool WritePrometheus(const std::string& path) const {
+        std::ofstream out(path, std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Cannot open stats file: " << path << std::endl;
+            return false;
+        }
+        auto stats = Snapshot();
+
+        const char* counters[][2] = {
+            {"spaceship_commands_executed_total", "Commands executed"},
+            {"spaceship_commands_failed_total", "Commands that threw an exception"},
+            {"spaceship_commands_retried_total", "Commands scheduled for retry"},
+        };
+        for (int k = 0; k < 3; ++k) {
+            out << "# HELP " << counters[k][0] << " " << counters[k][1] << "\n";
+            out << "# TYPE " << counters[k][0] << " counter\n";
+            for (const auto& s : stats) {
+                uint64_t value = k == 0 ? s.executed : (k == 1 ? s.failed : s.retried);
+                out << counters[k][0] << "{command=\"" << s.name << "\"} " << value << "\n";
+            }
+        }
+
+        const uint64_t boundsNs[] = {100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000,
+                                     250000, 500000, 1000000, 10000000, 100000000, 1000000000};
+        out << "# HELP spaceship_command_latency_seconds Command execution latency\n";
+        out << "# TYPE spaceship_command_latency_seconds histogram\n";
+        for (const auto& s : stats) {
+            for (uint64_t bound : boundsNs) {
+                out << "spaceship_command_latency_seconds_bucket{command=\"" << s.name << "\",le=\""
+                    << static_cast<double>(bound) / 1e9 << "\"} " << s.latencyNs.CountBelow(bound) << "\n";
+            }
+            out << "spaceship_command_latency_seconds_bucket{command=\"" << s.name << "\",le=\"+Inf\"} "
+                << s.latencyNs.Count() << "\n";
+            out << "spaceship_command_latency_seconds_sum{command=\"" << s.name << "\"} "
+                << static_cast<double>(s.latencyNs.Sum()) / 1e9 << "\n";
+            out << "spaceship_command_latency_seconds_count{command=\"" << s.name << "\"} "
+                << s.latencyNs.Count() << "\n";
+        }
+        return static_cast<bool>(out);
+    }
+
+private:
+    CommandStats() { StatsClock::NanosPerTick(); }
+
+    ThreadCommandStats* Register() {
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.push_back(std::make_unique<ThreadCommandStats>());  // Счетчики переживают поток
+        return threads.back().get();
+    }
+
+    std::atomic<bool> enabled{true};
+    std::vector<std::unique_ptr<ThreadCommandStats>> threads;
+    mutable std::mutex mutex;
+};
+
+#ifdef SPACESHIP_COMMAND_STATS
+
+// Замер выполнения одной команды: создается непосредственно перед Execute(), пишет в счетчики при разрушении.
+// Счетчики выполнений и ошибок ведутся для каждой команды. Задержка — два чтения часов, дороже остального
+// замера, поэтому она измеряется у первых LatencyExactCount команд каждого типа в потоке, дальше — у каждой
+// LatencySampleEvery-й. Гистограмма (ее count и sum) описывает замеренные команды
+class CommandProbe {
+public:
+    static constexpr uint64_t LatencyExactCount = 256;
+    static constexpr uint64_t LatencySampleEvery = 16;  // Степень двойки
+
+    template <typename NameFn>
+    CommandProbe(const std::type_info& type, NameFn&& name) {
+        if (CommandStats::Instance().Enabled()) {
+            counters = &CommandStats::Instance().Local().Find(type, name);
+            uint64_t executed = counters->executed.load(std::memory_order_relaxed);
+            if (executed < LatencyExactCount || (executed & (LatencySampleEvery - 1)) == 0) {
+                timed = true;
+                start = StatsClock::Now();  // Последним: в замер не попадает поиск счетчиков
+            }
+        }
+    }
+
+    ~CommandProbe() {
+        if (!counters) {
+            return;
+        }
+        CommandTypeCounters::Bump(counters->executed);
+        if (failed) {
+            CommandTypeCounters::Bump(counters->failed);
+        }
+        if (!timed) {
+            return;
+        }
+        uint64_t nanos = StatsClock::ToNanos(StatsClock::Now() - start);
+        CommandTypeCounters::Bump(counters->latency[LatencyHistogram::BucketIndex(nanos)]);
+        CommandTypeCounters::Bump(counters->latencySum, nanos);
+        if (nanos > counters->latencyMax.load(std::memory_order_relaxed)) {
+            counters->latencyMax.store(nanos, std::memory_order_relaxed);
+        }
+    }
+
+    CommandProbe(const CommandProbe&) = delete;
+    CommandProbe& operator=(const CommandProbe&) = delete;
+
+    void Fail() { failed = true; }
+
+    template <typename NameFn>
+    static void Retry(const std::type_info& type, NameFn&& name) {
+        if (CommandStats::Instance().Enabled()) {
+            CommandTypeCounters::Bump(CommandStats::Instance().Local().Find(type, name).retried);
+        }
+    }
+
+private:
+    CommandTypeCounters* counters = nullptr;
+    uint64_t start = 0;
+    bool timed = false;
+    bool failed = false;
+};
+
+#else
+
+// Статистика выключена при сборке: пустой замер, компилятор убирает его полностью
+class CommandProbe {
+public:
+    template <typename NameFn>
+    CommandProbe(const std::type_info&, NameFn&&) {}
+
+    void Fail() {}
+
+    template <typename NameFn>
+    static void Retry(const std::type_info&, NameFn&&) {}
+};
+
+#endif
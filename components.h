@@ -0,0 +1,200 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "vector.h"
+#include "movable.h"
+
+using EntityId = uint32_t;
+
+// Компоненты сущностей: у астероида может быть только положение и скорость, у снаряда — еще и топливо
+struct PositionComponent {
+    Vector value;
+};
+
+struct VelocityComponent {
+    Vector value;
+};
+
+struct RotationComponent {
+    Rotation angle = 0;
+    int direction = 0;
+    int directionsNumber = 0;  // 0 — непрерывный поворот в градусах
+};
+
+struct FuelComponent {
+    double amount = 0;
+};
+
+// Разреженное множество: sparse[id] — индекс в плотных массивах или NoIndex.
+// Плотные массивы лежат подряд и без пропусков, удаление переносит последний элемент на место удаленного
+template <typename T>
+class SparseSet {
+public:
+    static constexpr uint32_t NoIndex = UINT32_MAX;
+
+    bool Has(EntityId id) const {
+        return id < sparse.size() && sparse[id] != NoIndex;
+    }
+
+    T& Add(EntityId id, const T& component) {
+        if (Has(id)) {
+            return data[sparse[id]] = component;
+        }
+        if (sparse.size() <= id) {
+            sparse.resize(id + 1, NoIndex);
+        }
+        sparse[id] = static_cast<uint32_t>(entities.size());
+        entities.push_back(id);
+        data.push_back(component);
+        return data.back();
+    }
+
+    bool Remove(EntityId id) {
+        if (!Has(id)) {
+            return false;
+        }
+        uint32_t index = sparse[id];
+        EntityId last = entities.back();
+        entities[index] = last;
+        data[index] = data.back();
+        sparse[last] = index;
+        entities.pop_back();
+        data.pop_back();
+        sparse[id] = NoIndex;
+        return true;
+    }
+
+    T& Get(EntityId id) {
+        if (!Has(id)) {
+            throw std::out_of_range("No component for entity " + std::to_string(id));
+        }
+        return data[sparse[id]];
+    }
+
+    const T& Get(EntityId id) const {
+        if (!Has(id)) {
+            throw std::out_of_range("No component for entity " + std::to_string(id));
+        }
+        return data[sparse[id]];
+    }
+
+    // Без проверок: для систем, которые уже знают, что компонент есть
+    T& At(EntityId id) {
+        return data[sparse[id]];
+    }
+
+    size_t Size() const {
+        return data.size();
+    }
+
+    // Плотные массивы: entities[i] владеет data[i]
+    const std::vector<EntityId>& Entities() const {
+        return entities;
+    }
+
+    std::vector<T>& Data() {
+        return data;
+    }
+
+    const std::vector<T>& Data() const {
+        return data;
+    }
+
+private:
+    std::vector<uint32_t> sparse;
+    std::vector<EntityId> entities;
+    std::vector<T> data;
+};
+
+// Хранилище компонентов: по разреженному множеству на тип компонента
+class ComponentRegistry {
+public:
+    EntityId Create() {
+        if (!freeIds.empty()) {
+            EntityId id = freeIds.back();
+            freeIds.pop_back();
+            alive[id] = 1;
+            return id;
+        }
+        alive.push_back(1);
+        return static_cast<EntityId>(alive.size() - 1);
+    }
+
+    // Удаляет сущность со всеми компонентами; номер может быть выдан снова
+    void Destroy(EntityId id) {
+        if (!IsAlive(id)) {
+            return;
+        }
+        std::apply([id](auto&... sets) { (sets.Remove(id), ...); }, storages);
+        alive[id] = 0;
+        freeIds.push_back(id);
+    }
+
+    bool IsAlive(EntityId id) const {
+        return id < alive.size() && alive[id];
+    }
+
+    template <typename T>
+    T& Add(EntityId id, const T& component = T()) {
+        if (!IsAlive(id)) {
+            throw std::out_of_range("No entity " + std::to_string(id));
+        }
+        return Storage<T>().Add(id, component);
+    }
+
+    template <typename T>
+    bool Remove(EntityId id) {
+        return Storage<T>().Remove(id);
+    }
+
+    template <typename T>
+    bool Has(EntityId id) const {
+        return Storage<T>().Has(id);
+    }
+
+    template <typename T>
+    T& Get(EntityId id) {
+        return Storage<T>().Get(id);
+    }
+
+    template <typename T>
+    const T& Get(EntityId id) const {
+        return Storage<T>().Get(id);
+    }
+
+    template <typename T>
+    SparseSet<T>& Storage() {
+        return std::get<SparseSet<T>>(storages);
+    }
+
+    template <typename T>
+    const SparseSet<T>& Storage() const {
+        return std::get<SparseSet<T>>(storages);
+    }
+
+    // Обход сущностей, у которых есть все компоненты First, Rest...: visit(id, First&, Rest&...).
+    // Идем по плотному массиву First без поиска; остальные компоненты ищутся через sparse.
+    // Первым стоит указывать самый редкий компонент. Добавлять и удалять компоненты при обходе нельзя
+    template <typename First, typename... Rest, typename Visitor>
+    void Each(Visitor&& visit) {
+        SparseSet<First>& first = Storage<First>();
+        const std::vector<EntityId>& entities = first.Entities();
+        std::vector<First>& data = first.Data();
+        for (size_t i = 0; i < entities.size(); ++i) {
+            EntityId id = entities[i];
+            if ((Storage<Rest>().Has(id) && ...)) {
+                visit(id, data[i], Storage<Rest>().At(id)...);
+            }
+        }
+    }
+
+private:
+    std::tuple<SparseSet<PositionComponent>, SparseSet<VelocityComponent>, SparseSet<RotationComponent>,
+               SparseSet<FuelComponent>> storages;
+    std::vector<uint8_t> alive;
+    std::vector<EntityId> freeIds;
+};
@@ -0,0 +1,349 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <utility>
+#include <vector>
+
+// Пул памяти для кадров корутин: списки свободных блоков по классам размеров (64..4096 байт).
+// Списки у каждого потока свои, поэтому выделение и освобождение идут без блокировок.
+class FramePool {
+public:
+    static constexpr size_t MinBlock = 64;
+    static constexpr int ClassCount = 7;        // 64, 128, ..., 4096
+    static constexpr size_t MaxFreeBlocks = 1024;  // Больше не держим: лишнее отдаем системе
+
+    static void* Allocate(size_t size) {
+        int index = ClassIndex(size);
+        if (index < 0) {
+            return ::operator new(size);
+        }
+        auto& list = Local().free[index];
+        if (!list.empty()) {
+            void* block = list.back();
+            list.pop_back();
+            return block;
+        }
+        return ::operator new(ClassSize(index));
+    }
+
+    static void Deallocate(void* block, size_t size) {
+        int index = ClassIndex(size);
+        if (index < 0) {
+            ::operator delete(block);
+            return;
+        }
+        auto& list = Local().free[index];
+        if (list.size() >= MaxFreeBlocks) {
+            ::operator delete(block);
+            return;
+        }
+        list.push_back(block);
+    }
+
+private:
+    struct FreeLists {
+        std::array<std::vector<void*>, ClassCount> free;
+
+        ~FreeLists() {
+            for (auto& list : free) {
+                for (void* block : list) {
+                    ::operator delete(block);
+                }
+            }
+        }
+    };
+
+    static FreeLists& Local() {
+        static thread_local FreeLists lists;
+        return lists;
+    }
+
+    static int ClassIndex(size_t size) {
+        int index = 0;
+        for (size_t block = MinBlock; block < size; block <<= 1) {
+            ++index;
+        }
+        return index < ClassCount ? index : -1;
+    }
+
+    static size_t ClassSize(int index) {
+        return MinBlock << index;
+    }
+};
+
+class CommandScheduler;
+
+// Долгая команда-корутина: выполняется порциями, между ними ждет тика, задержки или условия.
+//
+//   Behavior Maneuver(SpaceShip& ship) {
+//       RotationHandler::Rotate(ship, 90);
+//       co_await NextTick();
+//       co_await Delay(10);
+//       co_await WaitFuel(ship, 5);
+//   }
+class Behavior {
+public:
+    struct promise_type {
+        CommandScheduler* scheduler = nullptr;
+
+        Behavior get_return_object() {
+            return Behavior(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        // Корутина начинает работу на ближайшем тике планировщика
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        // Кадр уничтожает планировщик
+        std::suspend_always final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            exception = std::current_exception();
+        }
+
+        static void* operator new(size_t size) {
+            return FramePool::Allocate(size);
+        }
+
+        static void operator delete(void* frame, size_t size) {
+            FramePool::Deallocate(frame, size);
+        }
+
+        std::exception_ptr exception;
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Behavior(Handle handle) : handle(handle) {}
+
+    Behavior(Behavior&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+    Behavior& operator=(Behavior&& other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    Behavior(const Behavior&) = delete;
+    Behavior& operator=(const Behavior&) = delete;
+
+    ~Behavior() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    // Передача владения кадром планировщику
+    Handle Release() {
+        return std::exchange(handle, nullptr);
+    }
+
+private:
+    Handle handle;
+};
+
+// Планировщик корутин-команд. Один вызов Tick() — один игровой тик:
+// возобновляются все корутины, чей тик, задержка или условие наступили.
+// Spawn() можно вызывать из любого потока, Tick() — из потока-исполнителя.
+class CommandScheduler {
+public:
+    using Handle = Behavior::Handle;
+
+    CommandScheduler() = default;
+    CommandScheduler(const CommandScheduler&) = delete;
+    CommandScheduler& operator=(const CommandScheduler&) = delete;
+
+    ~CommandScheduler() {
+        for (Handle handle : incoming) {
+            handle.destroy();
+        }
+        for (Handle handle : ready) {
+            handle.destroy();
+        }
+        while (!delayed.empty()) {
+            delayed.top().handle.destroy();
+            delayed.pop();
+        }
+        for (const auto& waiter : waiters) {
+            waiter.handle.destroy();
+        }
+    }
+
+    void Spawn(Behavior behavior) {
+        Handle handle = behavior.Release();
+        if (!handle) {
+            return;
+        }
+        handle.promise().scheduler = this;
+        std::lock_guard<std::mutex> lock(incomingMutex);
+        incoming.push_back(handle);
+        hasIncoming.store(true, std::memory_order_release);
+    }
+
+    void Tick() {
+        ++tick;
+        if (hasIncoming.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(incomingMutex);
+            ready.insert(ready.end(), incoming.begin(), incoming.end());
+            incoming.clear();
+            hasIncoming.store(false, std::memory_order_relaxed);
+        }
+        while (!delayed.empty() && delayed.top().wakeTick <= tick) {
+            ready.push_back(delayed.top().handle);
+            delayed.pop();
+        }
+        for (size_t i = 0; i < waiters.size();) {
+            if (waiters[i].check(waiters[i].condition)) {
+                ready.push_back(waiters[i].handle);
+                waiters[i] = waiters.back();
+                waiters.pop_back();
+            } else {
+                ++i;
+            }
+        }
+
+        // Корутины, которые снова ждут следующего тика, попадают в ready заново
+        running.swap(ready);
+        for (Handle handle : running) {
+            Resume(handle);
+        }
+        running.clear();
+        PublishScheduled();
+    }
+
+    uint64_t CurrentTick() const { return tick; }
+
+    // Количество корутин, ожидающих возобновления; можно вызывать из любого потока.
+    // Очереди потока-исполнителя меняются без блокировки, поэтому их размер читается
+    // из счетчика, который исполнитель обновляет после каждого изменения
+    size_t Pending() const {
+        std::lock_guard<std::mutex> lock(incomingMutex);
+        return incoming.size() + scheduled.load(std::memory_order_relaxed);
+    }
+
+    void ScheduleNextTick(Handle handle) {
+        ready.push_back(handle);
+        PublishScheduled();
+    }
+
+    void ScheduleAt(uint64_t wakeTick, Handle handle) {
+        delayed.push(Delayed{wakeTick, sequence++, handle});
+        PublishScheduled();
+    }
+
+    void ScheduleWhen(bool (*check)(void*), void* condition, Handle handle) {
+        waiters.push_back(Waiter{check, condition, handle});
+        PublishScheduled();
+    }
+
+private:
+    struct Delayed {
+        uint64_t wakeTick;
+        uint64_t order;  // Сохраняет порядок корутин с одинаковым тиком пробуждения
+        Handle handle;
+
+        bool operator>(const Delayed& other) const {
+            return wakeTick != other.wakeTick ? wakeTick > other.wakeTick : order > other.order;
+        }
+    };
+
+    struct Waiter {
+        bool (*check)(void*);
+        void* condition;  // Объект-условие живет в кадре ожидающей корутины
+        Handle handle;
+    };
+
+    void PublishScheduled() {
+        scheduled.store(ready.size() + delayed.size() + waiters.size(), std::memory_order_relaxed);
+    }
+
+    void Resume(Handle handle) {
+        handle.resume();
+        if (!handle.done()) {
+            return;
+        }
+        if (handle.promise().exception) {
+            try {
+                std::rethrow_exception(handle.promise().exception);
+            } catch (const std::exception& ex) {
+                std::cerr << "Exception caught in coroutine command: " << ex.what() << std::endl;
+            } catch (...) {
+                std::cerr << "Unknown exception caught in coroutine command." << std::endl;
+            }
+        }
+        handle.destroy();
+    }
+
+    uint64_t tick = 0;
+    uint64_t sequence = 0;
+    std::vector<Handle> ready;
+    std::vector<Handle> running;
+    std::priority_queue<Delayed, std::vector<Delayed>, std::greater<Delayed>> delayed;
+    std::vector<Waiter> waiters;
+    std::atomic<size_t> scheduled{0};  // ready + delayed + waiters для Pending из других потоков
+
+    std::vector<Handle> incoming;
+    std::atomic<bool> hasIncoming{false};
+    mutable std::mutex incomingMutex;
+};
+
+// Ожидание следующего тика
+struct NextTick {
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(Behavior::Handle handle) const {
+        handle.promise().scheduler->ScheduleNextTick(handle);
+    }
+
+    void await_resume() const noexcept {}
+};
+
+// Ожидание заданного количества тиков
+struct Delay {
+    uint64_t ticks;
+
+    explicit Delay(uint64_t ticks) : ticks(ticks) {}
+
+    bool await_ready() const noexcept { return ticks == 0; }
+
+    void await_suspend(Behavior::Handle handle) const {
+        CommandScheduler* scheduler = handle.promise().scheduler;
+        scheduler->ScheduleAt(scheduler->CurrentTick() + ticks, handle);
+    }
+
+    void await_resume() const noexcept {}
+};
+
+// Ожидание условия; проверяется в начале каждого тика
+template <typename Predicate>
+struct WaitUntil {
+    Predicate predicate;
+
+    explicit WaitUntil(Predicate predicate) : predicate(std::move(predicate)) {}
+
+    bool await_ready() { return predicate(); }
+
+    // Предикат вызывается без const: подходят и mutable-лямбды
+    void await_suspend(Behavior::Handle handle) {
+        handle.promise().scheduler->ScheduleWhen(&Check, this, handle);
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    static bool Check(void* self) {
+        return static_cast<WaitUntil*>(self)->predicate();
+    }
+};
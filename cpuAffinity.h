@@ -0,0 +1,159 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Топология процессоров: узлы NUMA и их процессоры (Linux, /sys/devices/system/node).
+// Память в Linux по умолчанию выделяется на узле потока, который первым записал страницу,
+// поэтому данные мира создаются потоком, закрепленным за процессорами нужного узла.
+class CpuTopology {
+public:
+    // Разбор списка вида "0-3,8,10-11"
+    static std::vector<int> ParseCpuList(const std::string& text) {
+        std::vector<int> cpus;
+        size_t pos = 0;
+        while (pos < text.size()) {
+            if (!std::isdigit(static_cast<unsigned char>(text[pos]))) {
+                ++pos;
+                continue;
+            }
+            size_t end;
+            int first = std::stoi(text.substr(pos), &end);
+            pos += end;
+            int last = first;
+            if (pos < text.size() && text[pos] == '-') {
+                last = std::stoi(text.substr(pos + 1), &end);
+                pos += end + 1;
+            }
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    // Процессоры, доступные процессу (в контейнере их может быть меньше, чем в системе).
+    // Маска читается один раз, до того как потоки начнут закрепляться
+    static const std::vector<int>& AllowedCpus() {
+        static const std::vector<int> allowed = QueryAllowedCpus();
+        return allowed;
+    }
+
+    // Доступные процессоры каждого узла NUMA. Без сведений о NUMA — один узел со всеми процессорами
+    static std::vector<std::vector<int>> Nodes() {
+        const std::vector<int>& allowed = AllowedCpus();
+        std::vector<std::vector<int>> nodes;
+        for (int node = 0;; ++node) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!file.is_open()) {
+                break;
+            }
+            std::string text;
+            std::getline(file, text);
+            std::vector<int> cpus;
+            for (int cpu : ParseCpuList(text)) {
+                if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+                    cpus.push_back(cpu);
+                }
+            }
+            if (!cpus.empty()) {
+                nodes.push_back(cpus);
+            }
+        }
+        if (nodes.empty()) {
+            nodes.push_back(allowed);
+        }
+        return nodes;
+    }
+
+    // Номер узла процессора; -1 — неизвестен
+    static int NodeOfCpu(int cpu) {
+        std::vector<std::vector<int>> nodes = Nodes();
+        for (size_t node = 0; node < nodes.size(); ++node) {
+            for (int nodeCpu : nodes[node]) {
+                if (nodeCpu == cpu) {
+                    return static_cast<int>(node);
+                }
+            }
+        }
+        return -1;
+    }
+
+    // По процессору на поток: узлы заполняются по порядку, чтобы соседние потоки
+    // делили кэш одного сокета. При нехватке процессоров распределение идет по кругу
+    static std::vector<std::vector<int>> WorkerCpuSets(size_t threads) {
+        std::vector<int> ordered;
+        for (const auto& node : Nodes()) {
+            ordered.insert(ordered.end(), node.begin(), node.end());
+        }
+        std::vector<std::vector<int>> sets;
+        for (size_t i = 0; i < threads; ++i) {
+            sets.push_back({ordered[i % ordered.size()]});
+        }
+        return sets;
+    }
+
+    // Процессор, на котором сейчас выполняется поток; -1 — неизвестен
+    static int CurrentCpu() {
+#if defined(__linux__)
+        return sched_getcpu();
+#else
+        return -1;
+#endif
+    }
+
+private:
+    static std::vector<int> QueryAllowedCpus() {
+        std::vector<int> cpus;
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &set)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+#endif
+        if (cpus.empty()) {
+            unsigned count = std::thread::hardware_concurrency();
+            for (unsigned cpu = 0; cpu < (count ? count : 1); ++cpu) {
+                cpus.push_back(static_cast<int>(cpu));
+            }
+        }
+        return cpus;
+    }
+};
+
+// Закрепление текущего потока за процессорами. false — не поддерживается или отказано
+inline bool PinCurrentThread(const std::vector<int>& cpus) {
+#if defined(__linux__)
+    if (cpus.empty()) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+// Снятие закрепления: поток может выполняться на любом доступном процессоре
+inline bool UnpinCurrentThread() {
+    return PinCurrentThread(CpuTopology::AllowedCpus());
+}
@@ -0,0 +1,253 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "world.h"
+
+// Шаги квантования передаваемых клиенту значений
+struct Quantization {
+    double position = 1.0 / 64;
+    double velocity = 1.0 / 256;
+    double rotation = 1.0 / 64;  // Градусы
+};
+
+// Квантованное состояние корабля, как его видит клиент
+struct QuantizedShip {
+    int64_t positionX = 0;
+    int64_t positionY = 0;
+    int64_t velocityX = 0;
+    int64_t velocityY = 0;
+    int64_t rotation = 0;
+};
+
+inline void WriteVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+inline bool ReadVarint(const uint8_t*& data, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && data < end; shift += 7) {
+        uint8_t byte = *data++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// ZigZag: небольшие по модулю отрицательные числа кодируются так же коротко, как положительные
+inline uint64_t ZigZag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t UnZigZag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// Формат пакета:
+//   varint тик, байт вида (DeltaPacket/FullPacket), затем записи кораблей по возрастанию номера:
+//   varint (номер - предыдущий номер - 1), байт маски полей,
+//   zigzag varint разностей с последним отправленным значением для каждого поля из маски.
+//   Бит ShipRemoved в маске — корабль с этим номером удален; поля рядом с ним — корабль, которому номер
+//   выдан снова (разности от нуля). В полном пакете так отмечаются все свободные номера
+enum PacketKind : uint8_t {
+    DeltaPacket = 0,
+    FullPacket = 1,  // Все корабли целиком, разности от нуля: для подключения нового клиента
+};
+
+// Кодировщик изменений мира за тик. Буфер пакета переиспользуется между тиками.
+class DeltaEncoder {
+private:
+    Quantization quantization;
+    std::vector<QuantizedShip> sent;  // Последнее отправленное состояние каждого корабля
+    std::vector<uint8_t> buffer;
+
+    QuantizedShip Quantize(const SpaceShip& ship) const {
+        Vector position = ship.getPosition();
+        Vector velocity = ship.getVelocity();
+        return QuantizedShip{std::llround(position.X / quantization.position),
+                             std::llround(position.Y / quantization.position),
+                             std::llround(velocity.X / quantization.velocity),
+                             std::llround(velocity.Y / quantization.velocity),
+                             std::llround(ship.getRotation() / quantization.rotation)};
+    }
+
+    void WriteShip(EntityId id, EntityId& next, const QuantizedShip& current, const QuantizedShip& base,
+                   uint8_t fields) {
+        WriteVarint(buffer, id - next);
+        next = id + 1;
+        buffer.push_back(fields);
+        if (fields & PositionField) {
+            WriteVarint(buffer, ZigZag(current.positionX - base.positionX));
+            WriteVarint(buffer, ZigZag(current.positionY - base.positionY));
+        }
+        if (fields & VelocityField) {
+            WriteVarint(buffer, ZigZag(current.velocityX - base.velocityX));
+            WriteVarint(buffer, ZigZag(current.velocityY - base.velocityY));
+        }
+        if (fields & RotationField) {
+            WriteVarint(buffer, ZigZag(current.rotation - base.rotation));
+        }
+    }
+
+    void BeginPacket(const World& world, uint64_t tick, PacketKind kind) {
+        buffer.clear();
+        WriteVarint(buffer, tick);
+        buffer.push_back(kind);
+        if (sent.size() < world.Size()) {
+            sent.resize(world.Size());
+        }
+    }
+
+public:
+    explicit DeltaEncoder(const Quantization& quantization = Quantization()) : quantization(quantization) {}
+
+    // Пакет изменений: только корабли, отмеченные миром, и только поля,
+    // чье квантованное значение отличается от отправленного ранее
+    const std::vector<uint8_t>& Encode(const World& world, uint64_t tick) {
+        BeginPacket(world, tick, DeltaPacket);
+        EntityId next = 0;
+        const QuantizedShip zero;
+        world.ForEachDirty([&](EntityId id, uint8_t dirtyFields) {
+            QuantizedShip& base = sent[id];
+            if (dirtyFields & ShipRemoved) {
+                base = zero;
+                if (!world.IsAlive(id)) {
+                    WriteShip(id, next, zero, zero, ShipRemoved);
+                    return;
+                }
+                // Номер выдан новому кораблю: все поля от нуля, даже нулевые — клиент создаст корабль
+                QuantizedShip current = Quantize(world.Ship(id));
+                WriteShip(id, next, current, zero, ShipRemoved | PositionField | VelocityField | RotationField);
+                base = current;
+                return;
+            }
+            if (!(dirtyFields & (PositionField | VelocityField | RotationField))) {
+                return;
+            }
+            QuantizedShip current = Quantize(world.Ship(id));
+            uint8_t fields = 0;
+            if (current.positionX != base.positionX || current.positionY != base.positionY) {
+                fields |= PositionField;
+            }
+            if (current.velocityX != base.velocityX || current.velocityY != base.velocityY) {
+                fields |= VelocityField;
+            }
+            if (current.rotation != base.rotation) {
+                fields |= RotationField;
+            }
+            if (fields) {
+                WriteShip(id, next, current, base, fields);
+                base = current;
+            }
+        });
+        return buffer;
+    }
+
+    // Полный снимок всех кораблей; свободные номера отмечаются удаленными
+    const std::vector<uint8_t>& EncodeFull(const World& world, uint64_t tick) {
+        BeginPacket(world, tick, FullPacket);
+        EntityId next = 0;
+        const QuantizedShip zero;
+        for (EntityId id = 0; id < world.Size(); ++id) {
+            if (!world.IsAlive(id)) {
+                WriteShip(id, next, zero, zero, ShipRemoved);
+                sent[id] = zero;
+                continue;
+            }
+            QuantizedShip current = Quantize(world.Ship(id));
+            WriteShip(id, next, current, zero, PositionField | VelocityField | RotationField);
+            sent[id] = current;
+        }
+        return buffer;
+    }
+};
+
+// Клиентская сторона: применяет пакеты к своей копии мира
+class DeltaDecoder {
+private:
+    Quantization quantization;
+    std::vector<QuantizedShip> received;
+    uint64_t lastTick = 0;
+
+public:
+    explicit DeltaDecoder(const Quantization& quantization = Quantization()) : quantization(quantization) {}
+
+    uint64_t LastTick() const {
+        return lastTick;
+    }
+
+    // false — пакет поврежден (состояние кораблей до места ошибки уже применено)
+    bool Apply(const uint8_t* data, size_t size, World& world) {
+        const uint8_t* end = data + size;
+        uint64_t tick;
+        if (!ReadVarint(data, end, tick) || data == end) {
+            return false;
+        }
+        PacketKind kind = static_cast<PacketKind>(*data++);
+        lastTick = tick;
+
+        uint64_t next = 0;
+        while (data < end) {
+            uint64_t gap;
+            if (!ReadVarint(data, end, gap) || data == end) {
+                return false;
+            }
+            uint64_t id = next + gap;
+            next = id + 1;
+            uint8_t fields = *data++;
+            if (id >= UINT32_MAX) {
+                return false;
+            }
+            if (received.size() <= id) {
+                received.resize(id + 1);
+            }
+
+            QuantizedShip& ship = received[id];
+            if (kind == FullPacket || (fields & ShipRemoved)) {
+                ship = QuantizedShip();
+            }
+            uint64_t raw[5];
+            int count = ((fields & PositionField) ? 2 : 0) + ((fields & VelocityField) ? 2 : 0) +
+                        ((fields & RotationField) ? 1 : 0);
+            for (int i = 0; i < count; ++i) {
+                if (!ReadVarint(data, end, raw[i])) {
+                    return false;
+                }
+            }
+
+            if (fields & ShipRemoved) {
+                world.EnsureRemoved(static_cast<EntityId>(id));
+                if (!(fields & (PositionField | VelocityField | RotationField))) {
+                    continue;
+                }
+            }
+            int i = 0;
+            SpaceShip& target = world.EnsureShip(static_cast<EntityId>(id));
+            if (fields & PositionField) {
+                ship.positionX += UnZigZag(raw[i++]);
+                ship.positionY += UnZigZag(raw[i++]);
+                target.setPosition(Vector(ship.positionX * quantization.position, ship.positionY * quantization.position));
+            }
+            if (fields & VelocityField) {
+                ship.velocityX += UnZigZag(raw[i++]);
+                ship.velocityY += UnZigZag(raw[i++]);
+                target.setVelocity(Vector(ship.velocityX * quantization.velocity, ship.velocityY * quantization.velocity));
+            }
+            if (fields & RotationField) {
+                ship.rotation += UnZigZag(raw[i++]);
+                target.setRotation(ship.rotation * quantization.rotation);
+            }
+        }
+        return true;
+    }
+
+    bool Apply(const std::vector<uint8_t>& packet, World& world) {
+        return Apply(packet.data(), packet.size(), world);
+    }
+};
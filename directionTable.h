@@ -0,0 +1,134 @@
+#pragma once
+#include <array>
+#include <stdexcept>
+#include <string>
+#include "vector.h"
+
+// Тригонометрия для таблиц направлений, вычисляемая компилятором.
+// Значения получаются одинаковыми на любой платформе: константные вычисления
+// выполняются по правилам IEEE и не зависят от libm.
+class DirectionMath {
+public:
+    static constexpr double Pi = 3.14159265358979323846;
+
+    // Ряд Тейлора; для |x| <= pi/4 погрешность меньше единицы последнего разряда
+    static constexpr double Sin(double x) {
+        double term = x;
+        double sum = x;
+        for (int i = 1; i < 14; ++i) {
+            term *= -x * x / ((2 * i) * (2 * i + 1));
+            sum += term;
+        }
+        return sum;
+    }
+
+    static constexpr double Cos(double x) {
+        double term = 1.0;
+        double sum = 1.0;
+        for (int i = 1; i < 14; ++i) {
+            term *= -x * x / ((2 * i - 1) * (2 * i));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // Синус угла step/directions полного оборота. Угол сводится к первой четверти;
+    // на границах четвертей значения точные (0 и ±1)
+    static constexpr double TurnSin(int step, int directions) {
+        long quarters = 4L * (step % directions);
+        long quadrant = quarters / directions;
+        long remainder = quarters % directions;  // Доля четверти: remainder / directions
+        double sign = (quadrant % 4 >= 2) ? -1.0 : 1.0;
+        bool odd = quadrant % 2 == 1;            // Во 2-й и 4-й четвертях синус идет как косинус
+        if (remainder == 0) {
+            return odd ? sign * 1.0 : 0.0;
+        }
+        if (2 * remainder == directions) {
+            double half = Sin(Pi / 4);
+            return sign * half;
+        }
+        bool upper = 2 * remainder > directions;  // Угол больше pi/4: через дополнительный
+        double angle = (upper ? directions - remainder : remainder) * (Pi / 2) / directions;
+        double value = (odd != upper) ? Cos(angle) : Sin(angle);
+        return sign * value;
+    }
+
+    // cos(x) = sin(x + pi/2); четверть оборота — целое число шагов
+    static constexpr double TurnCos(int step, int directions) {
+        return TurnSin((step + directions / 4) % directions, directions);
+    }
+};
+
+// Таблицы синусов и косинусов для N направлений, построенные во время компиляции
+template <int N>
+class DirectionTable {
+    static_assert(N > 0 && N % 4 == 0, "Directions number must be a positive multiple of 4");
+
+    static constexpr std::array<double, N> Build(bool cosine) {
+        std::array<double, N> table{};
+        for (int i = 0; i < N; ++i) {
+            table[i] = cosine ? DirectionMath::TurnCos(i, N) : DirectionMath::TurnSin(i, N);
+        }
+        return table;
+    }
+
+public:
+    static constexpr std::array<double, N> Sin = Build(false);
+    static constexpr std::array<double, N> Cos = Build(true);
+};
+
+// Таблица для количества направлений, заданного во время работы
+struct DirectionTableView {
+    const double* sin;
+    const double* cos;
+    int directions;
+};
+
+class DirectionTables {
+public:
+    template <int N>
+    static DirectionTableView View() {
+        return DirectionTableView{DirectionTable<N>::Sin.data(), DirectionTable<N>::Cos.data(), N};
+    }
+
+    static bool IsSupported(int directions) {
+        switch (directions) {
+            case 4: case 8: case 16: case 32: case 36: case 64: case 72: case 128: case 256: case 360:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static DirectionTableView Get(int directions) {
+        switch (directions) {
+            case 4: return View<4>();
+            case 8: return View<8>();
+            case 16: return View<16>();
+            case 32: return View<32>();
+            case 36: return View<36>();
+            case 64: return View<64>();
+            case 72: return View<72>();
+            case 128: return View<128>();
+            case 256: return View<256>();
+            case 360: return View<360>();
+            default:
+                throw std::invalid_argument("Unsupported directions number: " + std::to_string(directions));
+        }
+    }
+
+    // Номер направления в диапазоне [0, directions)
+    static int Normalize(int direction, int directions) {
+        int result = direction % directions;
+        return result < 0 ? result + directions : result;
+    }
+
+    // Поворот вектора на steps шагов по таблице
+    static Vector Rotate(const Vector& vector, int steps, int directions) {
+        DirectionTableView table = Get(directions);
+        int index = Normalize(steps, directions);
+        double c = table.cos[index];
+        double s = table.sin[index];
+        return Vector(vector.X * c - vector.Y * s, vector.X * s + vector.Y * c);
+    }
+};
@@ -1,9 +1,23 @@
 #pragma once
 #include <iostream>
-#include <queue>
 #include <stdexcept>
 #include <memory>
 #include <typeinfo>
+#include <deque>
+#include <cstdint>
+#include "commandStats.h"
+#include "tracing.h"
+#include "coroutineScheduler.h"
+#include "parallelExecutor.h"
+#include <algorithm>
+#include <exception>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+// Постоянный ключ цели команды: (владелец, номер). В отличие от адреса GetTarget() не меняется,
+// когда сущность переезжает в памяти (корабли мира — при удалении соседа и росте массива)
+using TargetKey = std::pair<const void*, uint64_t>;
 
 class LogCommand;
 class RetryCommand;
@@ -16,36 +30,291 @@ public:
     virtual void Execute() = 0;
     // Виртуальная функция для получения имени команды
     virtual std::string GetName() const = 0;
+    // Сущность (корабль), которую изменяет команда. Команды разных сущностей независимы
+    // и могут выполняться параллельно; nullptr — команда может затронуть что угодно
+    virtual const void* GetTarget() const { return nullptr; }
+    // Ключ той же цели для таблиц, живущих дольше одного вызова GetTarget(). По умолчанию — адрес
+    virtual TargetKey GetTargetKey() const { return TargetKey{GetTarget(), 0}; }
+};
+
+// Вид команды по ее точному типу (typeid(cmd)) для разбора команд без dynamic_cast по цепочке классов.
+// Сравнение type_info может сравнивать строки имен, поэтому таблица известных типов просматривается
+// один раз на тип, а результат запоминается по адресу type_info
+template <typename Kind>
+class TypeKindCache {
+public:
+    TypeKindCache(Kind other, std::initializer_list<std::pair<const std::type_info*, Kind>> known)
+        : other(other), known(known) {}
+
+    Kind Get(const std::type_info& type) {
+        for (const auto& [seen, kind] : cache) {
+            if (seen == &type) {
+                return kind;
+            }
+        }
+        Kind kind = other;
+        for (const auto& [candidate, candidateKind] : known) {
+            if (*candidate == type) {
+                kind = candidateKind;
+                break;
+            }
+        }
+        cache.emplace_back(&type, kind);
+        return kind;
+    }
+
+private:
+    Kind other;  // Вид типов, которых нет в таблице
+    std::vector<std::pair<const std::type_info*, Kind>> known;
+    std::vector<std::pair<const std::type_info*, Kind>> cache;
+};
+
+// Ошибки команд, выполненных внутри одной записи очереди (CoalescedCommand). Запись выполняется до конца
+// и бросает их вместе; обработчик очереди разбирает их по одной, как ошибки отдельных записей.
+// Поэтому в параллельном режиме полосы только собирают ошибки, а очередь меняется после их завершения
+class CommandFailures : public std::exception {
+public:
+    struct Failure {
+        std::shared_ptr<Command> cmd;
+        std::exception_ptr error;
+    };
+
+    explicit CommandFailures(std::vector<Failure> failures) : failures(std::move(failures)) {}
+
+    const char* what() const noexcept override {
+        return "Coalesced commands failed";
+    }
+
+    const std::vector<Failure>& Failures() const {
+        return failures;
+    }
+
+private:
+    std::vector<Failure> failures;
+};
+
+// Запись выполняемых команд (журнал). Вызывается до выполнения команды, из потока очереди
+class CommandRecorder {
+public:
+    virtual ~CommandRecorder() = default;
+    virtual void Record(uint64_t tick, const Command& cmd) = 0;
+    // Шаг движения мира (World::MoveShips) между командами тика; нужен журналу для точного повтора
+    virtual void RecordMovement(uint64_t tick) {}
+};
+
+// Дескриптор повторяющейся команды; после отмены устаревает и больше ни на что не влияет
+struct RepeatHandle {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
+// Команды, которые выполняются каждый тик до отмены (например, равномерное движение).
+// Узлы лежат в интрузивном двусвязном списке, освобожденные узлы переиспользуются,
+// поэтому регистрация, отмена и замена выполняются за O(1) и без выделений на тик.
+class RepeatList {
+private:
+    struct Node {
+        Node* prev = nullptr;
+        Node* next = nullptr;
+        std::shared_ptr<Command> command;
+        uint32_t index = 0;
+        uint32_t generation = 0;
+        bool active = false;
+    };
+
+    std::deque<Node> nodes;  // deque не перемещает узлы при росте
+    Node head;               // Сторож кольцевого списка активных узлов
+    Node* freeNodes = nullptr;
+    Node* cursor = nullptr;  // Следующий узел текущего обхода
+    size_t activeCount = 0;
+
+    Node* Find(RepeatHandle handle) {
+        if (handle.index >= nodes.size()) {
+            return nullptr;
+        }
+        Node& node = nodes[handle.index];
+        return node.active && node.generation == handle.generation ? &node : nullptr;
+    }
+
+public:
+    RepeatList() {
+        head.prev = head.next = &head;
+    }
+
+    RepeatList(const RepeatList&) = delete;
+    RepeatList& operator=(const RepeatList&) = delete;
+
+    RepeatHandle Add(std::shared_ptr<Command> cmd) {
+        Node* node = freeNodes;
+        if (node) {
+            freeNodes = node->next;
+        } else {
+            nodes.emplace_back();
+            node = &nodes.back();
+            node->index = static_cast<uint32_t>(nodes.size() - 1);
+        }
+        node->command = std::move(cmd);
+        node->active = true;
+        node->prev = head.prev;
+        node->next = &head;
+        head.prev->next = node;
+        head.prev = node;
+        ++activeCount;
+        return RepeatHandle{node->index, node->generation};
+    }
+
+    bool Cancel(RepeatHandle handle) {
+        Node* node = Find(handle);
+        if (!node) {
+            return false;
+        }
+        if (cursor == node) {
+            cursor = node->next;  // Отмена во время обхода: обход продолжится со следующего узла
+        }
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        node->command.reset();
+        node->active = false;
+        node->generation++;
+        node->next = freeNodes;
+        freeNodes = node;
+        --activeCount;
+        return true;
+    }
+
+    bool Replace(RepeatHandle handle, std::shared_ptr<Command> cmd) {
+        Node* node = Find(handle);
+        if (!node) {
+            return false;
+        }
+        node->command = std::move(cmd);
+        return true;
+    }
+
+    bool IsActive(RepeatHandle handle) {
+        return Find(handle) != nullptr;
+    }
+
+    size_t Size() const {
+        return activeCount;
+    }
+
+    // Обход активных команд; команды могут отменять и добавлять повторения во время обхода
+    template <typename Visitor>
+    void ForEach(Visitor&& visit) {
+        cursor = head.next;
+        while (cursor != &head) {
+            Node* node = cursor;
+            cursor = node->next;
+            std::shared_ptr<Command> cmd = node->command;  // Команду могут заменить во время выполнения
+            visit(cmd);
+        }
+        cursor = nullptr;
+    }
 };
 
 // Очередь команд
 class CommandQueue {
 private:
-    std::queue<std::shared_ptr<Command>> commands;
+    std::deque<std::shared_ptr<Command>> commands;
+    CommandScheduler scheduler;  // Долгие команды-корутины
+    RepeatList repeating;        // Команды, выполняемые каждый тик
+
+    // Параллельный режим
+    struct Failure {
+        size_t index;  // Позиция команды в пакете: исключения обрабатываются в исходном порядке
+        std::exception_ptr error;
+    };
+    ParallelExecutor* executor = nullptr;
+    CommandRecorder* recorder = nullptr;
+    std::vector<std::shared_ptr<Command>> batch;
+    std::vector<std::vector<size_t>> lanes;
+    std::vector<std::vector<Failure>> laneFailures;
 
 public:
     void AddCommand(std::shared_ptr<Command> cmd) {
-        commands.push(cmd);
+        commands.push_back(cmd);
+    }
+
+    // Команды, ожидающие следующего ProcessCommands, в порядке выполнения (без повторяющихся и корутин)
+    template <typename Visitor>
+    void ForEachPending(Visitor&& visit) const {
+        for (const auto& cmd : commands) {
+            visit(cmd);
+        }
+    }
+
+    // Запуск долгой команды-корутины; она начнет выполняться на следующем ProcessCommands
+    void Spawn(Behavior behavior) {
+        scheduler.Spawn(std::move(behavior));
+    }
+
+    CommandScheduler& Scheduler() {
+        return scheduler;
+    }
+
+    // Регистрация команды, которая будет выполняться каждый тик до отмены
+    RepeatHandle AddRepeating(std::shared_ptr<Command> cmd) {
+        return repeating.Add(std::move(cmd));
+    }
+
+    bool CancelRepeating(RepeatHandle handle) {
+        return repeating.Cancel(handle);
+    }
+
+    bool ReplaceRepeating(RepeatHandle handle, std::shared_ptr<Command> cmd) {
+        return repeating.Replace(handle, std::move(cmd));
     }
 
+    RepeatList& Repeating() {
+        return repeating;
+    }
+
+    // Параллельный режим: команды с разными GetTarget() выполняются на потоках executor.
+    // Команды одной сущности попадают в одну полосу и выполняются в порядке очереди,
+    // команды без сущности служат барьером. nullptr — последовательный режим.
+    void SetParallelExecutor(ParallelExecutor* parallelExecutor) {
+        executor = parallelExecutor;
+    }
+
+    // Журнал всех выполняемых команд, включая повторы и повторяющиеся команды. nullptr — без записи.
+    // В параллельном режиме команды записываются в порядке очереди до раздачи по потокам
+    void SetRecorder(CommandRecorder* commandRecorder) {
+        recorder = commandRecorder;
+    }
+
+    // Каждый вызов — один тик: возобновляются корутины, выполняются все команды из очереди,
+    // затем повторяющиеся команды
     void ProcessCommands() {
+        scheduler.Tick();
+
+        if (executor && executor->Threads() > 1) {
+            ProcessParallel();
+        }
         while (!commands.empty()) {
             auto cmd = commands.front();
-            commands.pop();
-
-            try {
-                cmd->Execute();  // Выполнение команды
-            } catch (const std::exception& ex) {
-                std::cerr << "Exception caught: " << ex.what() << std::endl;
-                HandleException(cmd, ex);  // Обработка исключений
-            }
+            commands.pop_front();
+            ExecuteCommand(cmd);
         }
+
+        repeating.ForEach([&](const std::shared_ptr<Command>& cmd) { ExecuteCommand(cmd); });
     }
 
     // Обработчик исключений
     void HandleException(std::shared_ptr<Command> cmd, const std::exception& ex) {
+        if (const auto* nested = dynamic_cast<const CommandFailures*>(&ex)) {
+            for (const auto& failure : nested->Failures()) {
+                try {
+                    std::rethrow_exception(failure.error);
+                } catch (const std::exception& inner) {
+                    HandleException(failure.cmd, inner);
+                }
+            }
+            return;
+        }
         if (typeid(ex) == typeid(std::runtime_error)) {
             std::cerr << "Handling runtime_error for command: " << cmd->GetName() << std::endl;
+            CommandProbe::Retry(typeid(*cmd), [&] { return cmd->GetName(); });
             // Добавляем команду-повторитель
             auto retryCmd = std::make_shared<RetryCommand>(cmd);
             AddCommand(std::static_pointer_cast<Command>(retryCmd));
@@ -55,6 +324,110 @@ public:
             AddCommand(std::static_pointer_cast<Command>(std::make_shared<LogCommand>(cmd, ex)));
         }
     }
+
+    // Корзина цели среди laneCount (полоса параллельного режима, ячейка хэш-таблицы по цели)
+    static size_t LaneOf(const void* target, size_t laneCount) {
+        uint64_t key = reinterpret_cast<uintptr_t>(target);
+        key = (key >> 4) * 0x9E3779B97F4A7C15ull;  // Перемешивание: адреса выровнены
+        return static_cast<size_t>(key >> 32) % laneCount;
+    }
+
+private:
+    // Выполнение команды с замерами; исключение пробрасывается вызывающему
+    static void RunCommand(Command& cmd) {
+        TraceScope trace("CommandQueue", typeid(cmd), [&] { return cmd.GetName(); });
+        CommandProbe probe(typeid(cmd), [&] { return cmd.GetName(); });  // Внутри трассы: замер — только Execute
+        try {
+            cmd.Execute();  // Выполнение команды
+        } catch (...) {
+            probe.Fail();
+            throw;
+        }
+    }
+
+    void ExecuteCommand(const std::shared_ptr<Command>& cmd) {
+        if (recorder) {
+            recorder->Record(scheduler.CurrentTick(), *cmd);
+        }
+        try {
+            RunCommand(*cmd);
+        } catch (const std::exception& ex) {
+            std::cerr << "Exception caught: " << ex.what() << std::endl;
+            HandleException(cmd, ex);  // Обработка исключений
+        }
+    }
+
+    // Очередь выбирается пакетами: повторы и логирование, добавленные при обработке
+    // исключений, попадают в следующий пакет — как и при последовательной обработке
+    void ProcessParallel() {
+        while (!commands.empty()) {
+            batch.clear();
+            while (!commands.empty()) {
+                batch.push_back(std::move(commands.front()));
+                commands.pop_front();
+            }
+
+            size_t begin = 0;
+            while (begin < batch.size()) {
+                if (!batch[begin]->GetTarget()) {
+                    ExecuteCommand(batch[begin]);  // Барьер
+                    ++begin;
+                    continue;
+                }
+                size_t end = begin;
+                while (end < batch.size() && batch[end]->GetTarget()) {
+                    ++end;
+                }
+                ExecuteSegment(begin, end);
+                begin = end;
+            }
+            batch.clear();
+        }
+    }
+
+    void ExecuteSegment(size_t begin, size_t end) {
+        const size_t laneCount = executor->Threads() * 4;  // Несколько полос на поток для балансировки
+        lanes.resize(laneCount);
+        laneFailures.resize(laneCount);
+        for (size_t lane = 0; lane < laneCount; ++lane) {
+            lanes[lane].clear();
+            laneFailures[lane].clear();
+        }
+        for (size_t i = begin; i < end; ++i) {
+            if (recorder) {
+                recorder->Record(scheduler.CurrentTick(), *batch[i]);
+            }
+            lanes[LaneOf(batch[i]->GetTarget(), laneCount)].push_back(i);
+        }
+
+        executor->Run(laneCount, [this](size_t lane) {
+            for (size_t index : lanes[lane]) {
+                try {
+                    RunCommand(*batch[index]);
+                } catch (...) {
+                    laneFailures[lane].push_back(Failure{index, std::current_exception()});
+                }
+            }
+        });
+
+        std::vector<Failure> failures;
+        for (auto& laneFailure : laneFailures) {
+            failures.insert(failures.end(), laneFailure.begin(), laneFailure.end());
+        }
+        if (failures.empty()) {
+            return;
+        }
+        std::sort(failures.begin(), failures.end(),
+                  [](const Failure& a, const Failure& b) { return a.index < b.index; });
+        for (const auto& failure : failures) {
+            try {
+                std::rethrow_exception(failure.error);
+            } catch (const std::exception& ex) {
+                std::cerr << "Exception caught: " << ex.what() << std::endl;
+                HandleException(batch[failure.index], ex);
+            }
+        }
+    }
 };
 
 // Команда записи в лог
@@ -107,9 +480,29 @@ public:
         }
     }
 
+    const std::shared_ptr<Command>& GetOriginal() const {
+        return originalCommand;
+    }
+
+    int GetRetryCount() const {
+        return retryCount;
+    }
+
+    int GetMaxRetries() const {
+        return maxRetries;
+    }
+
     std::string GetName() const override {
         return "RetryCommand";
     }
+
+    const void* GetTarget() const override {
+        return originalCommand->GetTarget();
+    }
+
+    TargetKey GetTargetKey() const override {
+        return originalCommand->GetTargetKey();
+    }
 };
 
 
@@ -153,7 +546,23 @@ public:
         }
     }
 
+    const std::shared_ptr<Command>& GetOriginal() const {
+        return originalCommand;
+    }
+
+    int GetRetryCount() const {
+        return retryCount;
+    }
+
     std::string GetName() const override {
         return "RetryTwiceCommand";
     }
+
+    const void* GetTarget() const override {
+        return originalCommand->GetTarget();
+    }
+
+    TargetKey GetTargetKey() const override {
+        return originalCommand->GetTargetKey();
+    }
 };
@@ -0,0 +1,250 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "commandStats.h"
+#include "world.h"
+#include "collision.h"
+#include "exception_queue.h"
+#include "coalescer.h"
+
+// Фазы тика в порядке выполнения
+enum class TickPhase {
+    Ingest,     // Прием входящих команд (сеть, ИИ)
+    Commands,   // CommandQueue::ProcessCommands
+    Movement,   // Шаг движения
+    Collision,  // Поиск столкновений за шаг (события выполнятся командами следующего тика)
+    Broadcast,  // Рассылка изменений
+};
+
+constexpr int TickPhaseCount = 5;
+
+inline const char* TickPhaseName(TickPhase phase) {
+    static const char* names[TickPhaseCount] = {"ingest", "commands", "movement", "collision", "broadcast"};
+    return names[static_cast<int>(phase)];
+}
+
+// Что делать, если тик не уложился в свой интервал
+enum class CatchUpPolicy {
+    CatchUp,  // Пропущенные тики выполняются подряд без сна (не больше maxCatchUpTicks), остальные пропускаются
+    Skip,     // Пропущенные тики отбрасываются, следующий тик — на ближайшем дедлайне
+};
+
+// Мир, которым управляет цикл. Необязательные части можно не задавать
+struct LoopWorld {
+    World* world = nullptr;
+    CommandQueue* queue = nullptr;
+    CollisionDetector* collisions = nullptr;
+    std::function<void(uint64_t tick)> ingest;
+    std::function<void(uint64_t tick)> broadcast;  // Например, DeltaEncoder::Encode и ClearDirty
+    CommandCoalescer* coalescer = nullptr;  // Слияние входящих команд: сбрасывается в очередь после приема
+    // Журнал мира (CommandJournal): шаг движения записывается перед MoveShips.
+    // Команды журнал получает от очереди (CommandQueue::SetRecorder)
+    CommandRecorder* recorder = nullptr;
+};
+
+// Статистика цикла; время фаз суммируется по всем мирам тика
+struct GameLoopStats {
+    LatencyHistogram phaseNs[TickPhaseCount];
+    LatencyHistogram tickNs;      // Вся работа тика
+    LatencyHistogram latenessNs;  // Опоздание начала тика относительно дедлайна
+    uint64_t ticks = 0;
+    uint64_t overruns = 0;        // Тики, закончившиеся позже дедлайна следующего
+    uint64_t skippedTicks = 0;
+};
+
+// Цикл с фиксированным шагом. Дедлайны абсолютные (start + n * period), поэтому ошибки сна
+// не накапливаются. Миры обрабатываются по очереди в потоке, вызвавшем Run
+class GameLoop {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit GameLoop(std::chrono::nanoseconds period, CatchUpPolicy policy = CatchUpPolicy::CatchUp,
+                      uint32_t maxCatchUpTicks = 5)
+        : period(period), policy(policy), maxCatchUpTicks(maxCatchUpTicks) {}
+
+    size_t AddWorld(const LoopWorld& loopWorld) {
+        worlds.push_back(loopWorld);
+        return worlds.size() - 1;
+    }
+
+    // Выполняет ticks тиков (0 — до Stop) и возвращает количество выполненных.
+    // Stop, вызванный до Run, останавливает его сразу; следующий Run снова работает
+    uint64_t Run(uint64_t ticks = 0) {
+        uint64_t executed = 0;
+        Clock::time_point deadline = Clock::now();
+        while ((ticks == 0 || executed < ticks) && !stopping.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_until(deadline);
+            Clock::time_point started = Clock::now();
+            RunTick(started - deadline);
+            ++executed;
+
+            deadline += period;
+            Clock::time_point now = Clock::now();
+            if (now <= deadline) {
+                continue;
+            }
+            // Тик не уложился: решаем, сколько пропущенных тиков догонять
+            uint64_t skip = TicksToSkip(now - deadline);
+            deadline += period * static_cast<int64_t>(skip);
+            std::lock_guard<std::mutex> lock(statsMutex);
+            ++stats.overruns;
+            stats.skippedTicks += skip;
+        }
+        stopping.store(false, std::memory_order_relaxed);
+        return executed;
+    }
+
+    // Сколько тиков пропустить, если дедлайн следующего тика прошел overdue назад.
+    // Пропущены сам этот дедлайн и все, прошедшие после него полностью
+    uint64_t TicksToSkip(Clock::duration overdue) const {
+        uint64_t missed = static_cast<uint64_t>(overdue / period) + 1;
+        if (policy == CatchUpPolicy::Skip) {
+            return missed;  // Следующий тик — на ближайшем будущем дедлайне
+        }
+        return missed > maxCatchUpTicks ? missed - maxCatchUpTicks : 0;  // Подряд — не больше maxCatchUpTicks
+    }
+
+    // Остановка Run из другого потока (или из фазы тика) после текущего тика
+    void Stop() {
+        stopping.store(true, std::memory_order_relaxed);
+    }
+
+    // Один тик всех миров без ожидания дедлайна
+    void RunTick(Clock::duration lateness = Clock::duration::zero()) {
+        uint64_t phaseNs[TickPhaseCount] = {};
+        Clock::time_point tickStart = Clock::now();
+        ++tick;
+        for (LoopWorld& loopWorld : worlds) {
+            Clock::time_point mark = Clock::now();
+            auto phaseDone = [&](TickPhase phase) {
+                Clock::time_point now = Clock::now();
+                phaseNs[static_cast<int>(phase)] += static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(now - mark).count());
+                mark = now;
+            };
+
+            if (loopWorld.ingest) {
+                loopWorld.ingest(tick);
+            }
+            if (loopWorld.coalescer) {
+                loopWorld.coalescer->Flush();
+            }
+            phaseDone(TickPhase::Ingest);
+            if (loopWorld.queue) {
+                loopWorld.queue->ProcessCommands();
+            }
+            phaseDone(TickPhase::Commands);
+            if (loopWorld.world) {
+                if (loopWorld.collisions) {
+                    loopWorld.collisions->BeginStep(*loopWorld.world);
+                }
+                if (loopWorld.recorder) {
+                    loopWorld.recorder->RecordMovement(loopWorld.queue ? loopWorld.queue->Scheduler().CurrentTick()
+                                                                       : tick);
+                }
+                loopWorld.world->MoveShips();
+            }
+            phaseDone(TickPhase::Movement);
+            if (loopWorld.world && loopWorld.collisions && loopWorld.queue) {
+                loopWorld.collisions->Detect(*loopWorld.world, *loopWorld.queue);
+            }
+            phaseDone(TickPhase::Collision);
+            if (loopWorld.broadcast) {
+                loopWorld.broadcast(tick);
+            }
+            phaseDone(TickPhase::Broadcast);
+        }
+
+        uint64_t tickNs = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - tickStart).count());
+        std::lock_guard<std::mutex> lock(statsMutex);
+        for (int phase = 0; phase < TickPhaseCount; ++phase) {
+            stats.phaseNs[phase].Record(phaseNs[phase]);
+        }
+        stats.tickNs.Record(tickNs);
+        stats.latenessNs.Record(static_cast<uint64_t>(
+            std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(lateness).count())));
+        ++stats.ticks;
+    }
+
+    uint64_t CurrentTick() const {
+        return tick;
+    }
+
+    std::chrono::nanoseconds Period() const {
+        return period;
+    }
+
+    // Копия статистики; можно вызывать из другого потока во время Run
+    GameLoopStats Stats() const {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        return stats;
+    }
+
+    // Статистика в текстовом формате Prometheus
+    bool WritePrometheus(const std::string& path) const {
+        std::ofstream out(path, std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Cannot open stats file: " << path << std::endl;
+            return false;
+        }
+        GameLoopStats snapshot = Stats();
+
+        const std::pair<const char*, uint64_t> counters[] = {
+            {"spaceship_loop_ticks_total", snapshot.ticks},
+            {"spaceship_loop_overruns_total", snapshot.overruns},
+            {"spaceship_loop_skipped_ticks_total", snapshot.skippedTicks},
+        };
+        for (const auto& [name, value] : counters) {
+            out << "# TYPE " << name << " counter\n";
+            out << name << " " << value << "\n";
+        }
+
+        const uint64_t boundsNs[] = {1000, 10000, 100000, 250000, 500000, 1000000, 2500000, 5000000,
+                                     10000000, 16666667, 33333333, 100000000};
+        auto writeHistogram = [&](const char* name, const std::string& labels, const LatencyHistogram& histogram) {
+            std::string prefix = labels.empty() ? "{" : "{" + labels + ",";
+            for (uint64_t bound : boundsNs) {
+                out << name << "_bucket" << prefix << "le=\"" << static_cast<double>(bound) / 1e9 << "\"} "
+                    << histogram.CountBelow(bound) << "\n";
+            }
+            out << name << "_bucket" << prefix << "le=\"+Inf\"} " << histogram.Count() << "\n";
+            std::string plain = labels.empty() ? "" : "{" + labels + "}";
+            out << name << "_sum" << plain << " " << static_cast<double>(histogram.Sum()) / 1e9 << "\n";
+            out << name << "_count" << plain << " " << histogram.Count() << "\n";
+        };
+
+        out << "# HELP spaceship_loop_phase_seconds Time spent in each tick phase\n";
+        out << "# TYPE spaceship_loop_phase_seconds histogram\n";
+        for (int phase = 0; phase < TickPhaseCount; ++phase) {
+            writeHistogram("spaceship_loop_phase_seconds",
+                           std::string("phase=\"") + TickPhaseName(static_cast<TickPhase>(phase)) + "\"",
+                           snapshot.phaseNs[phase]);
+        }
+        out << "# TYPE spaceship_loop_tick_seconds histogram\n";
+        writeHistogram("spaceship_loop_tick_seconds", "", snapshot.tickNs);
+        out << "# TYPE spaceship_loop_lateness_seconds histogram\n";
+        writeHistogram("spaceship_loop_lateness_seconds", "", snapshot.latenessNs);
+        return static_cast<bool>(out);
+    }
+
+private:
+    std::chrono::nanoseconds period;
+    CatchUpPolicy policy;
+    uint32_t maxCatchUpTicks;
+    std::vector<LoopWorld> worlds;
+    std::atomic<bool> stopping{false};
+    uint64_t tick = 0;
+
+    mutable std::mutex statsMutex;
+    GameLoopStats stats;
+};
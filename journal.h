@@ -0,0 +1,769 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+#include "world.h"
+#include "deltaCodec.h"
+#include "exception_queue.h"
+#include "movement.h"
+#include "moveShipCommand.h"
+#include "changeVelocity.h"
+#include "burnFuelCommand.h"
+#include "checkFuelCommand.h"
+#include "moveWithFuel.h"
+#include "rotateAndChangeVelocity.h"
+#include "macroCommand.h"
+#include "collision.h"
+#include "coalescer.h"
+
+// Формат журнала:
+//   "SSJ1", затем записи: varint тик, байт кода операции, аргументы.
+//   Корабль — varint номер в мире, числа с плавающей точкой — 8 байт как есть (для точного повтора).
+//   Вложенные команды (макрокоманда, повторы) записываются без тика.
+//   Перед первой командой, которая видит новые корабли, идет запись JournalShips с их состоянием.
+//   Так же перед командой записываются удаления кораблей (JournalRemoveShip) и корабли, получившие
+//   освободившийся номер (JournalShips с одним кораблем).
+//   Шаг движения мира между командами записывается как JournalMoveShips (GameLoop, LoopWorld::recorder).
+enum JournalOpcode : uint8_t {
+    JournalShips = 1,            // varint первый номер, varint количество, состояния кораблей
+    JournalMove = 2,             // корабль
+    JournalChangeVelocity = 3,   // корабль, x, y
+    JournalBurnFuel = 4,         // корабль, топливо
+    JournalCheckFuel = 5,        // корабль, топливо
+    JournalMoveWithFuel = 6,     // корабль, топливо
+    JournalRotateAndChange = 7,  // корабль, байт дискретности, угол или zigzag шагов, x, y
+    JournalMacro = 8,            // varint количество, вложенные команды
+    JournalRetry = 9,            // varint выполнено попыток, varint максимум, вложенная команда
+    JournalRetryTwice = 10,      // varint выполнено попыток, вложенная команда
+    JournalCollision = 11,       // первый, второй, байт препятствия, время, две точки касания
+    JournalOpaque = 12,          // varint длина, имя: команда без кодировки, при повторе пропускается
+    JournalCoalesced = 13,       // varint количество, вложенные команды (ошибка одной не останавливает остальные)
+    JournalMoveShips = 14,       // Без аргументов: шаг движения мира (World::MoveShips)
+    JournalRemoveShip = 15,      // корабль: удален из мира (World::RemoveShip)
+};
+
+constexpr char JournalMagic[4] = {'S', 'S', 'J', '1'};
+
+inline void WriteDouble(std::vector<uint8_t>& out, double value) {
+    uint8_t bytes[sizeof(double)];
+    std::memcpy(bytes, &value, sizeof(double));
+    out.insert(out.end(), bytes, bytes + sizeof(double));
+}
+
+inline bool ReadDouble(const uint8_t*& data, const uint8_t* end, double& value) {
+    if (end - data < static_cast<ptrdiff_t>(sizeof(double))) {
+        return false;
+    }
+    std::memcpy(&value, data, sizeof(double));
+    data += sizeof(double);
+    return true;
+}
+
+// Контрольная сумма состояния кораблей (FNV-1a по битам значений)
+inline uint64_t WorldChecksum(const World& world) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&hash](double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        for (int i = 0; i < 8; ++i) {
+            hash ^= (bits >> (i * 8)) & 0xFF;
+            hash *= 0x100000001b3ull;
+        }
+    };
+    for (EntityId id = 0; id < world.Size(); ++id) {
+        if (!world.IsAlive(id)) {
+            continue;
+        }
+        const SpaceShip& ship = world.Ship(id);
+        mix(ship.getPosition().X);
+        mix(ship.getPosition().Y);
+        mix(ship.getVelocity().X);
+        mix(ship.getVelocity().Y);
+        mix(ship.getRotation());
+        mix(ship.getFuel());
+    }
+    return hash;
+}
+
+// Буферизованная запись в файл без ожидания диска в игровом цикле.
+// Заполненный буфер отдается фоновому потоку; если тот еще пишет предыдущий,
+// текущий буфер просто продолжает расти.
+class JournalWriter {
+public:
+    explicit JournalWriter(size_t flushThreshold = 1 << 16) : flushThreshold(flushThreshold) {}
+
+    JournalWriter(const JournalWriter&) = delete;
+    JournalWriter& operator=(const JournalWriter&) = delete;
+
+    ~JournalWriter() {
+        Close();
+    }
+
+    bool Open(const std::string& path) {
+        Close();
+        file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        stopping = false;
+        flusher = std::thread(&JournalWriter::FlushLoop, this);
+        return true;
+    }
+
+    bool IsOpen() const {
+        return file != nullptr;
+    }
+
+    // Буфер для дописывания записи; после записи нужно вызвать Commit
+    std::vector<uint8_t>& Buffer() {
+        return active;
+    }
+
+    void Commit() {
+        if (active.size() < flushThreshold) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if (!lock.owns_lock() || pending) {
+            return;
+        }
+        std::swap(active, flushing);
+        active.clear();
+        pending = true;
+        cv.notify_one();
+    }
+
+    // Дописывает остаток и закрывает файл
+    void Close() {
+        if (!file) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_one();
+        flusher.join();
+        Write(active);
+        active.clear();
+        std::fclose(file);
+        file = nullptr;
+    }
+
+    uint64_t BytesWritten() const {
+        return bytesWritten.load(std::memory_order_relaxed);
+    }
+
+private:
+    void Write(const std::vector<uint8_t>& data) {
+        if (!data.empty()) {
+            std::fwrite(data.data(), 1, data.size(), file);
+            bytesWritten.fetch_add(data.size(), std::memory_order_relaxed);
+        }
+    }
+
+    void FlushLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [this] { return pending || stopping; });
+            if (pending) {
+                lock.unlock();
+                Write(flushing);
+                flushing.clear();
+                lock.lock();
+                pending = false;
+            }
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    size_t flushThreshold;
+    std::FILE* file = nullptr;
+    std::vector<uint8_t> active;
+    std::vector<uint8_t> flushing;
+    std::thread flusher;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool pending = false;
+    bool stopping = false;
+    std::atomic<uint64_t> bytesWritten{0};
+};
+
+// Журнал команд мира. Подключается к одной очереди (CommandQueue::SetRecorder или SafeQueue::setRecorder)
+// и вызывается только из ее потока. Команды кораблей вне мира и неизвестные команды
+// записываются как JournalOpaque
+class CommandJournal : public CommandRecorder {
+public:
+    explicit CommandJournal(const World& world, size_t flushThreshold = 1 << 16)
+        : world(world), writer(flushThreshold) {}
+
+    bool Open(const std::string& path) {
+        if (!writer.Open(path)) {
+            return false;
+        }
+        knownShips = 0;
+        knownGenerations.clear();
+        knownSlotChanges = world.SlotChanges();
+        records = 0;
+        movements = 0;
+        std::vector<uint8_t>& out = writer.Buffer();
+        out.insert(out.end(), JournalMagic, JournalMagic + sizeof(JournalMagic));
+        return true;
+    }
+
+    void Close() {
+        writer.Close();
+    }
+
+    void Record(uint64_t tick, const Command& cmd) override {
+        if (!writer.IsOpen()) {
+            return;
+        }
+        std::vector<uint8_t>& out = writer.Buffer();
+        SyncShips(out, tick);
+        WriteVarint(out, tick);
+        Encode(out, cmd);
+        ++records;
+        writer.Commit();
+    }
+
+    void RecordMovement(uint64_t tick) override {
+        if (!writer.IsOpen()) {
+            return;
+        }
+        std::vector<uint8_t>& out = writer.Buffer();
+        SyncShips(out, tick);
+        WriteVarint(out, tick);
+        out.push_back(JournalMoveShips);
+        ++movements;
+        writer.Commit();
+    }
+
+    uint64_t Records() const {
+        return records;
+    }
+
+    uint64_t Movements() const {
+        return movements;
+    }
+
+    uint64_t BytesWritten() const {
+        return writer.BytesWritten();
+    }
+
+private:
+    static void WriteEntity(std::vector<uint8_t>& out, EntityId id) {
+        WriteVarint(out, id);
+    }
+
+    // Поколение живого корабля, 0 — номер свободен (поколения мира начинаются с 1)
+    uint32_t LiveGeneration(EntityId id) const {
+        return world.IsAlive(id) ? world.Generation(id) : 0;
+    }
+
+    // Записи о кораблях, которых повтор еще не видел: новые номера, удаления и повторно выданные номера.
+    // Известные номера проверяются, только если мир удалял корабли или выдавал номера снова
+    void SyncShips(std::vector<uint8_t>& out, uint64_t tick) {
+        if (world.SlotChanges() != knownSlotChanges) {
+            knownSlotChanges = world.SlotChanges();
+            for (EntityId id = 0; id < knownShips; ++id) {
+                uint32_t generation = LiveGeneration(id);
+                if (generation == knownGenerations[id]) {
+                    continue;
+                }
+                if (knownGenerations[id] != 0) {
+                    WriteRemoval(out, tick, id);
+                }
+                if (generation != 0) {
+                    WriteShips(out, tick, id, id + 1);
+                }
+                knownGenerations[id] = generation;
+            }
+        }
+        if (world.Size() > knownShips) {
+            EntityId first = static_cast<EntityId>(knownShips);
+            knownShips = world.Size();
+            WriteShips(out, tick, first, static_cast<EntityId>(knownShips));
+            knownGenerations.resize(knownShips);
+            for (EntityId id = first; id < knownShips; ++id) {
+                knownGenerations[id] = LiveGeneration(id);
+                if (knownGenerations[id] == 0) {
+                    WriteRemoval(out, tick, id);  // Повтор создает все номера диапазона, свободные — удаляет
+                }
+            }
+        }
+    }
+
+    static void WriteRemoval(std::vector<uint8_t>& out, uint64_t tick, EntityId id) {
+        WriteVarint(out, tick);
+        out.push_back(JournalRemoveShip);
+        WriteEntity(out, id);
+    }
+
+    void WriteShips(std::vector<uint8_t>& out, uint64_t tick, EntityId first, EntityId end) {
+        WriteVarint(out, tick);
+        out.push_back(JournalShips);
+        WriteVarint(out, first);
+        WriteVarint(out, end - first);
+        const SpaceShip removed(Vector(), 0);
+        for (EntityId id = first; id < end; ++id) {
+            const SpaceShip& ship = world.IsAlive(id) ? world.Ship(id) : removed;
+            WriteDouble(out, ship.getPosition().X);
+            WriteDouble(out, ship.getPosition().Y);
+            WriteDouble(out, ship.getVelocity().X);
+            WriteDouble(out, ship.getVelocity().Y);
+            WriteDouble(out, ship.getRotation());
+            WriteDouble(out, ship.getFuel());
+            WriteVarint(out, static_cast<uint64_t>(ship.getDirectionsNumber()));
+            WriteVarint(out, static_cast<uint64_t>(ship.getDirection()));
+        }
+    }
+
+    // Номер корабля по адресу цели команды; корабли, созданные после последней записи кораблей,
+    // записываются перед командой, поэтому номер всегда известен повтору
+    bool Lookup(const void* target, EntityId& id) const {
+        return target && world.IdOf(target, id) && id < knownShips;
+    }
+
+    void WriteOpaque(std::vector<uint8_t>& out, const Command& cmd) {
+        std::string name = cmd.GetName();
+        out.push_back(JournalOpaque);
+        WriteVarint(out, name.size());
+        out.insert(out.end(), name.begin(), name.end());
+    }
+
+    void Encode(std::vector<uint8_t>& out, const Command& cmd) {
+        JournalOpcode opcode = opcodes.Get(typeid(cmd));
+        switch (opcode) {
+            case JournalMacro: {
+                auto& macro = static_cast<const MacroCommand&>(cmd);
+                out.push_back(JournalMacro);
+                WriteVarint(out, macro.GetCommands().size());
+                for (const auto& child : macro.GetCommands()) {
+                    Encode(out, *child);
+                }
+                return;
+            }
+            case JournalCoalesced: {
+                auto& coalesced = static_cast<const CoalescedCommand&>(cmd);
+                out.push_back(JournalCoalesced);
+                WriteVarint(out, coalesced.GetCommands().size());
+                for (const auto& child : coalesced.GetCommands()) {
+                    Encode(out, *child);
+                }
+                return;
+            }
+            case JournalRetry: {
+                auto& retry = static_cast<const RetryCommand&>(cmd);
+                out.push_back(JournalRetry);
+                WriteVarint(out, static_cast<uint64_t>(retry.GetRetryCount()));
+                WriteVarint(out, static_cast<uint64_t>(retry.GetMaxRetries()));
+                Encode(out, *retry.GetOriginal());
+                return;
+            }
+            case JournalRetryTwice: {
+                auto& retry = static_cast<const RetryTwiceCommand&>(cmd);
+                out.push_back(JournalRetryTwice);
+                WriteVarint(out, static_cast<uint64_t>(retry.GetRetryCount()));
+                Encode(out, *retry.GetOriginal());
+                return;
+            }
+            case JournalCollision: {
+                const auto& collision = static_cast<const CollisionCommand&>(cmd);
+                if (!collision.ShipsAlive()) {
+                    break;  // Как команды удаленных кораблей: без кодировки, при повторе пропускается
+                }
+                const Collision& hit = collision.GetCollision();
+                out.push_back(JournalCollision);
+                WriteVarint(out, hit.first);
+                WriteVarint(out, hit.second);
+                out.push_back(hit.obstacle ? 1 : 0);
+                WriteDouble(out, hit.time);
+                WriteDouble(out, hit.firstContact.X);
+                WriteDouble(out, hit.firstContact.Y);
+                WriteDouble(out, hit.secondContact.X);
+                WriteDouble(out, hit.secondContact.Y);
+                return;
+            }
+            default:
+                break;
+        }
+
+        EntityId id;
+        if (opcode == JournalOpaque || !Lookup(cmd.GetTarget(), id)) {
+            WriteOpaque(out, cmd);
+            return;
+        }
+        out.push_back(opcode);
+        WriteEntity(out, id);
+        switch (opcode) {
+            case JournalChangeVelocity: {
+                const Vector& velocity = static_cast<const ChangeVelocityCommand&>(cmd).GetVelocity();
+                WriteDouble(out, velocity.X);
+                WriteDouble(out, velocity.Y);
+                break;
+            }
+            case JournalBurnFuel:
+                WriteDouble(out, static_cast<const BurnFuelCommand&>(cmd).GetFuel());
+                break;
+            case JournalCheckFuel:
+                WriteDouble(out, static_cast<const CheckFuelCommand&>(cmd).GetRequiredFuel());
+                break;
+            case JournalMoveWithFuel:
+                WriteDouble(out, static_cast<const MoveWithFuelCommand&>(cmd).GetFuelNeeded());
+                break;
+            case JournalRotateAndChange: {
+                auto& rotate = static_cast<const RotateAndChangeVelocity&>(cmd);
+                out.push_back(rotate.IsDiscrete() ? 1 : 0);
+                if (rotate.IsDiscrete()) {
+                    WriteVarint(out, ZigZag(rotate.GetSteps().value));
+                } else {
+                    WriteDouble(out, rotate.GetAngle());
+                }
+                WriteDouble(out, rotate.GetVelocity().X);
+                WriteDouble(out, rotate.GetVelocity().Y);
+                break;
+            }
+            default:  // JournalMove: только корабль
+                break;
+        }
+    }
+
+    const World& world;
+    JournalWriter writer;
+    size_t knownShips = 0;
+    std::vector<uint32_t> knownGenerations;  // По номеру: LiveGeneration, как его видел журнал
+    uint64_t knownSlotChanges = 0;
+    // Код операции по точному типу команды: запись идет на каждую команду
+    TypeKindCache<JournalOpcode> opcodes{JournalOpaque,
+                                         {{&typeid(MacroCommand), JournalMacro},
+                                          {&typeid(CoalescedCommand), JournalCoalesced},
+                                          {&typeid(RetryCommand), JournalRetry},
+                                          {&typeid(RetryTwiceCommand), JournalRetryTwice},
+                                          {&typeid(CollisionCommand), JournalCollision},
+                                          {&typeid(MoveCommand), JournalMove},
+                                          {&typeid(MoveShipCommand), JournalMove},
+                                          {&typeid(ChangeVelocityCommand), JournalChangeVelocity},
+                                          {&typeid(BurnFuelCommand), JournalBurnFuel},
+                                          {&typeid(CheckFuelCommand), JournalCheckFuel},
+                                          {&typeid(MoveWithFuelCommand), JournalMoveWithFuel},
+                                          {&typeid(RotateAndChangeVelocity), JournalRotateAndChange}}};
+    uint64_t records = 0;
+    uint64_t movements = 0;
+};
+
+// Итог повтора журнала
+struct ReplayResult {
+    bool ok = false;          // false — файл не открылся или запись повреждена
+    uint64_t records = 0;     // Записи команд
+    uint64_t executed = 0;
+    uint64_t failed = 0;      // Команды, бросившие исключение (как и при записи)
+    uint64_t skipped = 0;     // JournalOpaque
+    uint64_t movements = 0;   // Шаги движения мира
+    uint64_t removals = 0;    // Удаления кораблей
+    uint64_t lastTick = 0;
+    double seconds = 0;
+    uint64_t checksum = 0;    // WorldChecksum после повтора
+};
+
+// Повтор журнала: команды восстанавливаются и выполняются подряд с максимальной скоростью.
+// Повторы и логирование исключений уже есть в журнале как отдельные записи,
+// поэтому исключения при повторе только подсчитываются
+class JournalReplay {
+public:
+    ReplayResult Run(const std::string& path, World& world) {
+        ReplayResult result;
+        std::vector<uint8_t> data;
+        if (!ReadFile(path, data) || data.size() < sizeof(JournalMagic) ||
+            std::memcmp(data.data(), JournalMagic, sizeof(JournalMagic)) != 0) {
+            return result;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        const uint8_t* cursor = data.data() + sizeof(JournalMagic);
+        const uint8_t* end = data.data() + data.size();
+        result.ok = true;
+        while (cursor < end) {
+            uint64_t tick;
+            if (!ReadVarint(cursor, end, tick) || cursor == end) {
+                result.ok = false;
+                break;
+            }
+            result.lastTick = tick;
+            if (*cursor == JournalShips) {
+                ++cursor;
+                if (!ReadShips(cursor, end, world)) {
+                    result.ok = false;
+                    break;
+                }
+                continue;
+            }
+            if (*cursor == JournalMoveShips) {
+                ++cursor;
+                world.MoveShips();
+                ++result.movements;
+                continue;
+            }
+            if (*cursor == JournalRemoveShip) {
+                ++cursor;
+                EntityId ship;
+                if (!ReadShip(cursor, end, world, ship)) {
+                    result.ok = false;
+                    break;
+                }
+                world.RemoveShip(world.Handle(ship));
+                ++result.removals;
+                continue;
+            }
+
+            std::shared_ptr<Command> cmd;
+            if (!Decode(cursor, end, world, cmd)) {
+                result.ok = false;
+                break;
+            }
+            ++result.records;
+            if (!cmd) {
+                ++result.skipped;
+                continue;
+            }
+            try {
+                cmd->Execute();
+                ++result.executed;
+            } catch (const CommandFailures& errors) {
+                ++result.executed;  // Собранная запись выполнилась, ошибки — у вложенных команд
+                result.failed += errors.Failures().size();
+            } catch (const std::exception&) {
+                ++result.failed;
+            }
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.checksum = WorldChecksum(world);
+        return result;
+    }
+
+private:
+    // Повтор выполняет вложенную команду, только если ее выполнил исходный повтор
+    class ReplayGuardCommand : public Command {
+    private:
+        std::shared_ptr<Command> inner;
+        bool runs;
+
+    public:
+        ReplayGuardCommand(std::shared_ptr<Command> inner, bool runs) : inner(std::move(inner)), runs(runs) {}
+
+        // inner == nullptr — вложенная команда без кодировки, пропускается
+        void Execute() override {
+            if (!runs) {
+                throw std::runtime_error("Max retries reached");
+            }
+            if (inner) {
+                inner->Execute();
+            }
+        }
+
+        std::string GetName() const override {
+            return "ReplayGuardCommand";
+        }
+    };
+
+    static bool ReadFile(const std::string& path, std::vector<uint8_t>& data) {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file) {
+            return false;
+        }
+        uint8_t chunk[1 << 16];
+        size_t read;
+        while ((read = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+            data.insert(data.end(), chunk, chunk + read);
+        }
+        std::fclose(file);
+        return true;
+    }
+
+    static bool ReadShips(const uint8_t*& cursor, const uint8_t* end, World& world) {
+        uint64_t first;
+        uint64_t count;
+        if (!ReadVarint(cursor, end, first) || !ReadVarint(cursor, end, count) || first + count >= UINT32_MAX) {
+            return false;
+        }
+        for (uint64_t id = first; id < first + count; ++id) {
+            double values[6];
+            uint64_t directions;
+            uint64_t direction;
+            for (double& value : values) {
+                if (!ReadDouble(cursor, end, value)) {
+                    return false;
+                }
+            }
+            if (!ReadVarint(cursor, end, directions) || !ReadVarint(cursor, end, direction)) {
+                return false;
+            }
+            SpaceShip& ship = world.EnsureShip(static_cast<EntityId>(id));
+            ship.setPosition(Vector(values[0], values[1]));
+            ship.setVelocity(Vector(values[2], values[3]));
+            ship.setRotation(values[4]);
+            ship.setFuel(values[5]);
+            if (directions != 0) {
+                ship.setDirectionsNumber(static_cast<int>(directions));
+                ship.setDirection(static_cast<int>(direction));
+            }
+        }
+        return true;
+    }
+
+    static bool ReadShip(const uint8_t*& cursor, const uint8_t* end, World& world, EntityId& ship) {
+        uint64_t id;
+        if (!ReadVarint(cursor, end, id) || id >= UINT32_MAX || !world.IsAlive(static_cast<EntityId>(id))) {
+            return false;
+        }
+        ship = static_cast<EntityId>(id);
+        return true;
+    }
+
+    static bool ReadVector(const uint8_t*& cursor, const uint8_t* end, Vector& vector) {
+        return ReadDouble(cursor, end, vector.X) && ReadDouble(cursor, end, vector.Y);
+    }
+
+    // cmd == nullptr — команда без кодировки (JournalOpaque)
+    static bool Decode(const uint8_t*& cursor, const uint8_t* end, World& world, std::shared_ptr<Command>& cmd) {
+        if (cursor == end) {
+            return false;
+        }
+        uint8_t opcode = *cursor++;
+        EntityId ship;
+        double value;
+        Vector vector;
+        switch (opcode) {
+            case JournalMove:
+                if (!ReadShip(cursor, end, world, ship)) {
+                    return false;
+                }
+                cmd = std::make_shared<MoveShipCommand>(world.Ref(ship));
+                return true;
+            case JournalChangeVelocity:
+                if (!ReadShip(cursor, end, world, ship) || !ReadVector(cursor, end, vector)) {
+                    return false;
+                }
+                cmd = std::make_shared<ChangeVelocityCommand>(world.Ref(ship), vector);
+                return true;
+            case JournalBurnFuel:
+                if (!ReadShip(cursor, end, world, ship) || !ReadDouble(cursor, end, value)) {
+                    return false;
+                }
+                cmd = std::make_shared<BurnFuelCommand>(world.Ref(ship), value);
+                return true;
+            case JournalCheckFuel:
+                if (!ReadShip(cursor, end, world, ship) || !ReadDouble(cursor, end, value)) {
+                    return false;
+                }
+                cmd = std::make_shared<CheckFuelCommand>(world.Ref(ship), value);
+                return true;
+            case JournalMoveWithFuel:
+                if (!ReadShip(cursor, end, world, ship) || !ReadDouble(cursor, end, value)) {
+                    return false;
+                }
+                cmd = std::make_shared<MoveWithFuelCommand>(world.Ref(ship), value);
+                return true;
+            case JournalRotateAndChange: {
+                if (!ReadShip(cursor, end, world, ship) || cursor == end) {
+                    return false;
+                }
+                bool discrete = *cursor++ != 0;
+                uint64_t steps = 0;
+                if (discrete ? !ReadVarint(cursor, end, steps) : !ReadDouble(cursor, end, value)) {
+                    return false;
+                }
+                if (!ReadVector(cursor, end, vector)) {
+                    return false;
+                }
+                if (discrete) {
+                    cmd = std::make_shared<RotateAndChangeVelocity>(
+                        world.Ref(ship), DirectionSteps(static_cast<int>(UnZigZag(steps))), vector);
+                } else {
+                    cmd = std::make_shared<RotateAndChangeVelocity>(world.Ref(ship), value, vector);
+                }
+                return true;
+            }
+            case JournalMacro:
+            case JournalCoalesced: {
+                uint64_t count;
+                if (!ReadVarint(cursor, end, count)) {
+                    return false;
+                }
+                std::vector<std::shared_ptr<Command>> children;
+                for (uint64_t i = 0; i < count; ++i) {
+                    std::shared_ptr<Command> child;
+                    if (!Decode(cursor, end, world, child)) {
+                        return false;
+                    }
+                    children.push_back(child ? child : std::make_shared<ReplayGuardCommand>(nullptr, true));
+                }
+                if (opcode == JournalMacro) {
+                    cmd = std::make_shared<MacroCommand>(children);
+                } else {
+                    cmd = std::make_shared<CoalescedCommand>(children);  // Повторы ошибок уже в журнале
+                }
+                return true;
+            }
+            case JournalRetry:
+            case JournalRetryTwice: {
+                uint64_t retries;
+                uint64_t maxRetries = 2;
+                if (!ReadVarint(cursor, end, retries) ||
+                    (opcode == JournalRetry && !ReadVarint(cursor, end, maxRetries))) {
+                    return false;
+                }
+                std::shared_ptr<Command> inner;
+                if (!Decode(cursor, end, world, inner)) {
+                    return false;
+                }
+                cmd = std::make_shared<ReplayGuardCommand>(inner, retries < maxRetries);
+                return true;
+            }
+            case JournalCollision: {
+                Collision hit;
+                uint64_t first;
+                uint64_t second;
+                if (!ReadVarint(cursor, end, first) || !ReadVarint(cursor, end, second) || cursor == end) {
+                    return false;
+                }
+                hit.first = static_cast<EntityId>(first);
+                hit.second = static_cast<EntityId>(second);
+                hit.obstacle = *cursor++ != 0;
+                if (!ReadDouble(cursor, end, hit.time) || !ReadVector(cursor, end, hit.firstContact) ||
+                    !ReadVector(cursor, end, hit.secondContact)) {
+                    return false;
+                }
+                if (!world.IsAlive(hit.first) || (!hit.obstacle && !world.IsAlive(hit.second))) {
+                    return false;
+                }
+                cmd = std::make_shared<CollisionCommand>(world, hit);
+                return true;
+            }
+            case JournalOpaque: {
+                uint64_t length;
+                if (!ReadVarint(cursor, end, length) || static_cast<uint64_t>(end - cursor) < length) {
+                    return false;
+                }
+                cursor += length;
+                cmd = nullptr;
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+};
@@ -26,7 +26,32 @@ public:
         }
     }
 
+    const std::vector<std::shared_ptr<Command>>& GetCommands() const {
+        return commands;
+    }
+
     std::string GetName() const override {
         return "MacroCommand";
     }
+
+    // Макрокоманда независима, только если все ее команды относятся к одной сущности
+    const void* GetTarget() const override {
+        const void* target = commands.empty() ? nullptr : commands.front()->GetTarget();
+        for (const auto& cmd : commands) {
+            if (cmd->GetTarget() != target) {
+                return nullptr;
+            }
+        }
+        return target;
+    }
+
+    TargetKey GetTargetKey() const override {
+        TargetKey key = commands.empty() ? TargetKey{} : commands.front()->GetTargetKey();
+        for (const auto& cmd : commands) {
+            if (cmd->GetTargetKey() != key) {
+                return TargetKey{};
+            }
+        }
+        return key;
+    }
 };
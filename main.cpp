@@ -16,6 +16,7 @@
 #include "vector.h"
 #include "AutoGenerated_MovableAdapter.h"
 #include "safequeue.h"
+#include "gameLoop.h"
 
 // Проверяем результат теста
 void assertEquals(const Vector& a, const Vector& b, const std::string& testName) {
@@ -490,6 +491,24 @@ void startTest() {
     std::this_thread::sleep_for(std::chrono::seconds(2));
 }
 
+// Игровой цикл: 30 тиков в секунду вместо sleep_for
+void gameLoopTest() {
+    World world;
+    EntityId ship = world.AddShip(Vector(12, 5), 0.0);
+    CommandQueue queue;
+    queue.AddCommand(std::make_shared<ChangeVelocityCommand>(world.Ref(ship), Vector(-7, 3)));
+
+    GameLoop loop(std::chrono::nanoseconds(1000000000 / 30));
+    loop.AddWorld(LoopWorld{&world, &queue, nullptr, nullptr, [&](uint64_t tick) {
+        std::cout << "Tick " << tick << ": ship position " << world.Ship(ship).getPosition() << "\n";
+    }});
+    loop.Run(30);
+
+    GameLoopStats stats = loop.Stats();
+    std::cout << "Ticks: " << stats.ticks << ", overruns: " << stats.overruns
+              << ", p99 tick time: " << stats.tickNs.Percentile(99) << " ns\n";
+}
+
 int main(int argc, char **argv) {
 // Thread pool
 // -*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*
@@ -498,6 +517,7 @@ int main(int argc, char **argv) {
 //    hardStopTest();
 //    softStopTest();
 //    exceptionTest();
+//    gameLoopTest();
 
 // Адаптер и кодогенерация
 // -*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*
@@ -18,3 +18,18 @@ public:
     virtual Rotatable& setRotation(Rotation rotation) = 0;
     virtual ~Rotatable() = default;
 };
+
+// Дискретный поворот: направление — номер одного из getDirectionsNumber() положений по кругу
+struct DirectionSteps {
+    int value;
+
+    explicit DirectionSteps(int value) : value(value) {}
+};
+
+class DiscreteRotatable {
+public:
+    virtual int getDirection() const = 0;
+    virtual int getDirectionsNumber() const = 0;
+    virtual DiscreteRotatable& setDirection(int direction) = 0;
+    virtual ~DiscreteRotatable() = default;
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include "world.h"
+#include "movement.h"
+#include "exception_queue.h"
+
+// Шаг движения корабля мира. MoveCommand держит ссылку на Movable, а корабли World переезжают
+// при росте мира и удалении, поэтому команды, созданные по номеру корабля (журнал, кольцо команд),
+// разрешают корабль по хэндлу при выполнении
+class MoveShipCommand : public Command {
+private:
+    ShipRef ship;
+
+public:
+    explicit MoveShipCommand(ShipRef ship) : ship(ship) {}
+
+    void Execute() override {
+        Movement::Move(ship.Get());
+    }
+
+    std::string GetName() const override {
+        return "MoveShipCommand";
+    }
+
+    const void* GetTarget() const override {
+        return ship.TryGet();
+    }
+
+    TargetKey GetTargetKey() const override {
+        return ship.Key();
+    }
+};
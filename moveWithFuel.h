@@ -5,23 +5,57 @@
 
 class MoveWithFuelCommand : public Command {
 private:
-    SpaceShip& ship;
+    ShipRef ship;
     double fuelNeeded;
+    int64_t unitsNeeded;
 
 public:
-    MoveWithFuelCommand(SpaceShip& ship, double fuelNeeded) : ship(ship), fuelNeeded(fuelNeeded) {}
+    MoveWithFuelCommand(ShipRef ship, double fuelNeeded)
+        : ship(ship), fuelNeeded(fuelNeeded), unitsNeeded(SpaceShip::toFuelUnits(fuelNeeded)) {}
 
     void Execute() override {
-        CheckFuelCommand checkFuel(ship, fuelNeeded);
-        checkFuel.Execute();  // Проверка топлива
+        SpaceShip& target = ship.Get();  // Хэндл разрешается один раз на оба шага
 
-        BurnFuelCommand burnFuel(ship, fuelNeeded);
-        burnFuel.Execute();  // Сжигаем топливо
+        // Проверка и сжигание топлива одним CAS: между ними другой поток не потратит тот же запас
+        if (!target.tryBurnFuelUnits(unitsNeeded)) {
+            throw std::runtime_error("Not enough fuel to execute the command.");
+        }
 
-        Movement::Move(ship);  // Перемещение
+        Movement::Move(target);  // Перемещение
+    }
+
+    // Системный вариант: сущности с топливом, скоростью и положением сжигают fuelNeeded и делают шаг.
+    // Сущности без достаточного запаса остаются на месте и добавляются в lacking. Возвращает количество сдвинутых
+    static size_t MoveAll(ComponentRegistry& registry, double fuelNeeded, std::vector<EntityId>* lacking = nullptr) {
+        size_t moved = 0;
+        registry.Each<FuelComponent, VelocityComponent, PositionComponent>(
+            [&](EntityId id, FuelComponent& fuel, VelocityComponent& velocity, PositionComponent& position) {
+                if (fuel.amount < fuelNeeded) {
+                    if (lacking) {
+                        lacking->push_back(id);
+                    }
+                    return;
+                }
+                fuel.amount -= fuelNeeded;
+                position.value = position.value + velocity.value;
+                ++moved;
+            });
+        return moved;
+    }
+
+    double GetFuelNeeded() const {
+        return fuelNeeded;
     }
 
     std::string GetName() const override {
         return "MoveWithFuelCommand";
     }
+
+    const void* GetTarget() const override {
+        return ship.TryGet();
+    }
+
+    TargetKey GetTargetKey() const override {
+        return ship.Key();
+    }
 };
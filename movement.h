@@ -1,10 +1,58 @@
 #pragma once
+#include <concepts>
+#include <type_traits>
 #include "movable.h"
+#include "components.h"
+#include "exception_queue.h"
+
+// Конкретный (final) тип: компилятор вызывает его методы напрямую, без таблицы виртуальных функций
+template <typename T>
+concept ConcreteMovable = std::derived_from<T, Movable> && std::is_final_v<T>;
 
 class Movement {
 public:
+    // Общий путь через интерфейс: адаптеры, тестовые объекты
     static Movable& Move(Movable& movable) {
         movable.setPosition(movable.getPosition() + movable.getVelocity());
         return movable;
     }
+
+    // Путь для конкретного типа (SpaceShip): вызовы встраиваются до пары сложений
+    template <ConcreteMovable T>
+    static T& Move(T& movable) {
+        movable.setPosition(movable.getPosition() + movable.getVelocity());
+        return movable;
+    }
+
+    // Системный вариант: шаг движения всех сущностей с положением и скоростью.
+    // Обход идет по плотному массиву скоростей (у неподвижных объектов скорости нет)
+    static void MoveAll(ComponentRegistry& registry) {
+        registry.Each<VelocityComponent, PositionComponent>(
+            [](EntityId, VelocityComponent& velocity, PositionComponent& position) {
+                position.value = position.value + velocity.value;
+            });
+    }
+};
+
+// Команда перемещения; для равномерного движения ее регистрируют один раз
+// через CommandQueue::AddRepeating, а не создают заново каждый тик
+class MoveCommand : public Command {
+private:
+    Movable& movable;
+
+public:
+    explicit MoveCommand(Movable& movable) : movable(movable) {}
+
+    void Execute() override {
+        Movement::Move(movable);
+    }
+
+    std::string GetName() const override {
+        return "MoveCommand";
+    }
+
+    // Адрес всего объекта, а не подобъекта Movable: совпадает с целью других команд этого корабля
+    const void* GetTarget() const override {
+        return dynamic_cast<const void*>(&movable);
+    }
 };
@@ -0,0 +1,157 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "cpuAffinity.h"
+
+// Пул потоков для параллельных проходов внутри тика.
+// Run() раздает номера заданий через атомарный счетчик и возвращается, когда выполнены все.
+// Вызывающий поток тоже выполняет задания, поэтому пул на один поток работает последовательно.
+class ParallelExecutor {
+public:
+    // cpuSets[i] — процессоры потока i (например, CpuTopology::WorkerCpuSets). Поток 0 — вызывающий,
+    // его закрепляет сам владелец (PinCurrentThread); пустой список — без закрепления
+    explicit ParallelExecutor(size_t threads, std::vector<std::vector<int>> cpuSets = {})
+        : cpuSets(std::move(cpuSets)) {
+        pinned.assign(threads > 0 ? threads - 1 : 0, 0);
+        for (size_t i = 1; i < threads; ++i) {
+            workers.emplace_back(&ParallelExecutor::WorkerLoop, this, i);
+        }
+    }
+
+    ParallelExecutor(const ParallelExecutor&) = delete;
+    ParallelExecutor& operator=(const ParallelExecutor&) = delete;
+
+    ~ParallelExecutor() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        startCv.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    size_t Threads() const {
+        return workers.size() + 1;
+    }
+
+    // Выполнение job(0) ... job(jobs - 1); job должна сама ловить свои исключения
+    void Run(size_t jobs, const std::function<void(size_t)>& job) {
+        if (jobs == 0) {
+            return;
+        }
+        if (workers.empty() || jobs == 1) {
+            for (size_t i = 0; i < jobs; ++i) {
+                job(i);
+            }
+            return;
+        }
+
+        Dispatch(job, jobs, false);
+    }
+
+    // job(номер потока) ровно один раз в каждом потоке пула; 0 — вызывающий поток.
+    // Нужен для работы, привязанной к потоку: например, чтобы мир создавался потоком,
+    // закрепленным за его узлом NUMA (память достается узлу первого записавшего потока)
+    void RunPerThread(const std::function<void(size_t)>& job) {
+        if (workers.empty()) {
+            job(0);
+            return;
+        }
+        Dispatch(job, Threads(), true);
+    }
+
+    // Удалось ли закрепить поток пула (1 ... Threads() - 1) за его процессорами
+    bool IsPinned(size_t thread) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return thread > 0 && thread - 1 < pinned.size() && pinned[thread - 1];
+    }
+
+private:
+    void Dispatch(const std::function<void(size_t)>& job, size_t jobs, bool perThread) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            currentJob = &job;
+            jobCount = jobs;
+            perThreadJobs = perThread;
+            nextJob.store(0, std::memory_order_relaxed);
+            busyWorkers = workers.size();
+            ++generation;
+        }
+        startCv.notify_all();
+
+        if (perThread) {
+            job(0);
+        } else {
+            RunJobs(job, jobs);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        doneCv.wait(lock, [this] { return busyWorkers == 0; });
+        currentJob = nullptr;
+    }
+
+    void RunJobs(const std::function<void(size_t)>& job, size_t jobs) {
+        for (size_t i = nextJob.fetch_add(1, std::memory_order_relaxed); i < jobs;
+             i = nextJob.fetch_add(1, std::memory_order_relaxed)) {
+            job(i);
+        }
+    }
+
+    void WorkerLoop(size_t index) {
+        if (!cpuSets.empty()) {
+            bool ok = PinCurrentThread(cpuSets[index % cpuSets.size()]);
+            std::lock_guard<std::mutex> lock(mutex);
+            pinned[index - 1] = ok;
+        }
+        uint64_t seenGeneration = 0;
+        while (true) {
+            const std::function<void(size_t)>* job;
+            size_t jobs;
+            bool perThread;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                startCv.wait(lock, [&] { return stopping || generation != seenGeneration; });
+                if (stopping) {
+                    return;
+                }
+                seenGeneration = generation;
+                job = currentJob;
+                jobs = jobCount;
+                perThread = perThreadJobs;
+            }
+
+            if (perThread) {
+                (*job)(index);
+            } else {
+                RunJobs(*job, jobs);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busyWorkers == 0) {
+                doneCv.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::vector<std::vector<int>> cpuSets;
+    std::vector<char> pinned;
+    mutable std::mutex mutex;
+    std::condition_variable startCv;
+    std::condition_variable doneCv;
+    const std::function<void(size_t)>* currentJob = nullptr;
+    size_t jobCount = 0;
+    bool perThreadJobs = false;
+    std::atomic<size_t> nextJob{0};
+    size_t busyWorkers = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+};
@@ -1,100 +1,447 @@
-#include <iostream>
+#pragma once
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
 #include <fstream>
-#include <regex>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
-#include <filesystem>
-#include <sstream>
 
-// Функция для проверки, является ли класс абстрактным
-bool isAbstractClass(const std::string& content, std::string& className) {
-    std::regex classRegex(R"(class\s+(\w+)\s*\{\s*public\s*:\s*virtual)");
-    std::smatch match;
-    if (std::regex_search(content, match, classRegex)) {
-        className = match[1];
-        return true;
-    }
-    return false;
-}
-
-// Генерация методов адаптера с использованием IoC для разрешения зависимостей
-void generateAdapterMethods(const std::vector<std::string>& methods, std::ofstream& outputFile, const std::string& className, const std::string& targetClassName) {
-    for (const auto& method : methods) {
-        std::regex methodRegex(R"((\w+)\s+(\w+)\s*\(([^)]*)\))");
-        std::smatch match;
-        if (std::regex_match(method, match, methodRegex)) {
-            std::string returnType = match[1];
-            std::string methodName = match[2];
-            std::string args = match[3];
-
-            // Обработка для метода setPosition
-            if (methodName == "setPosition" && returnType == "void") {
-                outputFile << "\tMovable& " << methodName << "(const Vector& vector) override {\n";
-                outputFile << "\t\tioc->Resolve<void>(key + \"::" << methodName << "\", {object, const_cast<Vector*>(&vector)});\n";
-                outputFile << "\t\treturn *this;\n";
-                outputFile << "\t}\n";
+// Генератор адаптеров: для каждого абстрактного класса (хотя бы один чисто виртуальный метод)
+// создается AutoGenerated_<Класс>Adapter, который переадресует вызовы в IoC по ключам "<key>::<метод>".
+// Заголовки разбираются ручным токенизатором; адаптер перезаписывается, только если изменился
+// хэш его интерфейса, поэтому зависящие от него файлы не пересобираются зря.
+
+struct Token {
+    enum Kind {
+        Identifier,
+        Number,
+        Punct,
+        Literal,  // Строка или символ в кавычках
+    };
+
+    Kind kind;
+    std::string text;
+    int line;
+};
+
+class HeaderTokenizer {
+public:
+    // Комментарии и директивы препроцессора пропускаются
+    static std::vector<Token> Tokenize(const std::string& source) {
+        std::vector<Token> tokens;
+        int line = 1;
+        bool lineStart = true;
+        size_t pos = 0;
+        auto peek = [&](size_t offset) { return pos + offset < source.size() ? source[pos + offset] : '\0'; };
+        while (pos < source.size()) {
+            char c = source[pos];
+            if (c == '\n') {
+                ++line;
+                lineStart = true;
+                ++pos;
+                continue;
+            }
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                ++pos;
+                continue;
+            }
+            if (c == '#' && lineStart) {  // Директива, с учетом переноса строки через '\'
+                while (pos < source.size() && !(source[pos] == '\n' && source[pos - 1] != '\\')) {
+                    line += source[pos] == '\n';
+                    ++pos;
+                }
+                continue;
+            }
+            lineStart = false;
+            if (c == '/' && peek(1) == '/') {
+                while (pos < source.size() && source[pos] != '\n') {
+                    ++pos;
+                }
+                continue;
+            }
+            if (c == '/' && peek(1) == '*') {
+                size_t end = source.find("*/", pos + 2);
+                end = end == std::string::npos ? source.size() : end + 2;
+                for (size_t i = pos; i < end; ++i) {
+                    line += source[i] == '\n';
+                }
+                pos = end;
+                continue;
+            }
+            size_t start = pos;
+            if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+                while (pos < source.size() && (std::isalnum(static_cast<unsigned char>(source[pos])) || source[pos] == '_')) {
+                    ++pos;
+                }
+                tokens.push_back(Token{Token::Identifier, source.substr(start, pos - start), line});
+            } else if (std::isdigit(static_cast<unsigned char>(c))) {
+                while (pos < source.size() && (std::isalnum(static_cast<unsigned char>(source[pos])) || source[pos] == '.' ||
+                                               source[pos] == '\'')) {
+                    ++pos;
+                }
+                tokens.push_back(Token{Token::Number, source.substr(start, pos - start), line});
+            } else if (c == '"' || c == '\'') {
+                ++pos;
+                while (pos < source.size() && source[pos] != c) {
+                    pos += source[pos] == '\\' ? 2 : 1;
+                }
+                pos = std::min(pos + 1, source.size());
+                tokens.push_back(Token{Token::Literal, source.substr(start, pos - start), line});
+            } else if ((c == ':' && peek(1) == ':') || (c == '-' && peek(1) == '>') || (c == '&' && peek(1) == '&')) {
+                pos += 2;
+                tokens.push_back(Token{Token::Punct, source.substr(start, 2), line});
             } else {
-                // Генерация других методов
-                outputFile << "\t" << returnType << " " << methodName << "() const override {\n";
-                outputFile << "\t\treturn *ioc->Resolve<" << returnType << ">(key + \"::" << methodName << "\", {object});\n";
-                outputFile << "\t}\n";
+                ++pos;
+                tokens.push_back(Token{Token::Punct, std::string(1, c), line});
             }
         }
+        return tokens;
     }
-}
+};
 
-// Генерация адаптера для абстрактного класса
-void generateAdapter(const std::string& className, const std::vector<std::string>& methods, std::ofstream& outputFile, const std::string& targetClassName) {
-    outputFile << "#pragma once\n";
-    outputFile << "#include \"" << className << ".h\"\n";
-    outputFile << "#include \"ioc.h\"\n";
-    outputFile << "#include <string>\n";
-    outputFile << "#include \"" << targetClassName << ".h\"\n\n";
+struct InterfaceParam {
+    std::string type;
+    std::string name;
+};
 
-    outputFile << "class AutoGenerated_" << className << "Adapter : public " << className << " {\n";
-    outputFile << "public:\n";
-    outputFile << "\tAutoGenerated_" << className << "Adapter(IoC* ioc, const std::string& key, " << targetClassName << "* object)\n";
-    outputFile << "\t\t: ioc(ioc), key(key), object(object) {}\n\n";
+struct InterfaceMethod {
+    std::string returnType;
+    std::string name;
+    std::vector<InterfaceParam> params;
+    bool isConst = false;
+};
 
-    // Генерация методов адаптера
-    generateAdapterMethods(methods, outputFile, className, targetClassName);
+struct InterfaceInfo {
+    std::string name;
+    std::vector<InterfaceMethod> methods;  // Только чисто виртуальные
+};
 
-    outputFile << "private:\n";
-    outputFile << "\tIoC* ioc;\n";
-    outputFile << "\tstd::string key;\n";
-    outputFile << "\t" << targetClassName << "* object; // Указатель на объект целевого класса\n";
-    outputFile << "};\n\n";
-}
+// Поиск абстрактных классов в токенах заголовка
+class InterfaceParser {
+public:
+    static std::vector<InterfaceInfo> Parse(const std::vector<Token>& tokens) {
+        std::vector<InterfaceInfo> interfaces;
+        for (size_t i = 0; i + 1 < tokens.size(); ++i) {
+            if (!IsWord(tokens[i], "class") && !IsWord(tokens[i], "struct")) {
+                continue;
+            }
+            if (tokens[i + 1].kind != Token::Identifier) {
+                continue;
+            }
+            // Определение класса: имя, необязательные final и базы, затем тело
+            size_t body = i + 2;
+            while (body < tokens.size() && !IsPunct(tokens[body], "{") && !IsPunct(tokens[body], ";")) {
+                ++body;
+            }
+            if (body >= tokens.size() || IsPunct(tokens[body], ";")) {
+                continue;  // Объявление без тела
+            }
+            InterfaceInfo info{tokens[i + 1].text, {}};
+            bool isPublic = IsWord(tokens[i], "struct");
+            size_t end = ParseBody(tokens, body + 1, info, isPublic);
+            if (!info.methods.empty()) {
+                interfaces.push_back(std::move(info));
+            }
+            i = end;
+        }
+        return interfaces;
+    }
 
-// Препроцессор для поиска абстрактных классов и генерации адаптеров
-void preprocess(const std::string& headerFilePath, const std::string& outputFilePath, const std::string& targetClassName) {
-    std::ifstream headerFile(headerFilePath);
-    std::ofstream outputFile(outputFilePath, std::ios::app); // Открытие файла для добавления
+    // Текст типа из токенов: "const Vector&", "std::vector<int>"
+    static std::string Join(const std::vector<Token>& tokens, size_t begin, size_t end) {
+        std::string text;
+        for (size_t i = begin; i < end; ++i) {
+            const std::string& part = tokens[i].text;
+            bool glue = text.empty() || part == "&" || part == "*" || part == "&&" || part == "::" || part == ">" ||
+                        part == "," || part == "<" || text.back() == '<' || text.back() == ':';
+            if (!glue) {
+                text += ' ';
+            }
+            text += part;
+        }
+        return text;
+    }
 
-    if (!headerFile.is_open()) {
-        std::cerr << "Ошибка при открытии файла: " << headerFilePath << std::endl;
-        return;
+private:
+    static bool IsWord(const Token& token, const char* word) {
+        return token.kind == Token::Identifier && token.text == word;
     }
 
-    if (!outputFile.is_open()) {
-        std::cerr << "Ошибка при открытии файла на запись: " << outputFilePath << std::endl;
-        return;
+    static bool IsPunct(const Token& token, const char* punct) {
+        return token.kind == Token::Punct && token.text == punct;
     }
 
-    std::string content((std::istreambuf_iterator<char>(headerFile)), std::istreambuf_iterator<char>());
-    std::string className;
+    static size_t SkipBalanced(const std::vector<Token>& tokens, size_t open) {
+        const std::string& opening = tokens[open].text;
+        std::string closing = opening == "{" ? "}" : opening == "(" ? ")" : "]";
+        int depth = 0;
+        for (size_t i = open; i < tokens.size(); ++i) {
+            if (tokens[i].kind != Token::Punct) {
+                continue;
+            }
+            if (tokens[i].text == opening) {
+                ++depth;
+            } else if (tokens[i].text == closing && --depth == 0) {
+                return i;
+            }
+        }
+        return tokens.size();
+    }
 
-    std::vector<std::string> methods = {
-        "Vector getPosition()",
-        "void setPosition(Vector newValue)",
-        "Vector getVelocity()",
-    };
+    // Члены класса до закрывающей скобки; возвращает ее индекс
+    static size_t ParseBody(const std::vector<Token>& tokens, size_t pos, InterfaceInfo& info, bool isPublic) {
+        size_t start = pos;
+        while (pos < tokens.size()) {
+            const Token& token = tokens[pos];
+            if (IsPunct(token, "}")) {
+                return pos;
+            }
+            if (pos == start && pos + 1 < tokens.size() && IsPunct(tokens[pos + 1], ":") &&
+                (IsWord(token, "public") || IsWord(token, "protected") || IsWord(token, "private"))) {
+                isPublic = token.text == "public";
+                start = pos = pos + 2;
+                continue;
+            }
+            if (IsPunct(token, "{")) {  // Тело метода или вложенного класса: член закончен
+                pos = SkipBalanced(tokens, pos) + 1;
+                if (pos < tokens.size() && IsPunct(tokens[pos], ";")) {
+                    ++pos;
+                }
+                start = pos;
+                continue;
+            }
+            if (IsPunct(token, "(")) {
+                pos = SkipBalanced(tokens, pos) + 1;
+                continue;
+            }
+            if (IsPunct(token, ";")) {
+                if (isPublic) {
+                    ParseMember(tokens, start, pos, info);
+                }
+                start = ++pos;
+                continue;
+            }
+            ++pos;
+        }
+        return pos;
+    }
+
+    // virtual <тип> <имя>(<параметры>) [const] [noexcept] = 0
+    static void ParseMember(const std::vector<Token>& tokens, size_t begin, size_t end, InterfaceInfo& info) {
+        if (end - begin < 6 || !IsWord(tokens[begin], "virtual") || !IsPunct(tokens[end - 2], "=") ||
+            tokens[end - 1].text != "0") {
+            return;
+        }
+        size_t open = begin + 1;
+        while (open < end && !IsPunct(tokens[open], "(")) {
+            ++open;
+        }
+        if (open >= end || open < begin + 2 || IsPunct(tokens[open - 1], "~")) {
+            return;  // Деструктор или не метод
+        }
+        size_t close = SkipBalanced(tokens, open);
+        InterfaceMethod method;
+        method.name = tokens[open - 1].text;
+        method.returnType = Join(tokens, begin + 1, open - 1);
+        for (size_t i = close + 1; i < end - 2; ++i) {
+            method.isConst = method.isConst || IsWord(tokens[i], "const");
+        }
+        size_t paramStart = open + 1;
+        int depth = 0;
+        for (size_t i = open + 1; i <= close; ++i) {
+            const std::string& text = tokens[i].text;
+            depth += text == "<" || text == "(" ? 1 : text == ">" || text == ")" ? -1 : 0;
+            if ((i == close || (depth == 0 && text == ",")) && i > paramStart) {
+                AddParam(tokens, paramStart, i, method);
+                paramStart = i + 1;
+            }
+        }
+        if (method.params.size() == 1 && method.params[0].type == "void") {
+            method.params.clear();
+        }
+        info.methods.push_back(std::move(method));
+    }
+
+    // Последний идентификатор — имя параметра, если перед ним есть тип; иначе имя придумывается
+    static void AddParam(const std::vector<Token>& tokens, size_t begin, size_t end, InterfaceMethod& method) {
+        size_t typeEnd = end;
+        for (size_t i = begin; i < end; ++i) {
+            if (IsPunct(tokens[i], "=")) {
+                typeEnd = i;  // Значение по умолчанию
+                break;
+            }
+        }
+        InterfaceParam param;
+        bool named = typeEnd - begin >= 2 && tokens[typeEnd - 1].kind == Token::Identifier &&
+                     !IsPunct(tokens[typeEnd - 2], "::");
+        if (named) {
+            param.type = Join(tokens, begin, typeEnd - 1);
+            param.name = tokens[typeEnd - 1].text;
+        } else {
+            param.type = Join(tokens, begin, typeEnd);
+            param.name = "arg" + std::to_string(method.params.size());
+        }
+        method.params.push_back(std::move(param));
+    }
+};
+
+struct AdapterOptions {
+    std::string outputDir;
+    std::string targetClass;   // Класс объекта, которому адаптер передает вызовы через IoC
+    std::string targetHeader;  // Заголовок этого класса
+};
+
+struct GeneratorResult {
+    size_t interfaces = 0;
+    size_t written = 0;     // Адаптеры, созданные или измененные
+    size_t unchanged = 0;   // Текст адаптера совпал с файлом: файл не тронут
+    std::vector<std::string> errors;
+};
+
+class AdapterGenerator {
+public:
+    static constexpr uint64_t FormatVersion = 1;  // Меняется вместе с форматом генерируемого кода
 
-    if (isAbstractClass(content, className)) {
-        std::cout << "Найден абстрактный класс: " << className << "\n";
-        generateAdapter(className, methods, outputFile, targetClassName);
+    static std::string FileName(const std::string& interfaceName) {
+        return "AutoGenerated_" + interfaceName + "Adapter.h";
+    }
+
+    // Хэш всего, от чего зависит текст адаптера (FNV-1a)
+    static uint64_t Hash(const InterfaceInfo& info, const std::string& sourceHeader, const AdapterOptions& options) {
+        std::string signature = std::to_string(FormatVersion) + "|" + sourceHeader + "|" + options.targetClass + "|" +
+                                options.targetHeader + "|" + info.name;
+        for (const auto& method : info.methods) {
+            signature += "|" + method.returnType + " " + method.name + "(";
+            for (const auto& param : method.params) {
+                signature += param.type + " " + param.name + ",";
+            }
+            signature += method.isConst ? ") const" : ")";
+        }
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (unsigned char c : signature) {
+            hash = (hash ^ c) * 0x100000001b3ull;
+        }
+        return hash;
     }
 
-    headerFile.close();
-    outputFile.close();
-}
+    static std::string HashLine(uint64_t hash) {
+        char text[40];
+        std::snprintf(text, sizeof(text), "// source-hash: %016llx", static_cast<unsigned long long>(hash));
+        return text;
+    }
+
+    static std::string Generate(const InterfaceInfo& info, const std::string& sourceHeader, const AdapterOptions& options) {
+        std::string adapter = "AutoGenerated_" + info.name + "Adapter";
+        std::ostringstream out;
+        out << HashLine(Hash(info, sourceHeader, options)) << "\n";
+        out << "// Сгенерировано adapterGenerator из " << sourceHeader << ", не редактировать\n";
+        out << "#pragma once\n";
+        out << "#include <memory>\n";
+        out << "#include <string>\n";
+        out << "#include \"" << sourceHeader << "\"\n";
+        out << "#include \"ioc.h\"\n";
+        out << "#include \"" << options.targetHeader << "\"\n\n";
+        out << "class " << adapter << " : public " << info.name << " {\n";
+        out << "public:\n";
+        out << "    " << adapter << "(IoC* ioc, const std::string& key, " << options.targetClass << "* object)\n";
+        out << "        : ioc(ioc), key(key), object(object) {}\n";
+        for (const auto& method : info.methods) {
+            out << "\n    " << method.returnType << " " << method.name << "(";
+            std::string args = "{object";
+            for (size_t i = 0; i < method.params.size(); ++i) {
+                const InterfaceParam& param = method.params[i];
+                out << (i ? ", " : "") << param.type << " " << param.name;
+                args += ", const_cast<void*>(static_cast<const void*>(&" + param.name + "))";
+            }
+            args += "}";
+            out << ")" << (method.isConst ? " const" : "") << " override {\n";
+            std::string call = "ioc->Resolve<";
+            std::string key = "key + \"::" + method.name + "\", " + args;
+            if (method.returnType == "void") {
+                out << "        " << call << "void>(" << key << ");\n";
+            } else if (method.returnType == info.name + "&") {
+                out << "        " << call << "void>(" << key << ");\n";
+                out << "        return *this;\n";
+            } else if (method.returnType.find('&') != std::string::npos || method.returnType.find('*') != std::string::npos) {
+                throw std::invalid_argument(info.name + "::" + method.name + ": only value and self-reference returns are supported");
+            } else {
+                // Фабрика в IoC возвращает новый объект: адаптер забирает владение
+                out << "        std::unique_ptr<" << method.returnType << "> result(" << call << method.returnType << ">("
+                    << key << "));\n";
+                out << "        return *result;\n";
+            }
+            out << "    }\n";
+        }
+        out << "\nprivate:\n";
+        out << "    IoC* ioc;\n";
+        out << "    std::string key;\n";
+        out << "    " << options.targetClass << "* object;\n";
+        out << "};\n";
+        return out.str();
+    }
+
+    // Адаптеры всех интерфейсов одного заголовка
+    static GeneratorResult ProcessHeader(const std::string& headerPath, const AdapterOptions& options) {
+        GeneratorResult result;
+        std::ifstream headerFile(headerPath);
+        if (!headerFile.is_open()) {
+            result.errors.push_back("Cannot open header: " + headerPath);
+            return result;
+        }
+        std::string content((std::istreambuf_iterator<char>(headerFile)), std::istreambuf_iterator<char>());
+        std::string sourceHeader = std::filesystem::path(headerPath).filename().string();
+        for (const auto& info : InterfaceParser::Parse(HeaderTokenizer::Tokenize(content))) {
+            ++result.interfaces;
+            try {
+                std::filesystem::path path = std::filesystem::path(options.outputDir) / FileName(info.name);
+                std::string text = Generate(info, sourceHeader, options);
+                if (ReadFile(path) == text) {  // Целиком: исправленный вручную адаптер с тем же хэшем перезаписывается
+                    ++result.unchanged;
+                    continue;
+                }
+                std::ofstream out(path, std::ios::trunc);
+                out << text;
+                if (!out) {
+                    result.errors.push_back("Cannot write adapter: " + path.string());
+                    continue;
+                }
+                ++result.written;
+            } catch (const std::exception& ex) {
+                result.errors.push_back(headerPath + ": " + ex.what());
+            }
+        }
+        return result;
+    }
+
+    // Заголовки разбираются параллельно, по потоку на заголовок
+    static GeneratorResult Run(const std::vector<std::string>& headers, const AdapterOptions& options) {
+        std::filesystem::create_directories(options.outputDir);
+        std::vector<GeneratorResult> results(headers.size());
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < headers.size(); ++i) {
+            workers.emplace_back([&, i] { results[i] = ProcessHeader(headers[i], options); });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        GeneratorResult total;
+        for (auto& result : results) {
+            total.interfaces += result.interfaces;
+            total.written += result.written;
+            total.unchanged += result.unchanged;
+            total.errors.insert(total.errors.end(), result.errors.begin(), result.errors.end());
+        }
+        return total;
+    }
+
+private:
+    static std::string ReadFile(const std::filesystem::path& path) {
+        std::ifstream file(path);
+        return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+};
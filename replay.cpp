@@ -0,0 +1,36 @@
+#include <cstdio>
+#include <iostream>
+#include "journal.h"
+
+// Повтор журнала команд: ./replay <журнал>
+// Выводит скорость выполнения и контрольную сумму итогового состояния мира
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <journal>" << std::endl;
+        return 2;
+    }
+
+    World world;
+    JournalReplay replay;
+    ReplayResult result = replay.Run(argv[1], world);
+    if (!result.ok) {
+        std::cerr << "Journal is missing or corrupted: " << argv[1] << " (replayed " << result.records
+                  << " records)" << std::endl;
+        return 1;
+    }
+
+    char checksum[17];
+    std::snprintf(checksum, sizeof(checksum), "%016llx", static_cast<unsigned long long>(result.checksum));
+    std::cout << "Ships:      " << world.Size() << "\n";
+    std::cout << "Ticks:      " << result.lastTick << "\n";
+    std::cout << "Records:    " << result.records << " (executed " << result.executed << ", failed "
+              << result.failed << ", skipped " << result.skipped << ")\n";
+    std::cout << "Movements:  " << result.movements << "\n";
+    std::cout << "Removals:   " << result.removals << "\n";
+    std::cout << "Time:       " << result.seconds << " s\n";
+    if (result.seconds > 0) {
+        std::cout << "Throughput: " << result.records / result.seconds << " commands/s\n";
+    }
+    std::cout << "Checksum:   " << checksum << std::endl;
+    return 0;
+}
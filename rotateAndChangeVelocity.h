@@ -1,19 +1,47 @@
 #pragma once
 #include <cmath>
-#include "spaceship.h"
+#include "world.h"
 #include "exception_queue.h"
+#include "rotation.h"
+#include "components.h"
 
 class RotateAndChangeVelocity : public Command {
 private:
-    SpaceShip& ship;
+    ShipRef target;
     Rotation angle;
     Vector newVelocity;
+    bool discrete = false;  // Поворот на steps направлений вместо angle градусов
+    DirectionSteps steps{0};
 
 public:
-    RotateAndChangeVelocity(SpaceShip& ship, Rotation angle, const Vector& velocity)
-            : ship(ship), angle(angle), newVelocity(velocity) {}
+    RotateAndChangeVelocity(ShipRef ship, Rotation angle, const Vector& velocity)
+            : target(ship), angle(angle), newVelocity(velocity) {}
+
+    // Дискретный поворот: корабль должен быть в режиме направлений (setDirectionsNumber)
+    RotateAndChangeVelocity(ShipRef ship, DirectionSteps steps, const Vector& velocity)
+            : target(ship), angle(0), newVelocity(velocity), discrete(true), steps(steps) {}
 
     void Execute() override {
+        SpaceShip& ship = target.Get();
+        if (discrete) {
+            RotationHandler::Rotate(ship, steps);
+            if (ship.getVelocity() != Vector(0, 0)) {
+                ship.setVelocity(RotationHandler::RotateVector(ship.getVelocity(), steps, ship.getDirectionsNumber()));
+            }
+            return;
+        }
+
+        int directions = ship.getDirectionsNumber();
+        if (directions != 0) {
+            // Дискретный режим: угол округляется до направления, скорость поворачивается на те же шаги по таблице
+            DirectionSteps turn = DiscreteSteps(ship.getRotation(), ship.getDirection(), angle, directions);
+            RotationHandler::Rotate(ship, turn);
+            if (ship.getVelocity() != Vector(0, 0)) {
+                ship.setVelocity(RotationHandler::RotateVector(ship.getVelocity(), turn, directions));
+            }
+            return;
+        }
+
         // Поворот корабля
         ship.setRotation(ship.getRotation() + angle);
 
@@ -28,13 +56,86 @@ public:
         }
     }
 
+    // Системный вариант: поворот всех сущностей на angle градусов. Сущности в дискретном режиме
+    // округляются до ближайшего направления, как SpaceShip::setRotation, и их скорость поворачивается
+    // по таблице на те же шаги. Ненулевая скорость поворачивается
+    static void RotateAll(ComponentRegistry& registry, Rotation angle) {
+        SparseSet<VelocityComponent>& velocities = registry.Storage<VelocityComponent>();
+        registry.Each<RotationComponent>([&](EntityId id, RotationComponent& rotation) {
+            int directions = rotation.directionsNumber;
+            DirectionSteps turn{0};
+            if (directions != 0) {
+                turn = DiscreteSteps(rotation.angle, rotation.direction, angle, directions);
+                rotation.direction = DirectionTables::Normalize(rotation.direction + turn.value, directions);
+                rotation.angle = rotation.direction * 360.0 / directions;
+            } else {
+                rotation.angle = rotation.angle + angle;
+            }
+            if (velocities.Has(id)) {
+                Vector& velocity = velocities.At(id).value;
+                if (velocity != Vector(0, 0)) {
+                    velocity = directions != 0 ? RotationHandler::RotateVector(velocity, turn, directions)
+                                               : RotateVector(velocity, angle);
+                }
+            }
+        });
+    }
+
+    // Системный вариант дискретного поворота; сущности с непрерывным поворотом пропускаются
+    static void RotateAll(ComponentRegistry& registry, DirectionSteps steps) {
+        SparseSet<VelocityComponent>& velocities = registry.Storage<VelocityComponent>();
+        registry.Each<RotationComponent>([&](EntityId id, RotationComponent& rotation) {
+            int directions = rotation.directionsNumber;
+            if (directions == 0) {
+                return;
+            }
+            rotation.direction = DirectionTables::Normalize(rotation.direction + steps.value, directions);
+            rotation.angle = rotation.direction * 360.0 / directions;
+            if (velocities.Has(id)) {
+                Vector& velocity = velocities.At(id).value;
+                if (velocity != Vector(0, 0)) {
+                    velocity = RotationHandler::RotateVector(velocity, steps, directions);
+                }
+            }
+        });
+    }
+
+    Rotation GetAngle() const {
+        return angle;
+    }
+
+    const Vector& GetVelocity() const {
+        return newVelocity;
+    }
+
+    bool IsDiscrete() const {
+        return discrete;
+    }
+
+    DirectionSteps GetSteps() const {
+        return steps;
+    }
+
     std::string GetName() const override {
         return "RotateAndChangeVelocity";
     }
 
-private:
+    const void* GetTarget() const override {
+        return target.TryGet();
+    }
+
+    TargetKey GetTargetKey() const override {
+        return target.Key();
+    }
+
+    // Поворот на angle градусов в дискретном режиме: на сколько шагов сменится направление
+    // после округления угла до ближайшего направления (как SpaceShip::setRotation)
+    static DirectionSteps DiscreteSteps(Rotation heading, int direction, Rotation angle, int directions) {
+        return DirectionSteps(static_cast<int>(std::lround((heading + angle) * directions / 360.0)) - direction);
+    }
+
     // Простой расчет скорости на основе угла поворота
-    Vector RotateVector(const Vector& velocity, Rotation angle) {
+    static Vector RotateVector(const Vector& velocity, Rotation angle) {
         double radians = angle * M_PI / 180.0;
         double newX = velocity.X * cos(radians) - velocity.Y * sin(radians);
         double newY = velocity.X * sin(radians) + velocity.Y * cos(radians);
@@ -1,5 +1,15 @@
 #pragma once
+#include <concepts>
+#include <type_traits>
 #include "movable.h"
+#include "directionTable.h"
+
+// Конкретные (final) типы, для которых повороты вызываются без виртуальных вызовов
+template <typename T>
+concept ConcreteRotatable = std::derived_from<T, Rotatable> && std::is_final_v<T>;
+
+template <typename T>
+concept ConcreteDiscreteRotatable = std::derived_from<T, DiscreteRotatable> && std::is_final_v<T>;
 
 class RotationHandler {
 public:
@@ -7,4 +17,29 @@ public:
         rotatable.setRotation(rotatable.getRotation() + angle);
         return rotatable;
     }
+
+    template <ConcreteRotatable T>
+    static T& Rotate(T& rotatable, Rotation angle) {
+        rotatable.setRotation(rotatable.getRotation() + angle);
+        return rotatable;
+    }
+
+    // Дискретный поворот на steps направлений
+    static DiscreteRotatable& Rotate(DiscreteRotatable& rotatable, DirectionSteps steps) {
+        rotatable.setDirection(rotatable.getDirection() + steps.value);
+        return rotatable;
+    }
+
+    template <ConcreteDiscreteRotatable T>
+    static T& Rotate(T& rotatable, DirectionSteps steps) {
+        rotatable.setDirection(rotatable.getDirection() + steps.value);
+        return rotatable;
+    }
+
+    // Поворот вектора (например, скорости) на steps направлений по таблице: результат
+    // побитово совпадает на всех платформах, если компилятор не сливает умножение и
+    // сложение в FMA (сборка с -ffp-contract=off)
+    static Vector RotateVector(const Vector& vector, DirectionSteps steps, int directions) {
+        return DirectionTables::Rotate(vector, steps.value, directions);
+    }
 };
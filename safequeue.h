@@ -1,37 +1,145 @@
 #ifndef SAFEQUEUE_H
 #define SAFEQUEUE_H
 
-#include <queue>
+#include <algorithm>
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 #include <condition_variable>
 #include <functional>
 #include <atomic>
 #include <iostream>
+#include "commandStats.h"
+#include "tracing.h"
+#include "coroutineScheduler.h"
+#include "exception_queue.h"
+#include "cpuAffinity.h"
+
+// Полосы приоритета: задачи High (управление тиком, срочные команды) выполняются раньше всех Normal
+enum class TaskPriority {
+    High,
+    Normal,
+};
+
+// Поведение addTask при заполненной очереди
+enum class OverflowPolicy {
+    Block,       // Производитель ждет свободного места
+    Reject,      // Задача не добавляется, addTask возвращает false
+    DropOldest,  // Вытесняется самая старая задача Normal; если очередь занята задачами High — как Reject
+};
+
+// Ожидание рабочего потока при пустой очереди
+enum class WaitStrategy {
+    Park,          // Сразу засыпает на condition_variable
+    SpinThenPark,  // Крутится, затем уступает процессор, затем засыпает; длина кручения подстраивается
+};
 
 class SafeQueue {
 private:
-    std::queue<std::function<void()>> tasks;
-    std::mutex queueMutex;
+    // Задача очереди: функция (addTask) или команда (addCommand). Команда хранится сама по себе,
+    // чтобы статистика и трасса шли по ее типу и имени, а запись в журнал не попадала в замер
+    struct QueuedTask {
+        std::function<void()> run;
+        std::shared_ptr<Command> cmd;
+    };
+
+    std::deque<QueuedTask> highTasks;
+    std::deque<QueuedTask> tasks;
+    mutable std::mutex queueMutex;
     std::condition_variable cv;
+    std::condition_variable notFull;  // Для производителей в режиме Block
     std::atomic<bool> hardStopFlag{false};
     std::atomic<bool> softStopFlag{false};
+    std::atomic<bool> destroying{false};
     std::thread workerThread;
+    CommandScheduler scheduler;  // Долгие команды-корутины
+    std::atomic<CommandRecorder*> recorder{nullptr};
+
+    size_t capacityLimit;  // 0 — без ограничения
+    OverflowPolicy overflowPolicy;
+    std::atomic<uint64_t> rejectedTasks{0};
+    std::atomic<uint64_t> droppedTasks{0};
+
+    // Ожидание: задачи видны без блокировки через queued, будить нужно только уснувший поток
+    static constexpr uint32_t MinSpins = 64;
+    static constexpr uint32_t MaxSpins = 1 << 14;
+    static constexpr uint32_t YieldIterations = 16;
+    WaitStrategy waitStrategy = WaitStrategy::Park;
+    std::vector<int> workerCpus;  // Пусто — без закрепления
+    std::atomic<size_t> queued{0};
+    bool workerParked = false;  // Под queueMutex
+    uint32_t spinBudget = 1024;
+
+    size_t size() const {
+        return highTasks.size() + tasks.size();
+    }
+
+    bool stopRequested() const {
+        return hardStopFlag.load(std::memory_order_acquire) || softStopFlag.load(std::memory_order_acquire) ||
+               destroying.load(std::memory_order_acquire);
+    }
+
+    static void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
 
 public:
-    SafeQueue() = default;
+    // capacity — общий предел задач в очереди (0 — без ограничения).
+    // Задачи High принимаются всегда, даже сверх предела: управление не должно ждать за потоком задач
+    explicit SafeQueue(size_t capacity = 0, OverflowPolicy policy = OverflowPolicy::Block)
+        : capacityLimit(capacity), overflowPolicy(policy) {}
 
+    // Поток завершается, выполнив оставшиеся задачи (если не было жесткой остановки)
     ~SafeQueue() {
-        //        hardStopFlag = true;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            destroying = true;
+        }
         cv.notify_all();
-        workerThread.join();
+        notFull.notify_all();
+        if (workerThread.joinable()) {
+            workerThread.join();
+        }
     }
 
-    // Метод добавления задачи
-    void addTask(std::function<void()> task) {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        tasks.emplace(task);
-        cv.notify_all();  // Уведомляем поток о новой задаче
+    // Метод добавления задачи. false — задача отклонена (OverflowPolicy::Reject или очередь остановлена)
+    bool addTask(std::function<void()> task, TaskPriority priority = TaskPriority::Normal) {
+        return enqueue(QueuedTask{std::move(task), nullptr}, priority);
+    }
+
+    // Задача-команда: попадает в журнал (setRecorder) перед выполнением в рабочем потоке
+    bool addCommand(std::shared_ptr<Command> cmd, TaskPriority priority = TaskPriority::Normal) {
+        return enqueue(QueuedTask{nullptr, std::move(cmd)}, priority);
+    }
+
+    // Журнал команд, добавленных через addCommand; вызывается из рабочего потока
+    void setRecorder(CommandRecorder* commandRecorder) {
+        recorder.store(commandRecorder, std::memory_order_release);
+    }
+
+    // Запуск долгой команды-корутины (из любого потока)
+    void spawn(Behavior behavior) {
+        scheduler.Spawn(std::move(behavior));
+    }
+
+    // Задача одного тика: возобновляет в рабочем потоке все корутины, которым пора.
+    // Идет в полосе High, чтобы тик не ждал за накопившимися задачами
+    void tick() {
+        addTask([this]() { scheduler.Tick(); }, TaskPriority::High);
+    }
+
+    // Способ ожидания задач; задается до start()
+    void setWaitStrategy(WaitStrategy strategy) {
+        waitStrategy = strategy;
+    }
+
+    // Процессоры рабочего потока (Linux affinity); задается до start()
+    void setAffinity(std::vector<int> cpus) {
+        workerCpus = std::move(cpus);
     }
 
     // Старт работы в новом потоке
@@ -39,59 +147,192 @@ public:
         workerThread = std::thread(&SafeQueue::processTasks, this);
     }
 
-    // Метод для жесткой остановки
+    // Метод для жесткой остановки: поток завершается после текущей задачи, остальные отбрасываются
     void hardStop() {
-        hardStopFlag = true;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            hardStopFlag = true;
+        }
         cv.notify_all();
+        notFull.notify_all();
     }
 
     // Метод для мягкой остановки
     void softStop() {
         std::cerr << "Soft stop initiated. Exiting after completing all tasks.\n";
-        softStopFlag = true;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            softStopFlag = true;
+        }
         cv.notify_all();
     }
 
+    // Глубина очереди: всего и по полосам
+    size_t depth() const {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        return size();
+    }
+
+    size_t depth(TaskPriority priority) const {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        return priority == TaskPriority::High ? highTasks.size() : tasks.size();
+    }
+
+    size_t capacity() const {
+        return capacityLimit;
+    }
+
+    // Задачи, не принятые addTask (Reject, DropOldest без задач Normal, Block после остановки)
+    uint64_t rejectedCount() const {
+        return rejectedTasks.load(std::memory_order_relaxed);
+    }
+
+    // Задачи, вытесненные политикой DropOldest
+    uint64_t droppedCount() const {
+        return droppedTasks.load(std::memory_order_relaxed);
+    }
+
 private:
-    // Основной метод обработки задач
+    bool enqueue(QueuedTask task, TaskPriority priority) {
+        bool wake;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            if (priority == TaskPriority::High) {
+                highTasks.push_back(std::move(task));
+            } else {
+                if (capacityLimit != 0 && size() >= capacityLimit && !makeRoom(lock)) {
+                    rejectedTasks.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                tasks.push_back(std::move(task));
+            }
+            queued.store(size(), std::memory_order_release);
+            wake = workerParked;
+        }
+        if (wake) {
+            cv.notify_one();  // Уведомляем поток о новой задаче, только если он уснул
+        }
+        return true;
+    }
+
+    // Освобождение места по политике переполнения; false — задачу нужно отклонить
+    bool makeRoom(std::unique_lock<std::mutex>& lock) {
+        switch (overflowPolicy) {
+            case OverflowPolicy::Reject:
+                return false;
+            case OverflowPolicy::DropOldest:
+                if (tasks.empty()) {
+                    return false;  // Очередь занята задачами High: их не вытесняем, и предел не превышаем
+                }
+                tasks.pop_front();
+                queued.store(size(), std::memory_order_release);
+                droppedTasks.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            case OverflowPolicy::Block:
+                // Рабочий поток не ждет сам себя: его задачи принимаются сверх предела
+                if (std::this_thread::get_id() == workerThread.get_id()) {
+                    return true;
+                }
+                notFull.wait(lock, [this] { return size() < capacityLimit || hardStopFlag || destroying; });
+                return size() < capacityLimit;
+        }
+        return false;
+    }
+
+    // Ожидание задачи или остановки; блокировка удерживается на входе и выходе.
+    // SpinThenPark: если задача пришла во время кручения, бюджет кручения растет, иначе уменьшается
+    void waitForTask(std::unique_lock<std::mutex>& lock) {
+        if (size() != 0 || stopRequested()) {
+            return;
+        }
+        if (waitStrategy == WaitStrategy::SpinThenPark) {
+            lock.unlock();
+            bool arrived = false;
+            for (uint32_t i = 0; i < spinBudget && !arrived; ++i) {
+                arrived = queued.load(std::memory_order_acquire) != 0 || stopRequested();
+                cpuRelax();
+            }
+            spinBudget = arrived ? std::min(spinBudget * 2, MaxSpins) : std::max(spinBudget / 2, MinSpins);
+            for (uint32_t i = 0; i < YieldIterations && !arrived; ++i) {
+                std::this_thread::yield();
+                arrived = queued.load(std::memory_order_acquire) != 0 || stopRequested();
+            }
+            lock.lock();
+            if (size() != 0 || stopRequested()) {
+                return;
+            }
+        }
+        std::cerr << "Waiting for new tasks... \n";
+        workerParked = true;
+        cv.wait(lock, [this] { return size() != 0 || stopRequested(); });
+        workerParked = false;
+        std::cerr << "...finished waiting.\n";
+    }
+
+    // Основной метод обработки задач. Задача выполняется без блокировки очереди
     void processTasks() {
+        if (!workerCpus.empty() && !PinCurrentThread(workerCpus)) {
+            std::cerr << "Cannot pin SafeQueue worker to the requested CPUs.\n";
+        }
+        if (Tracer::Instance().Enabled()) {
+            Tracer::Instance().SetThreadName("SafeQueue worker");
+        }
         while (true) {
-            std::function<void()> task;
+            QueuedTask task;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                waitForTask(lock);
 
-            std::unique_lock<std::mutex> lock(queueMutex);
+                if (hardStopFlag) {
+                    std::cerr << "Hard stop initiated.\n";
+                    return;  // Завершаем работу, если установлен флаг жесткой остановки
+                }
 
-            if (!tasks.empty()) {
-                std::cerr << "Working...\n";
-                task = std::move(tasks.front());
-                tasks.pop();
-
-                if (task) {
-                    try {
-                        task();  // Выполнение задачи
-                    } catch (const std::exception& e) {
-                        std::cerr << "Exception caught during task execution: " << e.what() << std::endl;
-                    } catch (...) {
-                        std::cerr << "Unknown exception caught during task execution." << std::endl;
-                    }
+                if (size() == 0) {
+                    std::cerr << "All tasks are completed after a soft stop.\n";
+                    Tracer::Instance().DumpOnStop();
+                    return;  // Завершаем работу после выполнения всех задач
                 }
 
-            } else {
-                std::cerr << "Waiting for new tasks... \n";
-                cv.wait(lock, [this] { return !tasks.empty(); });
-                std::cerr << "...finished waiting.\n";
+                std::deque<QueuedTask>& lane = highTasks.empty() ? tasks : highTasks;
+                task = std::move(lane.front());
+                lane.pop_front();
+                queued.store(size(), std::memory_order_release);
             }
-
-            if (hardStopFlag && !tasks.empty()) {
-                std::cerr << "Hard stop initiated.\n";
-                return;  // Завершаем работу, если установлен флаг жесткой остановки
+            if (capacityLimit != 0) {
+                notFull.notify_one();
             }
 
-            if (softStopFlag && tasks.empty()) {
-                std::cerr << "All tasks are completed after a soft stop.\n";
-                return;  // Завершаем работу после выполнения всех задач
+            if (task.cmd) {
+                std::cerr << "Working...\n";
+                if (CommandRecorder* commandRecorder = recorder.load(std::memory_order_acquire)) {
+                    commandRecorder->Record(scheduler.CurrentTick(), *task.cmd);
+                }
+                Command& cmd = *task.cmd;
+                runMeasured(typeid(cmd), [&] { return cmd.GetName(); }, [&] { cmd.Execute(); });
+            } else if (task.run) {
+                std::cerr << "Working...\n";
+                const std::type_info& type = task.run.target_type();
+                runMeasured(type, [&] { return DemangledName(type); }, task.run);
             }
         }
     }
+
+    // Выполнение задачи с замером и трассой; исключения задач логируются и не останавливают поток
+    template <typename NameFn, typename Run>
+    static void runMeasured(const std::type_info& type, NameFn&& name, Run&& run) {
+        TraceScope trace("SafeQueue", type, name);
+        CommandProbe probe(type, name);  // Внутри трассы: замер — только сама задача
+        try {
+            run();  // Выполнение задачи
+        } catch (const std::exception& e) {
+            probe.Fail();
+            std::cerr << "Exception caught during task execution: " << e.what() << std::endl;
+        } catch (...) {
+            probe.Fail();
+            std::cerr << "Unknown exception caught during task execution." << std::endl;
+        }
+    }
 };
 
 #endif  // SAFEQUEUE_H
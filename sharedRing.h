@@ -0,0 +1,512 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "world.h"
+#include "journal.h"
+#include "safequeue.h"
+
+// Команда фиксированного размера для передачи между процессами (сетевой процесс -> симуляция).
+// Коды операций — как в журнале; указателей нет, корабль задается номером и поколением хэндла
+struct CommandRecord {
+    uint8_t opcode = 0;       // JournalOpcode; 0 — пустая запись (дополнение пакета), пропускается
+    uint8_t discrete = 0;     // JournalRotateAndChange: поворот на steps направлений вместо угла
+    uint16_t reserved = 0;
+    EntityId ship = 0;
+    uint32_t generation = 0;  // 0 — корабль, который занимает номер при разборе записи
+    int32_t steps = 0;
+    double values[4] = {};    // Скорость: x, y; топливо: [0]; поворот: угол, x, y
+
+    static CommandRecord Move(ShipHandle ship) {
+        return Make(JournalMove, ship);
+    }
+
+    static CommandRecord ChangeVelocity(ShipHandle ship, const Vector& velocity) {
+        CommandRecord record = Make(JournalChangeVelocity, ship);
+        record.values[0] = velocity.X;
+        record.values[1] = velocity.Y;
+        return record;
+    }
+
+    // JournalBurnFuel, JournalCheckFuel или JournalMoveWithFuel
+    static CommandRecord Fuel(JournalOpcode opcode, ShipHandle ship, double fuel) {
+        CommandRecord record = Make(opcode, ship);
+        record.values[0] = fuel;
+        return record;
+    }
+
+    static CommandRecord Rotate(ShipHandle ship, double angle, const Vector& velocity) {
+        CommandRecord record = Make(JournalRotateAndChange, ship);
+        record.values[0] = angle;
+        record.values[1] = velocity.X;
+        record.values[2] = velocity.Y;
+        return record;
+    }
+
+    static CommandRecord RotateSteps(ShipHandle ship, int steps, const Vector& velocity) {
+        CommandRecord record = Make(JournalRotateAndChange, ship);
+        record.discrete = 1;
+        record.steps = steps;
+        record.values[1] = velocity.X;
+        record.values[2] = velocity.Y;
+        return record;
+    }
+
+private:
+    static CommandRecord Make(JournalOpcode opcode, ShipHandle ship) {
+        CommandRecord record;
+        record.opcode = opcode;
+        record.ship = ship.index;
+        record.generation = ship.generation;
+        return record;
+    }
+};
+
+static_assert(sizeof(CommandRecord) == 48, "CommandRecord must fit a cache line together with its sequence");
+static_assert(std::is_trivially_copyable_v<CommandRecord>, "CommandRecord is copied between processes");
+
+// Режим кольца задается при создании и общий для всех процессов
+enum class RingMode : uint32_t {
+    SingleProducer = 1,  // Один производитель публикует хвост пачками
+    MultiProducer = 2,   // Производители занимают блоки позиций и публикуют каждую ячейку отдельно
+};
+
+// Кольцо записей команд в разделяемой памяти POSIX (shm_open + mmap).
+// Заголовок: голова (прочитано потребителем), хвост (SingleProducer) и счетчик занятых позиций
+// (MultiProducer) лежат в разных кэш-линиях, ячейка с записью занимает ровно одну кэш-линию,
+// поэтому производитель и потребитель не пишут в общие линии, кроме публикации позиций.
+// Позиции растут без переполнения (64 бита), индекс ячейки — позиция по маске емкости.
+// Атомарные переменные в разделяемой памяти работают между процессами, пока они lock-free
+class SharedCommandRing {
+public:
+    static constexpr size_t CacheLine = 64;
+
+    struct alignas(CacheLine) Slot {
+        std::atomic<uint64_t> sequence{0};  // MultiProducer: позиция + 1, когда запись готова
+        CommandRecord record;
+    };
+
+    struct Header {
+        std::atomic<uint64_t> magic{0};  // Записывается последним: кольцо готово к подключению
+        uint32_t capacity = 0;
+        RingMode mode = RingMode::SingleProducer;
+        alignas(CacheLine) std::atomic<uint64_t> head{0};     // Публикует потребитель
+        alignas(CacheLine) std::atomic<uint64_t> tail{0};     // Публикует производитель SingleProducer
+        alignas(CacheLine) std::atomic<uint64_t> reserve{0};  // Занимают производители MultiProducer
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared-memory ring needs lock-free 64-bit atomics");
+    static_assert(sizeof(Slot) == CacheLine, "Slot must occupy exactly one cache line");
+
+    SharedCommandRing() = default;
+
+    SharedCommandRing(const SharedCommandRing&) = delete;
+    SharedCommandRing& operator=(const SharedCommandRing&) = delete;
+
+    ~SharedCommandRing() {
+        Close();
+    }
+
+    // Создание (или пересоздание) кольца; name — имя объекта разделяемой памяти вида "/spaceship_commands".
+    // capacity — степень двойки. Прежний объект с этим именем не усекается (процессы, которые его отобразили,
+    // получили бы SIGBUS), а отвязывается: они дорабатывают со старым кольцом, новое создается с O_EXCL.
+    // false — причина в Error()
+    bool Create(const std::string& name, uint32_t capacity, RingMode mode) {
+        if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("Ring capacity must be a power of two.");
+        }
+        Close();
+        Unlink(name);
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) {
+            return Fail("Cannot create shared memory " + name);
+        }
+        size_t bytes = BytesFor(capacity);
+        if (ftruncate(fd, static_cast<off_t>(bytes)) != 0 || !Map(fd, bytes)) {
+            bool failed = Fail("Cannot map shared memory " + name);
+            close(fd);
+            Close();
+            return failed;
+        }
+        close(fd);
+        header = new (mapping) Header();
+        header->capacity = capacity;
+        header->mode = mode;
+        slots = reinterpret_cast<Slot*>(static_cast<char*>(mapping) + sizeof(Header));
+        for (uint32_t i = 0; i < capacity; ++i) {
+            new (slots + i) Slot();
+        }
+        mask = capacity - 1;
+        header->magic.store(Magic, std::memory_order_release);
+        return true;
+    }
+
+    // Подключение к кольцу, созданному другим процессом; false — кольца нет или оно еще не готово
+    bool Open(const std::string& name) {
+        Close();
+        int fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0) {
+            return Fail("Cannot open shared memory " + name);
+        }
+        struct stat info;
+        bool mapped = fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(Header) &&
+                      Map(fd, static_cast<size_t>(info.st_size));
+        close(fd);
+        if (!mapped) {
+            Close();
+            return Fail("Cannot map shared memory " + name);
+        }
+        header = static_cast<Header*>(mapping);
+        if (header->magic.load(std::memory_order_acquire) != Magic || BytesFor(header->capacity) != size) {
+            Close();
+            error = "Shared memory " + name + " is not a ready ring";
+            return false;
+        }
+        slots = reinterpret_cast<Slot*>(static_cast<char*>(mapping) + sizeof(Header));
+        mask = header->capacity - 1;
+        return true;
+    }
+
+    // Отключение; объект разделяемой памяти остается до Unlink
+    void Close() {
+        if (mapping) {
+            munmap(mapping, size);
+        }
+        mapping = nullptr;
+        header = nullptr;
+        slots = nullptr;
+        size = 0;
+    }
+
+    // Удаление имени; подключенные процессы продолжают работать со своим отображением
+    static void Unlink(const std::string& name) {
+        shm_unlink(name.c_str());
+    }
+
+    bool IsOpen() const {
+        return mapping != nullptr;
+    }
+
+    // Причина последней неудачи Create или Open
+    const std::string& Error() const {
+        return error;
+    }
+
+    uint32_t Capacity() const {
+        return header->capacity;
+    }
+
+    RingMode Mode() const {
+        return header->mode;
+    }
+
+    // Записи, занятые производителями и еще не прочитанные (приблизительно, пока идет обмен)
+    uint64_t Pending() const {
+        uint64_t end = header->mode == RingMode::SingleProducer ? header->tail.load(std::memory_order_acquire)
+                                                                 : header->reserve.load(std::memory_order_acquire);
+        return end - header->head.load(std::memory_order_acquire);
+    }
+
+    Header& Shared() {
+        return *header;
+    }
+
+    Slot& At(uint64_t position) {
+        return slots[position & mask];
+    }
+
+    // Ожидание свободного места или новых записей: короткое кручение, затем уступка процессора
+    // (на одном процессоре кручение только мешает второй стороне)
+    static void Wait(uint32_t& spins) {
+        if (++spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+            return;
+        }
+        std::this_thread::yield();
+    }
+
+private:
+    static constexpr uint64_t Magic = 0x5353524e47303031ull;  // "SSRNG001"
+
+    void* mapping = nullptr;
+    size_t size = 0;
+    Header* header = nullptr;
+    Slot* slots = nullptr;
+    uint64_t mask = 0;
+    std::string error;
+
+    // Запоминает причину вместе с errno системного вызова; вызывается сразу после неудачного вызова
+    bool Fail(const std::string& what) {
+        error = what + ": " + std::strerror(errno);
+        return false;
+    }
+
+    static size_t BytesFor(uint32_t capacity) {
+        return sizeof(Header) + static_cast<size_t>(capacity) * sizeof(Slot);
+    }
+
+    bool Map(int fd, size_t bytes) {
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED) {
+            return false;
+        }
+        mapping = memory;
+        size = bytes;
+        return true;
+    }
+};
+
+// Производитель. Один объект на поток; в режиме SingleProducer — один на кольцо.
+// SingleProducer: записи копируются в ячейки, хвост публикуется раз в batch записей (и в Flush);
+// голова потребителя перечитывается, только когда по запомненной голове кольцо полно.
+// MultiProducer: одна атомарная операция занимает блок из batch позиций, каждая запись
+// публикуется своей последовательностью; незаполненный остаток блока Flush заполняет пустыми записями
+class RingProducer {
+public:
+    explicit RingProducer(SharedCommandRing& ring, uint32_t batch = 32)
+        : ring(ring), batch(std::clamp<uint32_t>(batch, 1, ring.Capacity())) {
+        SharedCommandRing::Header& shared = ring.Shared();
+        cachedHead = shared.head.load(std::memory_order_acquire);
+        if (ring.Mode() == RingMode::SingleProducer) {
+            next = end = published = shared.tail.load(std::memory_order_acquire);
+        }
+    }
+
+    RingProducer(const RingProducer&) = delete;
+    RingProducer& operator=(const RingProducer&) = delete;
+
+    ~RingProducer() {
+        Flush();
+    }
+
+    // false — кольцо заполнено; уже записанное при этом опубликовано
+    bool TryPush(const CommandRecord& record) {
+        if (ring.Mode() == RingMode::SingleProducer) {
+            if (next - cachedHead >= ring.Capacity()) {
+                cachedHead = ring.Shared().head.load(std::memory_order_acquire);
+                if (next - cachedHead >= ring.Capacity()) {
+                    Flush();
+                    return false;
+                }
+            }
+            ring.At(next).record = record;
+            ++next;
+            if (next - published >= batch) {
+                Flush();
+            }
+            return true;
+        }
+        if (next == end && !Claim()) {
+            return false;
+        }
+        SharedCommandRing::Slot& slot = ring.At(next);
+        slot.record = record;
+        slot.sequence.store(next + 1, std::memory_order_release);
+        ++next;
+        return true;
+    }
+
+    // Ожидание места в кольце
+    void Push(const CommandRecord& record) {
+        uint32_t spins = 0;
+        while (!TryPush(record)) {
+            SharedCommandRing::Wait(spins);
+        }
+    }
+
+    // Публикация записанного: потребитель увидит все записи, переданные до вызова
+    void Flush() {
+        if (ring.Mode() == RingMode::SingleProducer) {
+            if (next != published) {
+                ring.Shared().tail.store(next, std::memory_order_release);
+                published = next;
+            }
+            return;
+        }
+        for (; next != end; ++next) {
+            SharedCommandRing::Slot& slot = ring.At(next);
+            slot.record = CommandRecord();
+            slot.sequence.store(next + 1, std::memory_order_release);
+        }
+    }
+
+private:
+    SharedCommandRing& ring;
+    uint32_t batch;
+    uint64_t next = 0;        // Позиция следующей записи
+    uint64_t end = 0;         // MultiProducer: конец занятого блока
+    uint64_t published = 0;   // SingleProducer: последний опубликованный хвост
+    uint64_t cachedHead = 0;  // Голова потребителя при последнем чтении
+
+    // Блок позиций для MultiProducer; голова читается до счетчика позиций,
+    // поэтому запомненная голова никогда не больше позиции
+    bool Claim() {
+        SharedCommandRing::Header& shared = ring.Shared();
+        uint64_t capacity = ring.Capacity();
+        uint64_t position = shared.reserve.load(std::memory_order_relaxed);
+        while (true) {
+            if (position - cachedHead + batch > capacity) {
+                cachedHead = shared.head.load(std::memory_order_acquire);
+                position = shared.reserve.load(std::memory_order_relaxed);
+            }
+            uint64_t used = position - cachedHead;
+            if (used >= capacity) {
+                return false;
+            }
+            uint64_t count = std::min<uint64_t>(batch, capacity - used);
+            if (shared.reserve.compare_exchange_weak(position, position + count, std::memory_order_relaxed)) {
+                next = position;
+                end = position + count;
+                return true;
+            }
+        }
+    }
+};
+
+// Потребитель; один на кольцо. Позиция чтения публикуется один раз за вызов Poll,
+// хвост (SingleProducer) перечитывается, только когда прочитаны все известные записи
+class RingConsumer {
+public:
+    explicit RingConsumer(SharedCommandRing& ring) : ring(ring) {
+        head = cachedTail = ring.Shared().head.load(std::memory_order_acquire);
+    }
+
+    // visit(const CommandRecord&) для готовых записей, не больше max ячеек.
+    // Возвращает количество непустых записей
+    template <typename Visit>
+    size_t Poll(Visit&& visit, size_t max = SIZE_MAX) {
+        size_t visited = 0;
+        uint64_t start = head;
+        if (ring.Mode() == RingMode::SingleProducer) {
+            if (head == cachedTail) {
+                cachedTail = ring.Shared().tail.load(std::memory_order_acquire);
+            }
+            uint64_t last = head + std::min<uint64_t>(cachedTail - head, max);
+            for (; head != last; ++head) {
+                const CommandRecord& record = ring.At(head).record;
+                if (record.opcode != 0) {
+                    visit(record);
+                    ++visited;
+                }
+            }
+        } else {
+            for (size_t i = 0; i < max; ++i, ++head) {
+                SharedCommandRing::Slot& slot = ring.At(head);
+                if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+                    break;
+                }
+                if (slot.record.opcode != 0) {
+                    visit(slot.record);
+                    ++visited;
+                }
+            }
+        }
+        if (head != start) {
+            ring.Shared().head.store(head, std::memory_order_release);  // Ячейки можно переписывать
+        }
+        return visited;
+    }
+
+private:
+    SharedCommandRing& ring;
+    uint64_t head = 0;
+    uint64_t cachedTail = 0;
+};
+
+// Потребитель кольца для симуляции: записи разбираются в команды мира и передаются в очередь игры.
+// Вызывается в потоке, который может читать мир (корабли не добавляются и не удаляются параллельно),
+// например из фазы приема команд GameLoop или задачи SafeQueue
+class RingCommandFeeder {
+public:
+    RingCommandFeeder(SharedCommandRing& ring, World& world) : consumer(ring), world(world) {}
+
+    // Команды попадают в CommandQueue; возвращает количество добавленных команд
+    size_t Feed(CommandQueue& queue, size_t max = SIZE_MAX) {
+        size_t added = 0;
+        consumer.Poll([&](const CommandRecord& record) {
+            if (std::shared_ptr<Command> cmd = Decode(record, world)) {
+                queue.AddCommand(std::move(cmd));
+                ++added;
+            } else {
+                ++dropped;
+            }
+        }, max);
+        return added;
+    }
+
+    // Команды попадают в SafeQueue через addCommand (с журналом, если он подключен)
+    size_t Feed(SafeQueue& queue, size_t max = SIZE_MAX, TaskPriority priority = TaskPriority::Normal) {
+        size_t added = 0;
+        consumer.Poll([&](const CommandRecord& record) {
+            std::shared_ptr<Command> cmd = Decode(record, world);
+            if (cmd && queue.addCommand(std::move(cmd), priority)) {
+                ++added;
+            } else {
+                ++dropped;
+            }
+        }, max);
+        return added;
+    }
+
+    // Записи без команды: корабль удален, хэндл устарел, неизвестный код или очередь отклонила задачу
+    uint64_t Dropped() const {
+        return dropped;
+    }
+
+    // nullptr — запись не превращается в команду
+    static std::shared_ptr<Command> Decode(const CommandRecord& record, World& world) {
+        ShipHandle handle{record.ship, record.generation};
+        if (record.generation == 0) {
+            if (!world.IsAlive(record.ship)) {
+                return nullptr;
+            }
+            handle = world.Handle(record.ship);
+        }
+        SpaceShip* ship = world.Resolve(handle);
+        if (!ship) {
+            return nullptr;
+        }
+        ShipRef ref(world, handle);
+        Vector vector(record.values[0], record.values[1]);
+        switch (record.opcode) {
+            case JournalMove:
+                return std::make_shared<MoveShipCommand>(ref);
+            case JournalChangeVelocity:
+                return std::make_shared<ChangeVelocityCommand>(ref, vector);
+            case JournalBurnFuel:
+                return std::make_shared<BurnFuelCommand>(ref, record.values[0]);
+            case JournalCheckFuel:
+                return std::make_shared<CheckFuelCommand>(ref, record.values[0]);
+            case JournalMoveWithFuel:
+                return std::make_shared<MoveWithFuelCommand>(ref, record.values[0]);
+            case JournalRotateAndChange: {
+                Vector velocity(record.values[1], record.values[2]);
+                if (record.discrete) {
+                    return std::make_shared<RotateAndChangeVelocity>(ref, DirectionSteps(record.steps), velocity);
+                }
+                return std::make_shared<RotateAndChangeVelocity>(ref, record.values[0], velocity);
+            }
+            default:
+                return nullptr;
+        }
+    }
+
+private:
+    RingConsumer consumer;
+    World& world;
+    uint64_t dropped = 0;
+};
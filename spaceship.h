@@ -1,41 +1,257 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
 #include "movable.h"
+#include "directionTable.h"
 
-class SpaceShip : public Movable, public Rotatable {
+// Поля корабля, изменения которых отслеживаются (по биту на поле)
+enum ShipField : uint8_t {
+    PositionField = 1 << 0,
+    VelocityField = 1 << 1,
+    RotationField = 1 << 2,
+    FuelField = 1 << 3,
+};
+
+constexpr int ShipFieldCount = 4;
+
+// Как корабль движется в шаге мира
+enum class MotionMode : uint8_t {
+    Idle,      // Нулевая скорость: шаг ничего не меняет
+    Stepping,  // Положение прибавляется каждый шаг (Movement::Move)
+    Coasting,  // Ленивое движение: положение считается при чтении
+};
+
+// Наблюдатель за изменениями корабля (например, мир, собирающий изменения за тик)
+class ShipObserver {
+public:
+    virtual void onShipChanged(uint32_t entity, uint8_t fields) = 0;
+    // Сменился режим движения (скорость стала нулевой или ненулевой, включилось ленивое движение)
+    virtual void onMotionChanged(uint32_t entity, MotionMode mode) {}
+    virtual ~ShipObserver() = default;
+};
+
+// final: Movement и RotationHandler вызывают методы корабля напрямую, без vtable
+class SpaceShip final : public Movable, public Rotatable, public DiscreteRotatable {
 private:
     Vector position;
     Vector velocity;
     Rotation rotation;
-    double fuel;
+    // Топливо в фиксированной точке (FuelScale единиц на единицу топлива): проверка и списание —
+    // один CAS, поэтому потоки, сжигающие топливо одного корабля, не уводят его в минус
+    std::atomic<int64_t> fuelUnits{0};
+    int direction = 0;
+    int directionsNumber = 0;  // 0 — непрерывный поворот в градусах
+    ShipObserver* observer = nullptr;
+    uint32_t entity = 0;
+
+    // Ленивое движение: положение считается при чтении как position + velocity * (тик - startTick).
+    // Включается, только если это побитово совпадает с прибавлением скорости каждый тик
+    const uint64_t* clock = nullptr;  // Счетчик шагов движения мира; nullptr — обычное движение
+    uint64_t startTick = 0;
+    bool lazy = false;
+    MotionMode motion = MotionMode::Idle;  // О смене сообщается наблюдателю
+
+    void notify(uint8_t fields) {
+        if (observer) {
+            observer->onShipChanged(entity, fields);
+        }
+    }
+
+    // Показатель младшего значащего бита: x кратно 2^result
+    static int lowestBitExponent(double x) {
+        int exponent;
+        double mantissa = std::frexp(std::fabs(x), &exponent);
+        uint64_t bits = static_cast<uint64_t>(std::ldexp(mantissa, 53));
+        return exponent - 53 + __builtin_ctzll(bits);
+    }
+
+    // Горизонт, на котором ленивое положение обязано быть точным (больше любой игровой сессии)
+    static constexpr double LazyHorizonTicks = 1099511627776.0;  // 2^40
+
+    // Все суммы origin + velocity * k кратны общему младшему биту и не выходят за 53 бита мантиссы,
+    // поэтому и пошаговые сложения, и умножение с одним сложением точны и совпадают
+    static bool exactAxis(double origin, double velocity) {
+        if (!std::isfinite(origin) || !std::isfinite(velocity)) {
+            return false;
+        }
+        if (velocity == 0) {
+            return true;
+        }
+        int unit = lowestBitExponent(velocity);
+        if (origin != 0) {
+            unit = std::min(unit, lowestBitExponent(origin));
+        }
+        return std::fabs(origin) + std::fabs(velocity) * LazyHorizonTicks < std::ldexp(1.0, 53 + unit);
+    }
+
+    // Пересчет режима после перебазирования (position — начало отсчета на startTick)
+    void updateMotionMode() {
+        lazy = clock && exactAxis(position.X, velocity.X) && exactAxis(position.Y, velocity.Y);
+        MotionMode mode = velocity == Vector(0, 0) ? MotionMode::Idle
+                          : lazy                   ? MotionMode::Coasting
+                                                   : MotionMode::Stepping;
+        if (mode != motion) {
+            motion = mode;
+            if (observer) {
+                observer->onMotionChanged(entity, motion);
+            }
+        }
+    }
+
+    // Фиксация текущего положения как нового начала отсчета
+    void rebase() {
+        position = getPosition();
+        startTick = clock ? *clock : 0;
+    }
 
 public:
     SpaceShip(const Vector& pos, Rotation rot)
         : position(pos), velocity(Vector()), rotation(rot) {}
 
+    // Копия получает состояние, но не подписку наблюдателя и не ленивое движение
+    SpaceShip(const SpaceShip& other)
+        : position(other.getPosition()), velocity(other.velocity), rotation(other.rotation),
+          fuelUnits(other.fuelUnits.load(std::memory_order_relaxed)), direction(other.direction),
+          directionsNumber(other.directionsNumber) {
+        updateMotionMode();
+    }
+
+    // Перемещение внутри хранилища мира: подписка и ленивое движение переезжают вместе с кораблем,
+    // номер не меняется
+    SpaceShip(SpaceShip&& other) noexcept
+        : position(other.position), velocity(other.velocity), rotation(other.rotation),
+          fuelUnits(other.fuelUnits.load(std::memory_order_relaxed)), direction(other.direction),
+          directionsNumber(other.directionsNumber), observer(other.observer),
+          entity(other.entity), clock(other.clock), startTick(other.startTick), lazy(other.lazy),
+          motion(other.motion) {}
+
+    SpaceShip& operator=(SpaceShip&& other) noexcept {
+        position = other.position;
+        velocity = other.velocity;
+        rotation = other.rotation;
+        fuelUnits.store(other.fuelUnits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        direction = other.direction;
+        directionsNumber = other.directionsNumber;
+        observer = other.observer;
+        entity = other.entity;
+        clock = other.clock;
+        startTick = other.startTick;
+        lazy = other.lazy;
+        motion = other.motion;
+        return *this;
+    }
+
+    SpaceShip& operator=(const SpaceShip& other) {
+        position = other.getPosition();
+        velocity = other.velocity;
+        rotation = other.rotation;
+        fuelUnits.store(other.fuelUnits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        direction = other.direction;
+        directionsNumber = other.directionsNumber;
+        startTick = clock ? *clock : 0;
+        updateMotionMode();
+        notify(PositionField | VelocityField | RotationField | FuelField);
+        return *this;
+    }
+
+    // Подписка наблюдателя; entity — номер корабля, который получит наблюдатель.
+    // Наблюдатель сразу узнает режим движения, если корабль уже движется
+    void setObserver(ShipObserver* shipObserver, uint32_t id) {
+        observer = shipObserver;
+        entity = id;
+        if (observer && motion != MotionMode::Idle) {
+            observer->onMotionChanged(entity, motion);
+        }
+    }
+
+    // Ленивое движение по счетчику шагов мира; nullptr — положение меняется только через setPosition
+    void setMotionClock(const uint64_t* motionClock) {
+        rebase();
+        clock = motionClock;
+        startTick = clock ? *clock : 0;
+        updateMotionMode();
+    }
+
+    // Положение считается при чтении; Movement::Move для такого корабля не нужен
+    bool hasLazyMotion() const {
+        return lazy;
+    }
+
+    MotionMode getMotionMode() const {
+        return motion;
+    }
+
     void setVelocity(const Vector& vec) {
+        rebase();
         velocity = vec;
+        updateMotionMode();
+        notify(VelocityField);
     }
 
     // Добавляем методы для управления топливом
+    static constexpr double FuelScale = 1048576.0;  // 2^20: двоичные дроби до 2^-20 хранятся точно
+
+    // Перевод в единицы фиксированной точки; остальные значения округляются до ближайшей единицы
+    static int64_t toFuelUnits(double amount) {
+        double units = amount * FuelScale;
+        if (!(std::fabs(units) < 9.0e18)) {
+            throw std::out_of_range("Fuel amount out of range: " + std::to_string(amount));
+        }
+        return std::llround(units);
+    }
+
     double getFuel() const {
-        return fuel;
+        return static_cast<double>(getFuelUnits()) / FuelScale;
+    }
+
+    int64_t getFuelUnits() const {
+        return fuelUnits.load(std::memory_order_relaxed);
     }
 
     void setFuel(double amount) {
-        fuel = amount;
+        fuelUnits.store(toFuelUnits(amount), std::memory_order_relaxed);
+        notify(FuelField);
+    }
+
+    bool hasFuel(double amount) const {
+        return getFuelUnits() >= toFuelUnits(amount);
+    }
+
+    // Проверка и списание одной атомарной операцией; false — топлива не хватает, запас не изменен.
+    // Топливо — единственное общее состояние, поэтому достаточно relaxed.
+    // Наблюдатель вызывается в потоке, который сжег топливо
+    bool tryBurnFuelUnits(int64_t units) {
+        int64_t current = fuelUnits.load(std::memory_order_relaxed);
+        do {
+            if (current < units) {
+                return false;
+            }
+        } while (!fuelUnits.compare_exchange_weak(current, current - units, std::memory_order_relaxed));
+        notify(FuelField);
+        return true;
+    }
+
+    bool tryBurnFuel(double amount) {
+        return tryBurnFuelUnits(toFuelUnits(amount));
     }
 
     void burnFuel(double amount) {
-        if (fuel >= amount) {
-            fuel -= amount;
-        } else {
+        if (!tryBurnFuel(amount)) {
             throw std::runtime_error("Not enough fuel to burn.");
         }
     }
 
     // Implement Movable interface
     Vector getPosition() const override {
-        return position;
+        if (!lazy) {
+            return position;
+        }
+        uint64_t elapsed = *clock - startTick;
+        return elapsed == 0 ? position : position + velocity * static_cast<double>(elapsed);
     }
 
     Vector getVelocity() const override {
@@ -44,6 +260,11 @@ public:
 
     Movable& setPosition(const Vector& vector) override {
         position = vector;
+        if (lazy) {
+            startTick = *clock;
+            updateMotionMode();
+        }
+        notify(PositionField);
         return *this;
     }
 
@@ -53,7 +274,42 @@ public:
     }
 
     Rotatable& setRotation(Rotation rot) override {
+        if (directionsNumber != 0) {
+            // В дискретном режиме угол округляется до ближайшего направления
+            setDirection(static_cast<int>(std::lround(rot * directionsNumber / 360.0)));
+            return *this;
+        }
         rotation = rot;
+        notify(RotationField);
+        return *this;
+    }
+
+    // Включение дискретного режима: поворот шагами по 360 / directions градусов
+    // с табличной тригонометрией. Текущий угол округляется до ближайшего направления
+    void setDirectionsNumber(int directions) {
+        if (!DirectionTables::IsSupported(directions)) {
+            throw std::invalid_argument("Unsupported directions number: " + std::to_string(directions));
+        }
+        directionsNumber = directions;
+        setDirection(static_cast<int>(std::lround(rotation * directions / 360.0)));
+    }
+
+    // Implement DiscreteRotatable interface
+    int getDirection() const override {
+        return direction;
+    }
+
+    int getDirectionsNumber() const override {
+        return directionsNumber;
+    }
+
+    DiscreteRotatable& setDirection(int newDirection) override {
+        if (directionsNumber == 0) {
+            throw std::runtime_error("Discrete rotation mode is off.");
+        }
+        direction = DirectionTables::Normalize(newDirection, directionsNumber);
+        rotation = direction * 360.0 / directionsNumber;  // Угол в градусах для остального кода
+        notify(RotationField);
         return *this;
     }
 };
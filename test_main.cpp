@@ -3,6 +3,43 @@
 #include "spaceship.h"
 #include "movement.h"
 #include "rotation.h"
+#include "exception_queue.h"
+#include "burnFuelCommand.h"
+#include "checkFuelCommand.h"
+#include "changeVelocity.h"
+#include "rotateAndChangeVelocity.h"
+#include "macroCommand.h"
+#include "parallelExecutor.h"
+#include "world.h"
+#include "deltaCodec.h"
+#include "directionTable.h"
+#include "worldSnapshot.h"
+#include "collision.h"
+#include "journal.h"
+#include "gameLoop.h"
+#include "cpuAffinity.h"
+#include "components.h"
+#include "coalescer.h"
+#include "commandScript.h"
+#include "trajectoryPredictor.h"
+#include "preprocessor.h"
+#include "ioc.h"
+#include "sharedRing.h"
+#include "AutoGenerated_RotatableAdapter.h"
+#include "moveWithFuel.h"
+#include <cmath>
+#include "coroutineScheduler.h"
+#include "commandStats.h"
+#include "safequeue.h"
+#include "tracing.h"
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <filesystem>
+#include <sys/wait.h>
+#include <fstream>
+#include <sstream>
 
 TEST(MovementTests, MoveChangesPositionCorrectly) {
     SpaceShip ship(Vector(12, 5), 0.0);  // Создаем корабль в точке (12, 5)
@@ -13,6 +50,1902 @@ TEST(MovementTests, MoveChangesPositionCorrectly) {
     EXPECT_EQ(ship.getPosition(), Vector(5, 8));  // Проверяем, что новое положение (5, 8)
 }
 
+// Содержимое файла целиком
+std::string readFile(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+// Статистика по типу команды из снимка (пустая, если команда не выполнялась)
+CommandTypeStats findStats(const std::string& name) {
+    for (const auto& stats : CommandStats::Instance().Snapshot()) {
+        if (stats.name == name) {
+            return stats;
+        }
+    }
+    return CommandTypeStats{name};
+}
+
+TEST(CommandStatsTests, HistogramBucketsCoverValues) {
+    for (uint64_t value : {0ull, 7ull, 8ull, 15ull, 16ull, 1000ull, 123456789ull}) {
+        int index = LatencyHistogram::BucketIndex(value);
+        EXPECT_LE(LatencyHistogram::BucketLowerBound(index), value);
+        EXPECT_GT(LatencyHistogram::BucketUpperBound(index), value);
+    }
+
+    LatencyHistogram histogram;
+    for (uint64_t value = 1; value <= 100; ++value) {
+        histogram.Record(value);
+    }
+    EXPECT_EQ(histogram.Count(), 100u);
+    EXPECT_NEAR(static_cast<double>(histogram.Percentile(50)), 50.0, 50.0 / 8);
+}
+
+TEST(CommandStatsTests, CountsExecutionsFailuresAndRetries) {
+    auto before = findStats("BurnFuelCommand");
+
+    SpaceShip ship(Vector(0, 0), 0);
+    ship.setFuel(10);
+    CommandQueue queue;
+    queue.AddCommand(std::make_shared<BurnFuelCommand>(ship, 5));
+    queue.AddCommand(std::make_shared<BurnFuelCommand>(ship, 5));
+    queue.AddCommand(std::make_shared<BurnFuelCommand>(ship, 5));  // Топлива нет: ошибка и повтор
+    queue.ProcessCommands();
+
+    auto after = findStats("BurnFuelCommand");
+    EXPECT_EQ(after.executed - before.executed, 3u);
+    EXPECT_EQ(after.failed - before.failed, 1u);
+    EXPECT_EQ(after.retried - before.retried, 1u);
+    EXPECT_EQ(after.latencyNs.Count() - before.latencyNs.Count(), 3u);
+}
+
+class SampledStatsCommand : public Command {
+public:
+    void Execute() override {}
+
+    std::string GetName() const override {
+        return "SampledStatsCommand";
+    }
+};
+
+TEST(CommandStatsTests, LatencySampledAfterFirstCommandsOfType) {
+    const uint64_t commands = CommandProbe::LatencyExactCount + 2 * CommandProbe::LatencySampleEvery;
+    CommandQueue queue;
+    auto cmd = std::make_shared<SampledStatsCommand>();
+    for (uint64_t i = 0; i < commands; ++i) {
+        queue.AddCommand(cmd);
+    }
+    queue.ProcessCommands();
+
+    auto stats = findStats("SampledStatsCommand");
+    EXPECT_EQ(stats.executed, commands);
+    EXPECT_EQ(stats.latencyNs.Count(), CommandProbe::LatencyExactCount + 2);
+}
+
+TEST(CommandStatsTests, AggregatesSafeQueueThreadsAndWritesPrometheus) {
+    auto countTasks = [] {
+        uint64_t count = 0;
+        for (const auto& stats : CommandStats::Instance().Snapshot()) {
+            if (stats.name.find("CommandStatsTests") != std::string::npos) {
+                count += stats.executed;
+            }
+        }
+        return count;
+    };
+    uint64_t before = countTasks();
+    auto burnBefore = findStats("BurnFuelCommand");
+    SpaceShip ship(Vector(0, 0), 0);
+    ship.setFuel(10);
+    {
+        SafeQueue queue;
+        queue.addTask([] {});
+        queue.addTask([] {});
+        queue.addCommand(std::make_shared<BurnFuelCommand>(ship, 1));  // Строка своего типа, а не обертки
+        queue.softStop();  // Заранее: поток завершится, как только очередь опустеет
+        queue.start();
+    }
+    EXPECT_EQ(countTasks() - before, 2u);
+    auto burnAfter = findStats("BurnFuelCommand");
+    EXPECT_EQ(burnAfter.executed - burnBefore.executed, 1u);
+    EXPECT_EQ(burnAfter.latencyNs.Count() - burnBefore.latencyNs.Count(), 1u);
+
+    const std::string path = "command_stats_test.prom";
+    ASSERT_TRUE(CommandStats::Instance().WritePrometheus(path));
+    std::string content = readFile(path);
+    EXPECT_NE(content.find("spaceship_commands_executed_total{command=\"BurnFuelCommand\"}"), std::string::npos);
+    EXPECT_NE(content.find("spaceship_command_latency_seconds_bucket"), std::string::npos);
+    std::remove(path.c_str());
+}
+
+TEST(TracingTests, DisabledTracerRecordsNothing) {
+    Tracer::Instance().Disable();
+    Tracer::Instance().Clear();
+
+    SpaceShip ship(Vector(0, 0), 0);
+    ship.setFuel(10);
+    CommandQueue queue;
+    queue.AddCommand(std::make_shared<BurnFuelCommand>(ship, 1));
+    queue.ProcessCommands();
+
+    const std::string path = "trace_disabled_test.json";
+    ASSERT_TRUE(Tracer::Instance().DumpChromeTrace(path));
+    EXPECT_EQ(readFile(path).find("\"ph\":\"X\""), std::string::npos);
+    std::remove(path.c_str());
+}
+
+TEST(TracingTests, DumpsCommandsAndTasksAtSoftStop) {
+    const std::string path = "trace_test.json";
+    Tracer::Instance().Clear();
+    Tracer::Instance().Enable();
+    Tracer::Instance().SetOutputPath(path);
+
+    SpaceShip ship(Vector(0, 0), 0);
+    ship.setFuel(10);
+    CommandQueue commands;
+    commands.AddCommand(std::make_shared<BurnFuelCommand>(ship, 1));
+    commands.ProcessCommands();
+    {
+        SafeQueue queue;
+        queue.addTask([] {});
+        queue.addCommand(std::make_shared<ChangeVelocityCommand>(ship, Vector(1, 0)));
+        queue.softStop();
+        queue.start();
+    }
+    Tracer::Instance().Disable();
+    Tracer::Instance().SetOutputPath("");
+
+    std::string trace = readFile(path);
+    EXPECT_EQ(trace.rfind("{\"displayTimeUnit\"", 0), 0u);
+    EXPECT_NE(trace.find("\"name\":\"BurnFuelCommand\",\"cat\":\"CommandQueue\",\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(trace.find("\"cat\":\"SafeQueue\""), std::string::npos);
+    // Команда из SafeQueue — под своим именем, а не под типом лямбды-обертки
+    EXPECT_NE(trace.find("\"name\":\"ChangeVelocityCommand\",\"cat\":\"SafeQueue\""), std::string::npos);
+    EXPECT_NE(trace.find("SafeQueue worker"), std::string::npos);
+    std::remove(path.c_str());
+}
+
+TEST(TracingTests, EnableAppliesCapacityToExistingBuffers) {
+    Tracer::Instance().Enable(0);  // Емкость 0 поднимается до 1
+    EXPECT_EQ(Tracer::Instance().Local().Capacity(), 1u);
+    SpaceShip ship(Vector(0, 0), 0);
+    ship.setFuel(10);
+    CommandQueue queue;
+    queue.AddCommand(std::make_shared<BurnFuelCommand>(ship, 1));
+    queue.AddCommand(std::make_shared<BurnFuelCommand>(ship, 1));
+    queue.ProcessCommands();
+
+    Tracer::Instance().Enable(8);
+    EXPECT_EQ(Tracer::Instance().Local().Capacity(), 8u);
+    Tracer::Instance().Enable();
+    Tracer::Instance().Disable();
+    Tracer::Instance().Clear();
+}
+
+// Маневр на несколько тиков: поворот, разгон, полет
+Behavior maneuver(SpaceShip& ship, std::vector<uint64_t>& log, CommandScheduler& scheduler) {
+    RotationHandler::Rotate(ship, 90);
+    log.push_back(scheduler.CurrentTick());
+    co_await NextTick();
+    ship.setVelocity(Vector(1, 0));
+    log.push_back(scheduler.CurrentTick());
+    co_await Delay(3);
+    Movement::Move(ship);
+    log.push_back(scheduler.CurrentTick());
+}
+
+TEST(CoroutineTests, BehaviorSpansSeveralTicks) {
+    SpaceShip ship(Vector(0, 0), 0);
+    std::vector<uint64_t> log;
+    CommandQueue queue;
+    queue.Spawn(maneuver(ship, log, queue.Scheduler()));
+
+    queue.ProcessCommands();
+    EXPECT_EQ(ship.getRotation(), 90.0);
+    EXPECT_EQ(ship.getVelocity(), Vector(0, 0));
+
+    queue.ProcessCommands();
+    EXPECT_EQ(ship.getVelocity(), Vector(1, 0));
+
+    for (int i = 0; i < 3; ++i) {
+        queue.ProcessCommands();
+    }
+    EXPECT_EQ(ship.getPosition(), Vector(1, 0));
+    EXPECT_EQ(log, (std::vector<uint64_t>{1, 2, 5}));
+    EXPECT_EQ(queue.Scheduler().Pending(), 0u);
+}
+
+Behavior burnWhenFueled(SpaceShip& ship, bool& burned) {
+    co_await WaitFuel(ship, 5);
+    ship.burnFuel(5);
+    burned = true;
+}
+
+TEST(CoroutineTests, WaitFuelResumesWhenFuelIsEnough) {
+    SpaceShip ship(Vector(0, 0), 0);
+    ship.setFuel(1);
+    bool burned = false;
+    CommandQueue queue;
+    queue.Spawn(burnWhenFueled(ship, burned));
+
+    queue.ProcessCommands();
+    queue.ProcessCommands();
+    EXPECT_FALSE(burned);
+
+    ship.setFuel(7);
+    queue.ProcessCommands();
+    EXPECT_TRUE(burned);
+    EXPECT_EQ(ship.getFuel(), 2.0);
+}
+
+// Предикат с изменяемым состоянием: ждет заданное число проверок
+Behavior waitChecks(int checks, bool& done) {
+    co_await WaitUntil([checks]() mutable { return --checks < 0; });
+    done = true;
+}
+
+TEST(CoroutineTests, MutablePredicateAndPendingFromOtherThread) {
+    CommandScheduler scheduler;
+    bool done = false;
+    scheduler.Spawn(waitChecks(2, done));
+    std::atomic<bool> stop{false};
+    std::thread observer([&] {
+        while (!stop.load()) {
+            EXPECT_LE(scheduler.Pending(), 1u);
+        }
+    });
+    scheduler.Tick();
+    EXPECT_EQ(scheduler.Pending(), 1u);
+    scheduler.Tick();
+    EXPECT_FALSE(done);
+    scheduler.Tick();
+    EXPECT_TRUE(done);
+    EXPECT_EQ(scheduler.Pending(), 0u);
+    stop = true;
+    observer.join();
+}
+
+Behavior failingBehavior() {
+    co_await NextTick();
+    throw std::runtime_error("Behavior failed");
+}
+
+TEST(CoroutineTests, ExceptionDestroysFrame) {
+    CommandScheduler scheduler;
+    scheduler.Spawn(failingBehavior());
+    scheduler.Tick();
+    EXPECT_EQ(scheduler.Pending(), 1u);
+    scheduler.Tick();
+    EXPECT_EQ(scheduler.Pending(), 0u);
+}
+
+TEST(CoroutineTests, FramePoolReusesBlocks) {
+    void* first = FramePool::Allocate(100);
+    FramePool::Deallocate(first, 100);
+    void* second = FramePool::Allocate(120);  // Тот же класс размера (128 байт)
+    EXPECT_EQ(first, second);
+    FramePool::Deallocate(second, 120);
+}
+
+TEST(CoroutineTests, SafeQueueResumesBehaviorsInTickTasks) {
+    SpaceShip ship(Vector(0, 0), 0);
+    {
+        SafeQueue queue;
+        queue.spawn([](SpaceShip& ship) -> Behavior {
+            for (int i = 0; i < 3; ++i) {
+                RotationHandler::Rotate(ship, 30);
+                co_await NextTick();
+            }
+        }(ship));
+        for (int i = 0; i < 3; ++i) {
+            queue.tick();
+        }
+        queue.softStop();
+        queue.start();
+    }
+    EXPECT_EQ(ship.getRotation(), 90.0);
+}
+
+TEST(RepeatTests, RepeatingMoveRunsEveryTickUntilCancelled) {
+    SpaceShip ship(Vector(0, 0), 0);
+    ship.setVelocity(Vector(1, 2));
+    CommandQueue queue;
+    RepeatHandle handle = queue.AddRepeating(std::make_shared<MoveCommand>(ship));
+
+    for (int i = 0; i < 3; ++i) {
+        queue.ProcessCommands();
+    }
+    EXPECT_EQ(ship.getPosition(), Vector(3, 6));
+
+    EXPECT_TRUE(queue.CancelRepeating(handle));
+    EXPECT_FALSE(queue.CancelRepeating(handle));  // Дескриптор устарел
+    queue.ProcessCommands();
+    EXPECT_EQ(ship.getPosition(), Vector(3, 6));
+    EXPECT_EQ(queue.Repeating().Size(), 0u);
+
+    // Освобожденный узел переиспользуется, старый дескриптор на него не действует
+    RepeatHandle reused = queue.AddRepeating(std::make_shared<MoveCommand>(ship));
+    EXPECT_EQ(reused.index, handle.index);
+    EXPECT_FALSE(queue.Repeating().IsActive(handle));
+    EXPECT_TRUE(queue.Repeating().IsActive(reused));
+}
+
+TEST(RepeatTests, ReplaceAndCancelDuringTick) {
+    SpaceShip first(Vector(0, 0), 0);
+    SpaceShip second(Vector(0, 0), 0);
+    first.setVelocity(Vector(1, 0));
+    second.setVelocity(Vector(0, 1));
+    CommandQueue queue;
+
+    RepeatHandle moveFirst = queue.AddRepeating(std::make_shared<MoveCommand>(first));
+    RepeatHandle moveSecond = queue.AddRepeating(std::make_shared<MoveCommand>(second));
+    queue.ReplaceRepeating(moveFirst, std::make_shared<ChangeVelocityCommand>(first, Vector(5, 5)));
+
+    // Команда отменяет следующую за ней в том же тике
+    class CancelCommand : public Command {
+    public:
+        CancelCommand(CommandQueue& queue, RepeatHandle& target) : queue(queue), target(target) {}
+        void Execute() override { queue.CancelRepeating(target); }
+        std::string GetName() const override { return "CancelCommand"; }
+
+    private:
+        CommandQueue& queue;
+        RepeatHandle& target;
+    };
+    RepeatHandle canceller = queue.AddRepeating(std::make_shared<CancelCommand>(queue, moveSecond));
+    RepeatHandle last = queue.AddRepeating(std::make_shared<MoveCommand>(second));
+    queue.ReplaceRepeating(canceller, std::make_shared<CancelCommand>(queue, last));
+
+    queue.ProcessCommands();
+    EXPECT_EQ(first.getVelocity(), Vector(5, 5));
+    EXPECT_EQ(first.getPosition(), Vector(0, 0));
+    EXPECT_EQ(second.getPosition(), Vector(0, 1));  // Выполнилось только первое движение
+    EXPECT_EQ(queue.Repeating().Size(), 3u);
+}
+
+// Один и тот же набор команд для последовательного и параллельного режимов
+void fillMixedCommands(CommandQueue& queue, std::vector<SpaceShip>& ships) {
+    for (int round = 0; round < 5; ++round) {
+        for (size_t i = 0; i < ships.size(); ++i) {
+            SpaceShip& ship = ships[i];
+            queue.AddCommand(std::make_shared<ChangeVelocityCommand>(ship, Vector(i % 7, round)));
+            queue.AddCommand(std::make_shared<RotateAndChangeVelocity>(ship, 30.0 * round, Vector()));
+            queue.AddCommand(std::make_shared<MoveCommand>(ship));
+            queue.AddCommand(std::make_shared<BurnFuelCommand>(ship, 3));  // Часть сжиганий завершится ошибкой
+        }
+        queue.AddCommand(std::make_shared<FailingCommand>());  // Барьер
+    }
+}
+
+TEST(ParallelQueueTests, MatchesSerialExecution) {
+    std::vector<SpaceShip> serialShips(64, SpaceShip(Vector(1, 1), 0));
+    std::vector<SpaceShip> parallelShips(64, SpaceShip(Vector(1, 1), 0));
+    for (size_t i = 0; i < serialShips.size(); ++i) {
+        serialShips[i].setFuel(static_cast<double>(i % 10));
+        parallelShips[i].setFuel(static_cast<double>(i % 10));
+    }
+
+    CommandQueue serial;
+    fillMixedCommands(serial, serialShips);
+    serial.ProcessCommands();
+
+    ParallelExecutor executor(4);
+    CommandQueue parallel;
+    parallel.SetParallelExecutor(&executor);
+    fillMixedCommands(parallel, parallelShips);
+    parallel.ProcessCommands();
+
+    for (size_t i = 0; i < serialShips.size(); ++i) {
+        EXPECT_EQ(parallelShips[i].getPosition(), serialShips[i].getPosition());
+        EXPECT_EQ(parallelShips[i].getVelocity(), serialShips[i].getVelocity());
+        EXPECT_EQ(parallelShips[i].getRotation(), serialShips[i].getRotation());
+        EXPECT_EQ(parallelShips[i].getFuel(), serialShips[i].getFuel());
+    }
+}
+
+TEST(ParallelQueueTests, WorldShipsChangeMotionOnLanes) {
+    const EntityId ships = 256;
+    World serialWorld;
+    World parallelWorld;
+    parallelWorld.SetLazyMotion(true);  // Смена режима и в бите инерции, и в активном множестве
+    for (EntityId i = 0; i < ships; ++i) {
+        serialWorld.AddShip(Vector(i, 0), 0);
+        parallelWorld.AddShip(Vector(i, 0), 0);
+    }
+    CommandQueue serial;
+    ParallelExecutor executor(4);
+    CommandQueue parallel;
+    parallel.SetParallelExecutor(&executor);
+    for (int round = 0; round < 30; ++round) {
+        size_t moving = 0;
+        for (EntityId i = 0; i < ships; ++i) {
+            // Скорости то нулевые, то ненулевые, то неточные: корабли переходят между всеми режимами
+            Vector velocity = (i + round) % 3 == 0 ? Vector(0, 0) : Vector(0.1 * round, (i + round) % 3);
+            moving += velocity != Vector(0, 0);
+            serial.AddCommand(std::make_shared<ChangeVelocityCommand>(serialWorld.Ref(i), velocity));
+            parallel.AddCommand(std::make_shared<ChangeVelocityCommand>(parallelWorld.Ref(i), velocity));
+        }
+        serial.ProcessCommands();
+        parallel.ProcessCommands();
+        serialWorld.MoveShips();
+        parallelWorld.MoveShips();
+        EXPECT_EQ(serialWorld.SteppingCount(), moving);
+        for (EntityId i = 0; i < ships; ++i) {
+            ASSERT_EQ(parallelWorld.Ship(i).getPosition(), serialWorld.Ship(i).getPosition())
+                << "round " << round << " ship " << i;
+        }
+    }
+}
+
+TEST(ParallelQueueTests, CommandsDeclareTheirTarget) {
+    SpaceShip first(Vector(0, 0), 0);
+    SpaceShip second(Vector(0, 0), 0);
+    MoveCommand move(first);
+    BurnFuelCommand burn(first, 1);
+    EXPECT_EQ(move.GetTarget(), burn.GetTarget());
+
+    MacroCommand sameShip({std::make_shared<MoveCommand>(first), std::make_shared<BurnFuelCommand>(first, 1)});
+    MacroCommand twoShips({std::make_shared<MoveCommand>(first), std::make_shared<MoveCommand>(second)});
+    EXPECT_EQ(sameShip.GetTarget(), &first);
+    EXPECT_EQ(twoShips.GetTarget(), nullptr);
+    EXPECT_EQ(FailingCommand().GetTarget(), nullptr);
+}
+
+TEST(WorldTests, ParallelCommandsKeepEveryDirtyBit) {
+    World world;
+    const EntityId ships = 512;
+    for (EntityId i = 0; i < ships; ++i) {
+        world.Ship(world.AddShip(Vector(0, 0), 0)).setFuel(100);
+    }
+    ParallelExecutor executor(4);
+    CommandQueue queue;
+    queue.SetParallelExecutor(&executor);
+    for (int round = 0; round < 20; ++round) {
+        world.ClearDirty();
+        for (EntityId i = 0; i < ships; ++i) {
+            queue.AddCommand(std::make_shared<BurnFuelCommand>(world.Ref(i), 1));
+        }
+        queue.ProcessCommands();
+        size_t dirty = 0;
+        world.ForEachDirty([&](EntityId, uint8_t fields) { dirty += fields == FuelField; });
+        ASSERT_EQ(dirty, ships) << "round " << round;  // Соседи по слову из разных полос не теряют биты
+    }
+}
+
+TEST(WorldTests, TracksDirtyFieldsPerShip) {
+    World world;
+    EntityId first = world.AddShip(Vector(0, 0), 0);
+    EntityId second = world.AddShip(Vector(1, 1), 0);
+    EXPECT_TRUE(world.IsDirty(first, PositionField));
+    world.ClearDirty();
+
+    world.Ship(second).setVelocity(Vector(1, 0));
+    world.Ship(second).burnFuel(0);
+    EXPECT_FALSE(world.IsDirty(first, VelocityField));
+    EXPECT_TRUE(world.IsDirty(second, VelocityField));
+    EXPECT_FALSE(world.IsDirty(second, PositionField));
+
+    std::vector<std::pair<EntityId, uint8_t>> changed;
+    world.ForEachDirty([&](EntityId id, uint8_t fields) { changed.emplace_back(id, fields); });
+    ASSERT_EQ(changed.size(), 1u);
+    EXPECT_EQ(changed[0].first, second);
+    EXPECT_EQ(changed[0].second, VelocityField | FuelField);
+}
+
+TEST(DeltaCodecTests, VarintAndZigZagRoundTrip) {
+    std::vector<uint8_t> buffer;
+    const int64_t values[] = {0, -1, 1, 63, -64, 300, -123456789, INT64_MAX, INT64_MIN};
+    for (int64_t value : values) {
+        WriteVarint(buffer, ZigZag(value));
+    }
+    EXPECT_EQ(buffer[0], 0);
+    EXPECT_EQ(buffer[1], 1);  // -1 -> 1: один байт
+    const uint8_t* data = buffer.data();
+    for (int64_t value : values) {
+        uint64_t raw;
+        ASSERT_TRUE(ReadVarint(data, buffer.data() + buffer.size(), raw));
+        EXPECT_EQ(UnZigZag(raw), value);
+    }
+}
+
+TEST(DeltaCodecTests, ClientFollowsServerWithDeltas) {
+    World server;
+    World client;
+    DeltaEncoder encoder;
+    DeltaDecoder decoder;
+    for (int i = 0; i < 100; ++i) {
+        server.AddShip(Vector(i, -i), i);
+    }
+    server.Ship(3).setVelocity(Vector(2, 1));
+    server.Ship(70).setVelocity(Vector(-1, 0.5));
+
+    for (uint64_t tick = 1; tick <= 5; ++tick) {
+        server.MoveShips();
+        ASSERT_TRUE(decoder.Apply(encoder.Encode(server, tick), client));
+        server.ClearDirty();
+    }
+    EXPECT_EQ(decoder.LastTick(), 5u);
+    ASSERT_EQ(client.Size(), server.Size());
+    for (EntityId id = 0; id < server.Size(); ++id) {
+        EXPECT_EQ(client.Ship(id).getPosition(), server.Ship(id).getPosition());
+        EXPECT_EQ(client.Ship(id).getVelocity(), server.Ship(id).getVelocity());
+        EXPECT_EQ(client.Ship(id).getRotation(), server.Ship(id).getRotation());
+    }
+
+    // Движутся два корабля: в пакете только их позиции
+    server.MoveShips();
+    const auto& packet = encoder.Encode(server, 6);
+    EXPECT_LT(packet.size(), 20u);
+    server.ClearDirty();
+    EXPECT_EQ(encoder.Encode(server, 7).size(), 2u);  // Только заголовок
+
+    // Удаления: номер 3 освобождается, номер 70 сразу выдается новому кораблю
+    server.RemoveShip(server.Handle(3));
+    server.RemoveShip(server.Handle(70));
+    EXPECT_EQ(server.AddShip(Vector(0, 0), 0), 70u);  // Все поля нулевые: клиент все равно создаст корабль
+    server.MoveShips();
+    ASSERT_TRUE(decoder.Apply(encoder.Encode(server, 8), client));
+    server.ClearDirty();
+    for (EntityId id = 0; id < server.Size(); ++id) {
+        ASSERT_EQ(client.IsAlive(id), server.IsAlive(id)) << "ship " << id;
+        if (server.IsAlive(id)) {
+            EXPECT_EQ(client.Ship(id).getPosition(), server.Ship(id).getPosition());
+            EXPECT_EQ(client.Ship(id).getVelocity(), server.Ship(id).getVelocity());
+        }
+    }
+    EXPECT_EQ(client.Count(), server.Count());
+
+    World late;
+    DeltaDecoder lateDecoder;
+    ASSERT_TRUE(lateDecoder.Apply(encoder.EncodeFull(server, 9), late));
+    EXPECT_EQ(late.Ship(70).getPosition(), server.Ship(70).getPosition());
+    EXPECT_FALSE(late.IsAlive(3));
+    EXPECT_EQ(late.Count(), server.Count());
+}
+
+TEST(DirectionTableTests, TablesMatchLibmAndAreExactOnQuarters) {
+    for (int i = 0; i < 360; ++i) {
+        double radians = i * M_PI / 180.0;
+        EXPECT_NEAR(DirectionTable<360>::Sin[i], std::sin(radians), 1e-15);
+        EXPECT_NEAR(DirectionTable<360>::Cos[i], std::cos(radians), 1e-15);
+    }
+    static_assert(DirectionTable<8>::Sin[2] == 1.0 && DirectionTable<8>::Cos[2] == 0.0);
+    static_assert(DirectionTable<8>::Sin[4] == 0.0 && DirectionTable<8>::Cos[4] == -1.0);
+    static_assert(DirectionTable<8>::Sin[1] == DirectionTable<8>::Cos[1]);
+    EXPECT_THROW(DirectionTables::Get(7), std::invalid_argument);
+}
+
+TEST(DirectionTableTests, DiscreteRotationWrapsAndRotatesVelocity) {
+    SpaceShip ship(Vector(0, 0), 0);
+    EXPECT_THROW(RotationHandler::Rotate(ship, DirectionSteps(1)), std::runtime_error);
+
+    ship.setDirectionsNumber(8);
+    RotationHandler::Rotate(ship, DirectionSteps(-3));
+    EXPECT_EQ(ship.getDirection(), 5);
+    EXPECT_EQ(ship.getRotation(), 225.0);
+
+    ship.setVelocity(Vector(10, 10));
+    RotateAndChangeVelocity turn(ship, DirectionSteps(2), Vector());
+    turn.Execute();
+    EXPECT_EQ(ship.getDirection(), 7);
+    EXPECT_EQ(ship.getVelocity(), Vector(-10, 10));  // Ровно, без погрешности cos(pi/2)
+
+    ship.setVelocity(Vector(3, 0));
+    Vector velocity = ship.getVelocity();
+    for (int i = 0; i < 8; ++i) {
+        velocity = RotationHandler::RotateVector(velocity, DirectionSteps(1), 8);
+    }
+    EXPECT_NEAR(velocity.X, 3.0, 1e-14);
+    EXPECT_NEAR(velocity.Y, 0.0, 1e-14);
+}
+
+TEST(DirectionTableTests, DegreeTurnInDiscreteModeUsesTable) {
+    SpaceShip ship(Vector(0, 0), 0);
+    ship.setDirectionsNumber(8);
+    ship.setVelocity(Vector(2, 0));
+    RotateAndChangeVelocity(ship, 50, Vector()).Execute();  // 50° округляется до одного шага
+    EXPECT_EQ(ship.getDirection(), 1);
+    Vector stepped = RotationHandler::RotateVector(Vector(2, 0), DirectionSteps(1), 8);
+    EXPECT_EQ(ship.getVelocity(), stepped);
+    RotateAndChangeVelocity(ship, 20, Vector()).Execute();  // Направление не меняется — скорость тоже
+    EXPECT_EQ(ship.getDirection(), 1);
+    EXPECT_EQ(ship.getVelocity(), stepped);
+
+    ComponentRegistry registry;
+    EntityId id = registry.Create();
+    registry.Add(id, VelocityComponent{Vector(2, 0)});
+    registry.Add(id, RotationComponent{0, 0, 8});
+    RotateAndChangeVelocity::RotateAll(registry, 50);
+    EXPECT_EQ(registry.Get<RotationComponent>(id).direction, 1);
+    EXPECT_EQ(registry.Get<VelocityComponent>(id).value, stepped);
+
+    World world;
+    EntityId turning = world.AddShip(Vector(0, 0), 0);
+    world.Ship(turning).setDirectionsNumber(8);
+    world.Ship(turning).setVelocity(Vector(2, 0));
+    CommandQueue queue;
+    queue.AddCommand(std::make_shared<RotateAndChangeVelocity>(world.Ref(turning), 50, Vector()));
+    queue.AddCommand(std::make_shared<RotateAndChangeVelocity>(world.Ref(turning), 70, Vector()));
+    TrajectoryPredictor predictor;
+    predictor.Predict(world, 3, queue);
+    queue.ProcessCommands();
+    EXPECT_EQ(predictor.Velocity(turning), world.Ship(turning).getVelocity());
+    for (size_t tick = 1; tick <= 3; ++tick) {
+        world.MoveShips();
+        EXPECT_EQ(predictor.At(tick, turning), world.Ship(turning).getPosition());
+    }
+}
+
+TEST(WorldSnapshotTests, HeldSnapshotIsNeverOverwritten) {
+    World world;
+    world.AddShip(Vector(1, 1), 0);
+    SnapshotBuffer buffer(2);
+    EXPECT_FALSE(buffer.Acquire());
+
+    EXPECT_TRUE(buffer.Publish(world, 1));
+    SnapshotView held = buffer.Acquire();
+    ASSERT_TRUE(held);
+    EXPECT_EQ(held->tick, 1u);
+
+    world.Ship(0).setPosition(Vector(2, 2));
+    EXPECT_TRUE(buffer.Publish(world, 2));
+    // Оба буфера заняты: последний опубликованный и удерживаемый читателем
+    EXPECT_FALSE(buffer.Publish(world, 3));
+    EXPECT_EQ(buffer.Skipped(), 1u);
+    EXPECT_EQ(held->ships[0].position, Vector(1, 1));
+    EXPECT_EQ(buffer.Acquire()->tick, 2u);
+
+    held.Release();
+    EXPECT_TRUE(buffer.Publish(world, 4));
+    EXPECT_EQ(buffer.Acquire()->tick, 4u);
+}
+
+TEST(WorldSnapshotTests, ReadersSeeConsistentTicks) {
+    World world;
+    for (int i = 0; i < 64; ++i) {
+        world.AddShip(Vector(0, i), 0);
+        world.Ship(i).setVelocity(Vector(1, 0));
+    }
+    SnapshotBuffer buffer;
+    std::atomic<bool> done{false};
+    std::atomic<int> torn{0};
+
+    std::thread reader([&] {
+        while (!done.load()) {
+            SnapshotView view = buffer.Acquire();
+            if (!view) {
+                continue;
+            }
+            for (const ShipState& ship : view->ships) {
+                if (ship.position.X != static_cast<double>(view->tick)) {
+                    ++torn;
+                }
+            }
+        }
+    });
+    for (uint64_t tick = 1; tick <= 2000; ++tick) {
+        world.MoveShips();
+        buffer.Publish(world, tick);
+    }
+    done = true;
+    reader.join();
+    EXPECT_EQ(torn.load(), 0);
+    EXPECT_EQ(buffer.Published() + buffer.Skipped(), 2000u);
+}
+
+TEST(CollisionTests, FastShipsDoNotTunnel) {
+    World world;
+    EntityId a = world.AddShip(Vector(0, 0), 0);
+    EntityId b = world.AddShip(Vector(5, 0), 0);
+    EntityId far = world.AddShip(Vector(0, 50), 0);
+    world.Ship(a).setVelocity(Vector(10, 0));
+    world.Ship(b).setVelocity(Vector(-10, 0));
+    world.Ship(far).setVelocity(Vector(10, 0));
+
+    CommandQueue queue;
+    CollisionDetector detector(1.0);
+    // Без проверки корабли поменялись бы местами: (10, 0) и (-5, 0)
+    ASSERT_EQ(detector.Step(world, queue), 1u);
+    const Collision& hit = detector.LastCollisions()[0];
+    EXPECT_EQ(hit.first, a);
+    EXPECT_EQ(hit.second, b);
+    EXPECT_DOUBLE_EQ(hit.time, 0.15);
+
+    queue.ProcessCommands();
+    EXPECT_DOUBLE_EQ(world.Ship(a).getPosition().X, 1.5);
+    EXPECT_DOUBLE_EQ(world.Ship(b).getPosition().X, 3.5);
+    EXPECT_EQ(world.Ship(far).getPosition(), Vector(10, 50));
+}
+
+TEST(CollisionTests, ShipStopsAtObstacle) {
+    World world;
+    EntityId ship = world.AddShip(Vector(0, 0), 0);
+    world.Ship(ship).setVelocity(Vector(10, 0));
+
+    CommandQueue queue;
+    CollisionDetector detector(0.5);
+    detector.AddObstacle(Vector(4, -1), Vector(5, 1));
+    ASSERT_EQ(detector.Step(world, queue), 1u);
+    EXPECT_TRUE(detector.LastCollisions()[0].obstacle);
+
+    queue.ProcessCommands();
+    EXPECT_DOUBLE_EQ(world.Ship(ship).getPosition().X, 3.5);
+}
+
+TEST(CollisionTests, ShipRemovedBeforeCollisionCommandRuns) {
+    World world;
+    EntityId a = world.AddShip(Vector(0, 0), 0);
+    EntityId b = world.AddShip(Vector(10, 0), 0);
+    EntityId ship = world.AddShip(Vector(0, 20), 0);
+    EntityId other = world.AddShip(Vector(0, 40), 0);
+    world.Ship(a).setVelocity(Vector(10, 0));
+    world.Ship(b).setVelocity(Vector(-10, 0));
+    world.Ship(ship).setVelocity(Vector(10, 0));
+    world.Ship(other).setVelocity(Vector(10, 0));
+
+    ParallelExecutor executor(4);
+    CommandQueue queue;
+    queue.SetParallelExecutor(&executor);
+    CollisionDetector detector(0.5);
+    detector.AddObstacle(Vector(4, 15), Vector(5, 45));
+    ASSERT_EQ(detector.Step(world, queue), 3u);
+
+    // Между обнаружением и выполнением удаляются корабль пары и корабль у препятствия
+    world.RemoveShip(world.Handle(a));
+    world.RemoveShip(world.Handle(ship));
+    EXPECT_NO_THROW(queue.ProcessCommands());  // Цель удаленного корабля не бросает вне обработчика
+    EXPECT_DOUBLE_EQ(world.Ship(other).getPosition().X, 3.5);
+    EXPECT_EQ(world.Ship(b).getPosition(), Vector(0, 0));  // Пара не обработана: первый корабль удален
+}
+
+TEST(CollisionTests, TouchingShipsFlyApart) {
+    World world;
+    EntityId a = world.AddShip(Vector(0, 0), 0);
+    EntityId b = world.AddShip(Vector(2, 0), 0);  // Касаются: сумма радиусов 2
+    EntityId ship = world.AddShip(Vector(3.5, 10), 0);  // На грани расширенного препятствия
+    world.Ship(a).setVelocity(Vector(-1, 0));
+    world.Ship(b).setVelocity(Vector(1, 0));
+    world.Ship(ship).setVelocity(Vector(-1, 1));
+
+    CommandQueue queue;
+    CollisionDetector detector(1.0);
+    detector.AddObstacle(Vector(4.5, 5), Vector(6, 15));
+    for (int tick = 0; tick < 3; ++tick) {
+        EXPECT_EQ(detector.Step(world, queue), 0u) << "tick " << tick;
+        queue.ProcessCommands();
+    }
+    EXPECT_EQ(world.Ship(a).getPosition(), Vector(-3, 0));
+    EXPECT_EQ(world.Ship(b).getPosition(), Vector(5, 0));
+    EXPECT_EQ(world.Ship(ship).getPosition(), Vector(0.5, 13));
+
+    // Касание со сближением — удар в начале шага
+    world.Ship(a).setPosition(Vector(0, 0));
+    world.Ship(b).setPosition(Vector(2, 0));
+    world.Ship(a).setVelocity(Vector(1, 0));
+    world.Ship(b).setVelocity(Vector(0, 0));
+    world.Ship(ship).setPosition(Vector(3.5, 10));
+    world.Ship(ship).setVelocity(Vector(1, 0));
+    ASSERT_EQ(detector.Step(world, queue), 2u);
+    EXPECT_EQ(detector.LastCollisions()[0].time, 0.0);
+    EXPECT_EQ(detector.LastCollisions()[1].time, 0.0);
+}
+
+TEST(JournalTests, ReplayReproducesFinalState) {
+    const std::string path = "journal_test.ssj";
+    World world;
+    EntityId first = world.AddShip(Vector(0, 0), 0);
+    EntityId second = world.AddShip(Vector(10, 10), 45);
+    world.Ship(first).setFuel(5);
+    world.Ship(second).setDirectionsNumber(8);
+
+    CommandQueue queue;
+    CommandJournal journal(world, 64);  // Маленький порог: запись идет через фоновый поток
+    ASSERT_TRUE(journal.Open(path));
+    queue.SetRecorder(&journal);
+
+    SpaceShip& a = world.Ship(first);
+    SpaceShip& b = world.Ship(second);
+    for (int tick = 0; tick < 50; ++tick) {
+        queue.AddCommand(std::make_shared<ChangeVelocityCommand>(a, Vector(1.5, -0.25 * tick)));
+        queue.AddCommand(std::make_shared<MoveWithFuelCommand>(a, 0.5));  // Топливо кончится на 10-м тике
+        queue.AddCommand(std::make_shared<RotateAndChangeVelocity>(b, DirectionSteps(tick % 3), Vector()));
+        queue.AddCommand(std::make_shared<MacroCommand>(std::vector<std::shared_ptr<Command>>{
+            std::make_shared<ChangeVelocityCommand>(b, Vector(0.1, 0.3)), std::make_shared<MoveCommand>(b)}));
+        queue.ProcessCommands();
+    }
+    journal.Close();
+    EXPECT_GT(journal.Records(), 200u);
+
+    World replayed;
+    JournalReplay replay;
+    ReplayResult result = replay.Run(path, replayed);
+    ASSERT_TRUE(result.ok);
+    EXPECT_EQ(result.records, journal.Records());
+    EXPECT_GT(result.failed, 0u);   // Нехватка топлива повторилась
+    EXPECT_GT(result.skipped, 0u);  // LogCommand
+    EXPECT_EQ(result.lastTick, 50u);
+    EXPECT_EQ(result.checksum, WorldChecksum(world));
+    EXPECT_EQ(replayed.Ship(first).getPosition(), a.getPosition());
+    EXPECT_EQ(replayed.Ship(second).getDirection(), b.getDirection());
+    std::remove(path.c_str());
+}
+
+TEST(JournalTests, ReplayMatchesGameLoopWorld) {
+    const std::string path = "journal_loop_test.ssj";
+    World world;
+    world.SetLazyMotion(true);
+    EntityId left = world.AddShip(Vector(0, 0), 0);
+    EntityId right = world.AddShip(Vector(30, 0.5), 0);
+    EntityId drifter = world.AddShip(Vector(0, 40), 0);
+    world.Ship(drifter).setVelocity(Vector(0.1, 0.3));  // Движется только шагами мира
+    world.Ship(left).setFuel(3);
+
+    CommandQueue queue;
+    CommandJournal journal(world, 64);
+    ASSERT_TRUE(journal.Open(path));
+    queue.SetRecorder(&journal);
+    CollisionDetector detector(1.0);
+    GameLoop loop(std::chrono::milliseconds(1));
+    LoopWorld loopWorld;
+    loopWorld.world = &world;
+    loopWorld.queue = &queue;
+    loopWorld.collisions = &detector;
+    loopWorld.recorder = &journal;
+    loopWorld.ingest = [&](uint64_t tick) {
+        if (tick == 1) {
+            queue.AddCommand(std::make_shared<ChangeVelocityCommand>(world.Ref(left), Vector(1.5, 0)));
+            queue.AddCommand(std::make_shared<ChangeVelocityCommand>(world.Ref(right), Vector(-1.5, 0)));
+        }
+        if (tick % 5 == 0) {
+            queue.AddCommand(std::make_shared<RotateAndChangeVelocity>(world.Ref(drifter), 7, Vector()));
+            queue.AddCommand(std::make_shared<MoveWithFuelCommand>(world.Ref(left), 1));
+        }
+    };
+    size_t collisions = 0;
+    loopWorld.broadcast = [&](uint64_t) { collisions += detector.LastCollisions().size(); };
+    loop.AddWorld(loopWorld);
+    for (int tick = 0; tick < 40; ++tick) {
+        loop.RunTick();
+        if (tick == 20) {
+            world.AddShip(Vector(5, 5), 0);  // Новый корабль попадает в журнал перед следующим шагом
+            world.Ship(3).setVelocity(Vector(-0.25, 0));
+        }
+        if (tick == 25) {
+            world.RemoveShip(world.Handle(right));  // Удаление тоже в журнале: повтор не двигает призрак
+        }
+        if (tick == 30) {
+            EXPECT_EQ(world.AddShip(Vector(-5, 20), 0), right);  // Номер выдан снова — новое состояние
+            world.Ship(right).setVelocity(Vector(0.5, 0));
+            world.RemoveShip(world.Handle(3));
+        }
+    }
+    journal.Close();
+    EXPECT_EQ(journal.Movements(), 40u);
+    EXPECT_GT(collisions, 0u);  // Столкновение выполнилось командой следующего тика и тоже в журнале
+
+    World replayed;
+    JournalReplay replay;
+    ReplayResult result = replay.Run(path, replayed);
+    ASSERT_TRUE(result.ok);
+    EXPECT_EQ(result.movements, 40u);
+    EXPECT_EQ(result.removals, 2u);
+    EXPECT_EQ(result.checksum, WorldChecksum(world));
+    EXPECT_EQ(replayed.Ship(drifter).getPosition(), world.Ship(drifter).getPosition());
+    EXPECT_EQ(replayed.Ship(right).getPosition(), world.Ship(right).getPosition());
+    EXPECT_FALSE(replayed.IsAlive(3));
+    std::remove(path.c_str());
+}
+
+TEST(SafeQueueTests, HighPriorityTasksJumpTheQueue) {
+    std::vector<int> order;
+    {
+        SafeQueue queue;
+        for (int i = 0; i < 3; ++i) {
+            queue.addTask([&order, i] { order.push_back(i); });
+        }
+        queue.addTask([&order] { order.push_back(100); }, TaskPriority::High);
+        EXPECT_EQ(queue.depth(), 4u);
+        EXPECT_EQ(queue.depth(TaskPriority::High), 1u);
+        queue.start();
+    }  // Деструктор дожидается выполнения оставшихся задач
+    EXPECT_EQ(order, (std::vector<int>{100, 0, 1, 2}));
+}
+
+TEST(SafeQueueTests, OverflowPolicies) {
+    std::vector<int> done;
+    {
+        SafeQueue queue(2, OverflowPolicy::Reject);
+        EXPECT_TRUE(queue.addTask([&done] { done.push_back(1); }));
+        EXPECT_TRUE(queue.addTask([&done] { done.push_back(2); }));
+        EXPECT_FALSE(queue.addTask([&done] { done.push_back(3); }));
+        EXPECT_TRUE(queue.addTask([&done] { done.push_back(4); }, TaskPriority::High));  // Управление проходит всегда
+        EXPECT_EQ(queue.rejectedCount(), 1u);
+        queue.start();
+    }
+    EXPECT_EQ(done, (std::vector<int>{4, 1, 2}));
+
+    done.clear();
+    {
+        SafeQueue queue(2, OverflowPolicy::DropOldest);
+        for (int i = 1; i <= 4; ++i) {
+            EXPECT_TRUE(queue.addTask([&done, i] { done.push_back(i); }));
+        }
+        EXPECT_EQ(queue.droppedCount(), 2u);
+        queue.start();
+    }
+    EXPECT_EQ(done, (std::vector<int>{3, 4}));
+
+    done.clear();
+    {
+        SafeQueue queue(2, OverflowPolicy::DropOldest);
+        EXPECT_TRUE(queue.addTask([&done] { done.push_back(1); }, TaskPriority::High));
+        EXPECT_TRUE(queue.addTask([&done] { done.push_back(2); }, TaskPriority::High));
+        EXPECT_FALSE(queue.addTask([&done] { done.push_back(3); }));  // Вытеснять нечего: задача отклоняется
+        EXPECT_EQ(queue.depth(), 2u);
+        EXPECT_EQ(queue.droppedCount(), 0u);
+        EXPECT_EQ(queue.rejectedCount(), 1u);
+        queue.start();
+    }
+    EXPECT_EQ(done, (std::vector<int>{1, 2}));
+
+    std::atomic<int> executed{0};
+    {
+        SafeQueue queue(2, OverflowPolicy::Block);
+        queue.start();
+        for (int i = 0; i < 100; ++i) {
+            EXPECT_TRUE(queue.addTask([&executed] { ++executed; }));
+            EXPECT_LE(queue.depth(), 2u);
+        }
+        queue.softStop();
+    }
+    EXPECT_EQ(executed.load(), 100);
+}
+
+TEST(SafeQueueTests, SpinThenParkNeverLosesWakeups) {
+    std::streambuf* log = std::cerr.rdbuf(nullptr);  // Сообщения об ожидании на каждую задачу
+    std::atomic<int> executed{0};
+    {
+        SafeQueue queue;
+        queue.setWaitStrategy(WaitStrategy::SpinThenPark);
+        queue.start();
+        // Паузы перебирают весь путь ожидания: кручение, уступку процессора, засыпание и моменты между ними.
+        // Задача, добавленная, пока поток решает уснуть, должна его разбудить
+        for (int i = 0; i < 400; ++i) {
+            auto pause = std::chrono::microseconds((i * 37) % 400);
+            auto until = std::chrono::steady_clock::now() + pause;
+            while (std::chrono::steady_clock::now() < until) {
+            }
+            queue.addTask([&executed] { executed.fetch_add(1); });
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+            while (executed.load() != i + 1 && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::yield();
+            }
+            if (executed.load() != i + 1) {
+                ADD_FAILURE() << "task " << i << " was not picked up";
+                break;
+            }
+        }
+
+        // Деструктор без остановки выполняет оставшиеся задачи
+        for (int i = 0; i < 1000; ++i) {
+            queue.addTask([&executed] { executed.fetch_add(1); });
+        }
+    }
+    std::cerr.rdbuf(log);
+    EXPECT_EQ(executed.load(), 1400);
+}
+
+TEST(GameLoopTests, RunsPhasesInOrderForEveryWorld) {
+    World first;
+    World second;
+    EntityId ship = first.AddShip(Vector(0, 0), 0);
+    first.Ship(ship).setVelocity(Vector(1, 0));
+    second.AddShip(Vector(0, 0), 0);
+    CommandQueue queue;
+    CollisionDetector detector;
+
+    std::vector<std::string> phases;
+    GameLoop loop(std::chrono::milliseconds(1));
+    loop.AddWorld(LoopWorld{&first, &queue, &detector,
+                            [&](uint64_t) {
+                                phases.push_back("ingest");
+                                queue.AddCommand(std::make_shared<ChangeVelocityCommand>(first.Ship(ship), Vector(2, 0)));
+                            },
+                            [&](uint64_t tick) { phases.push_back("broadcast " + std::to_string(tick)); }});
+    loop.AddWorld(LoopWorld{&second, nullptr, nullptr, nullptr, nullptr});
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(loop.Run(5), 5u);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(4));  // Дедлайны через 1 мс
+    EXPECT_EQ(phases.size(), 10u);
+    EXPECT_EQ(phases.back(), "broadcast 5");
+    EXPECT_EQ(first.Ship(ship).getPosition(), Vector(10, 0));  // Скорость меняется командой до шага движения
+
+    GameLoopStats stats = loop.Stats();
+    EXPECT_EQ(stats.ticks, 5u);
+    EXPECT_EQ(stats.phaseNs[static_cast<int>(TickPhase::Movement)].Count(), 5u);
+
+    const std::string path = "game_loop_test.prom";
+    ASSERT_TRUE(loop.WritePrometheus(path));
+    std::string text = readFile(path);
+    EXPECT_NE(text.find("spaceship_loop_ticks_total 5"), std::string::npos);
+    EXPECT_NE(text.find("spaceship_loop_phase_seconds_count{phase=\"collision\"} 5"), std::string::npos);
+    std::remove(path.c_str());
+}
+
+TEST(GameLoopTests, OverrunPolicies) {
+    auto run = [](CatchUpPolicy policy) {
+        GameLoop loop(std::chrono::milliseconds(2), policy, 1);
+        World world;
+        loop.AddWorld(LoopWorld{&world, nullptr, nullptr,
+                                [](uint64_t tick) {
+                                    if (tick == 2) {
+                                        std::this_thread::sleep_for(std::chrono::milliseconds(9));  // Опоздание на 4 тика
+                                    }
+                                },
+                                nullptr});
+        EXPECT_EQ(loop.Run(6), 6u);
+        return loop.Stats();
+    };
+
+    GameLoopStats skip = run(CatchUpPolicy::Skip);
+    EXPECT_GE(skip.overruns, 1u);
+    EXPECT_GE(skip.skippedTicks, 4u);
+
+    GameLoopStats catchUp = run(CatchUpPolicy::CatchUp);  // Догоняется не больше 1 тика
+    EXPECT_GE(catchUp.overruns, 1u);
+    EXPECT_GE(catchUp.skippedTicks, 2u);
+    EXPECT_LT(catchUp.skippedTicks, skip.skippedTicks);
+}
+
+TEST(GameLoopTests, CatchUpRunsAtMostMaxTicksAndKeepsEarlyStop) {
+    using namespace std::chrono;
+    GameLoop catchUp(milliseconds(2), CatchUpPolicy::CatchUp, 2);
+    EXPECT_EQ(catchUp.TicksToSkip(microseconds(500)), 0u);  // Пропущен один дедлайн: догоняется
+    EXPECT_EQ(catchUp.TicksToSkip(milliseconds(3)), 0u);    // Два — оба догоняются подряд
+    EXPECT_EQ(catchUp.TicksToSkip(milliseconds(9)), 3u);    // Пять — два догоняются, три пропускаются
+    GameLoop skip(milliseconds(2), CatchUpPolicy::Skip, 2);
+    EXPECT_EQ(skip.TicksToSkip(microseconds(500)), 1u);
+    EXPECT_EQ(skip.TicksToSkip(milliseconds(9)), 5u);
+
+    World world;
+    catchUp.AddWorld(LoopWorld{&world});
+    catchUp.Stop();  // До Run: не теряется
+    EXPECT_EQ(catchUp.Run(3), 0u);
+    EXPECT_EQ(catchUp.Run(3), 3u);
+}
+
+TEST(AffinityTests, ParsesCpuListsAndPinsWorkers) {
+    EXPECT_EQ(CpuTopology::ParseCpuList("0-3,8,10-11\n"), (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_FALSE(CpuTopology::Nodes().empty());
+
+    std::vector<std::vector<int>> cpuSets = CpuTopology::WorkerCpuSets(3);
+    ParallelExecutor executor(3, cpuSets);
+    std::vector<int> cpus(3, -2);
+    executor.RunPerThread([&](size_t thread) { cpus[thread] = CpuTopology::CurrentCpu(); });
+    for (size_t thread = 1; thread < 3; ++thread) {
+        ASSERT_TRUE(executor.IsPinned(thread));
+        EXPECT_EQ(cpus[thread], cpuSets[thread][0]);  // Каждый поток выполнил свое задание на своем процессоре
+    }
+}
+
+TEST(DevirtualizationTests, ConcreteTypesTakeTemplatePath) {
+    static_assert(ConcreteMovable<SpaceShip>);
+    static_assert(ConcreteRotatable<SpaceShip>);
+    static_assert(!ConcreteMovable<Movable>);
+
+    SpaceShip ship(Vector(1, 1), 10);
+    ship.setVelocity(Vector(2, 3));
+    static_assert(std::is_same_v<decltype(Movement::Move(ship)), SpaceShip&>);
+    static_assert(std::is_same_v<decltype(Movement::Move(static_cast<Movable&>(ship))), Movable&>);
+
+    Movement::Move(ship);
+    Movement::Move(static_cast<Movable&>(ship));
+    RotationHandler::Rotate(ship, 20);
+    RotationHandler::Rotate(static_cast<Rotatable&>(ship), 30);
+    EXPECT_EQ(ship.getPosition(), Vector(5, 7));
+    EXPECT_EQ(ship.getRotation(), 60.0);
+}
+
+TEST(ShipHandleTests, StaleHandlesFailAndStorageStaysDense) {
+    World world;
+    EntityId first = world.AddShip(Vector(1, 1), 0);
+    EntityId second = world.AddShip(Vector(2, 2), 0);
+    EntityId third = world.AddShip(Vector(3, 3), 0);
+    ShipHandle removed = world.Handle(second);
+    auto burn = std::make_shared<BurnFuelCommand>(world.Ref(second), 1);
+    auto turn = std::make_shared<ChangeVelocityCommand>(world.Ref(third), Vector(0, 1));
+
+    EXPECT_TRUE(world.RemoveShip(removed));
+    EXPECT_FALSE(world.RemoveShip(removed));
+    EXPECT_EQ(world.Count(), 2u);
+    EXPECT_EQ(world.Resolve(removed), nullptr);
+    EXPECT_EQ(burn->GetTarget(), nullptr);
+    EXPECT_THROW(burn->Execute(), std::out_of_range);
+
+    // Последний корабль переехал на место удаленного: его хэндл и подписка на изменения сохранились
+    world.ClearDirty();
+    turn->Execute();
+    EXPECT_EQ(world.Ship(third).getVelocity(), Vector(0, 1));
+    EXPECT_TRUE(world.IsDirty(third, VelocityField));
+    EntityId id;
+    ASSERT_TRUE(world.IdOf(&world.Ship(third), id));
+    EXPECT_EQ(id, third);
+
+    // Номер выдается снова, но с новым поколением
+    EXPECT_EQ(world.AddShip(Vector(9, 9), 0), second);
+    EXPECT_EQ(world.Resolve(removed), nullptr);
+    EXPECT_NE(world.Handle(second), removed);
+    world.MoveShips();
+    EXPECT_EQ(world.Ship(first).getPosition(), Vector(1, 1));
+    EXPECT_EQ(world.Ship(third).getPosition(), Vector(3, 4));
+
+    // Устаревшая команда в очереди логируется, а не повторяется
+    CommandQueue queue;
+    queue.AddCommand(burn);
+    std::stringstream errors;
+    auto* old = std::cerr.rdbuf(errors.rdbuf());
+    queue.ProcessCommands();
+    std::cerr.rdbuf(old);
+    EXPECT_NE(errors.str().find("Stale ship handle"), std::string::npos);
+    EXPECT_EQ(errors.str().find("Retry"), std::string::npos);
+}
+
+TEST(LazyMotionTests, MatchesStepByStepMovementExactly) {
+    World eager;
+    World lazy;
+    lazy.SetLazyMotion(true);
+    const Vector velocities[] = {Vector(3, -2), Vector(0.25, 0.5), Vector(0.1, 0.3), Vector(0, 0), Vector(1e15, 1)};
+    for (World* world : {&eager, &lazy}) {
+        for (int i = 0; i < 5; ++i) {
+            world->Ship(world->AddShip(Vector(i * 10 + 0.5, -i), 0)).setVelocity(velocities[i]);
+        }
+    }
+    EXPECT_TRUE(lazy.Ship(0).hasLazyMotion());
+    EXPECT_TRUE(lazy.Ship(1).hasLazyMotion());
+    EXPECT_FALSE(lazy.Ship(2).hasLazyMotion());  // 0.1 не представимо точно: сумма шагов != произведение
+    EXPECT_FALSE(lazy.Ship(4).hasLazyMotion());  // Выходит за точность мантиссы
+
+    auto compare = [&] {
+        for (EntityId id = 0; id < eager.Size(); ++id) {
+            Vector expected = eager.Ship(id).getPosition();
+            Vector actual = lazy.Ship(id).getPosition();
+            EXPECT_EQ(std::memcmp(&expected, &actual, sizeof(Vector)), 0) << "ship " << id;
+        }
+    };
+    for (int tick = 0; tick < 100; ++tick) {
+        for (World* world : {&eager, &lazy}) {
+            world->ClearDirty();
+            world->MoveShips();
+            if (tick == 40) {
+                RotateAndChangeVelocity(world->Ref(0), 90, Vector()).Execute();
+                ChangeVelocityCommand(world->Ref(1), Vector(-1, 0)).Execute();
+                MoveCommand(world->Ship(3)).Execute();
+            }
+        }
+        EXPECT_TRUE(lazy.IsDirty(1, PositionField));
+        compare();
+    }
+    EXPECT_FALSE(lazy.IsDirty(3, PositionField));  // Стоящий корабль не меняется и не отмечается
+}
+
+TEST(ActiveSetTests, OnlyMovingShipsAreStepped) {
+    World world;
+    for (int i = 0; i < 1000; ++i) {
+        world.AddShip(Vector(i, 0), 0);
+    }
+    EXPECT_EQ(world.SteppingCount(), 0u);
+    world.Ship(10).setVelocity(Vector(1, 1));
+    world.Ship(20).setVelocity(Vector(0.1, 0));
+    RotateAndChangeVelocity(world.Ref(30), 90, Vector()).Execute();  // Поворот без скорости: корабль стоит
+    EXPECT_EQ(world.SteppingCount(), 2u);
+    EXPECT_EQ(world.Ship(10).getMotionMode(), MotionMode::Stepping);
+    EXPECT_EQ(world.Ship(30).getMotionMode(), MotionMode::Idle);
+
+    world.ClearDirty();
+    world.MoveShips();
+    EXPECT_EQ(world.Ship(10).getPosition(), Vector(11, 1));
+    EXPECT_EQ(world.Ship(20).getPosition(), Vector(20.1, 0));
+    EXPECT_FALSE(world.IsDirty(30, PositionField));
+
+    world.Ship(10).setVelocity(Vector(0, 0));
+    EXPECT_TRUE(world.RemoveShip(world.Handle(20)));
+    world.Ship(999).setVelocity(Vector(-1, 0));  // Переехал на место удаленного, в множестве по номеру
+    EXPECT_EQ(world.SteppingCount(), 1u);
+    world.MoveShips();
+    EXPECT_EQ(world.Ship(10).getPosition(), Vector(11, 1));
+    EXPECT_EQ(world.Ship(999).getPosition(), Vector(998, 0));
+
+    world.SetLazyMotion(true);  // Целочисленная скорость: корабль летит по инерции и уходит из множества
+    EXPECT_EQ(world.SteppingCount(), 0u);
+    EXPECT_EQ(world.Ship(999).getMotionMode(), MotionMode::Coasting);
+}
+
+TEST(CoalescerTests, SameFinalStateWithFewerQueueEntries) {
+    const std::string path = "coalescer_test.ssj";
+    World plain;
+    World coalesced;
+    CommandQueue plainQueue;
+    CommandQueue queue;
+    CommandCoalescer coalescer(queue);
+    CommandJournal journal(coalesced);
+    ASSERT_TRUE(journal.Open(path));
+    queue.SetRecorder(&journal);
+    for (World* world : {&plain, &coalesced}) {
+        world->Ship(world->AddShip(Vector(0, 0), 0)).setFuel(4);
+        world->Ship(world->AddShip(Vector(5, 5), 10)).setVelocity(Vector(1, 0));
+    }
+
+    std::stringstream errors;
+    auto* old = std::cerr.rdbuf(errors.rdbuf());
+    for (int tick = 0; tick < 5; ++tick) {
+        auto send = [&](auto make) {
+            plainQueue.AddCommand(make(plain));
+            coalescer.AddCommand(make(coalesced));
+        };
+        send([&](World& w) { return std::make_shared<ChangeVelocityCommand>(w.Ref(0), Vector(1, tick)); });
+        send([&](World& w) { return std::make_shared<RotateAndChangeVelocity>(w.Ref(1), 33.3, Vector()); });
+        send([&](World& w) { return std::make_shared<ChangeVelocityCommand>(w.Ref(0), Vector(0.5, -tick)); });
+        send([&](World& w) { return std::make_shared<BurnFuelCommand>(w.Ref(0), 0.75); });
+        send([&](World& w) { return std::make_shared<BurnFuelCommand>(w.Ref(0), 0.5); });  // Топлива не хватит
+        send([&](World& w) { return std::make_shared<RotateAndChangeVelocity>(w.Ref(1), 12.5, Vector()); });
+        send([&](World& w) { return std::make_shared<MoveCommand>(w.Ship(1)); });
+        send([&](World& w) { return std::make_shared<RotateAndChangeVelocity>(w.Ref(1), -7, Vector()); });
+        coalescer.Flush();
+        plainQueue.ProcessCommands();
+        queue.ProcessCommands();
+        plain.MoveShips();
+        coalesced.MoveShips();
+    }
+    std::cerr.rdbuf(old);
+    journal.Close();
+
+    for (EntityId id = 0; id < 2; ++id) {
+        EXPECT_EQ(coalesced.Ship(id).getPosition(), plain.Ship(id).getPosition());
+        EXPECT_EQ(coalesced.Ship(id).getVelocity(), plain.Ship(id).getVelocity());
+        EXPECT_EQ(coalesced.Ship(id).getRotation(), plain.Ship(id).getRotation());
+        EXPECT_EQ(coalesced.Ship(id).getFuel(), plain.Ship(id).getFuel());
+    }
+    EXPECT_EQ(coalescer.Received(), 40u);
+    EXPECT_EQ(coalescer.Superseded(), 5u);  // Первая скорость каждого тика
+    EXPECT_EQ(coalescer.Merged(), 10u);     // Второе сжигание и второй поворот до MoveCommand
+    EXPECT_EQ(coalescer.Elided(), 15u);
+
+    // Собранные записи журналируются целиком, ошибки вложенных команд видны при повторе
+    World replayed;
+    ReplayResult result = JournalReplay().Run(path, replayed);
+    ASSERT_TRUE(result.ok);
+    EXPECT_GT(result.failed, 0u);
+    EXPECT_EQ(replayed.Ship(0).getFuel(), plain.Ship(0).getFuel());
+    std::remove(path.c_str());
+}
+
+// Подсчет повторов, поставленных обработчиком исключений
+struct RetryCounter : CommandRecorder {
+    size_t retries = 0;
+    void Record(uint64_t, const Command& cmd) override {
+        retries += dynamic_cast<const RetryCommand*>(&cmd) != nullptr;
+    }
+};
+
+TEST(CoalescerTests, ParallelFailuresReachHandlerAfterLanes) {
+    const EntityId ships = 32;
+    World plain;
+    World coalesced;
+    for (EntityId i = 0; i < ships; ++i) {
+        plain.Ship(plain.AddShip(Vector(i, 0), 0)).setFuel(static_cast<double>(i % 4));
+        coalesced.Ship(coalesced.AddShip(Vector(i, 0), 0)).setFuel(static_cast<double>(i % 4));
+    }
+    CommandQueue plainQueue;
+    RetryCounter plainRetries;
+    plainQueue.SetRecorder(&plainRetries);
+    ParallelExecutor executor(4);
+    CommandQueue queue;
+    queue.SetParallelExecutor(&executor);
+    RetryCounter retries;
+    queue.SetRecorder(&retries);
+    CommandCoalescer coalescer(queue);
+
+    for (int round = 0; round < 3; ++round) {
+        for (EntityId i = 0; i < ships; ++i) {
+            // Второе сжигание сливается с первым в одну запись; у части кораблей топлива не хватит
+            for (double amount : {1.0, 0.5}) {
+                plainQueue.AddCommand(std::make_shared<BurnFuelCommand>(plain.Ref(i), amount));
+                coalescer.AddCommand(std::make_shared<BurnFuelCommand>(coalesced.Ref(i), amount));
+            }
+        }
+        coalescer.Flush();
+        plainQueue.ProcessCommands();
+        queue.ProcessCommands();
+    }
+
+    EXPECT_GT(coalescer.Merged(), 0u);
+    EXPECT_GT(retries.retries, 0u);
+    EXPECT_EQ(retries.retries, plainRetries.retries);  // Каждая ошибка вложенной команды обработана
+    for (EntityId i = 0; i < ships; ++i) {
+        EXPECT_EQ(coalesced.Ship(i).getFuel(), plain.Ship(i).getFuel()) << "ship " << i;
+    }
+}
+
+TEST(CoalescerTests, RemovedShipDoesNotMergeWithShipMovedIntoItsPlace) {
+    World world;
+    for (EntityId i = 0; i < 3; ++i) {
+        world.Ship(world.AddShip(Vector(i, 0), 0)).setFuel(2);
+    }
+    CommandQueue queue;
+    CommandCoalescer coalescer(queue);
+
+    const SpaceShip* removed = &world.Ship(0);
+    coalescer.AddCommand(std::make_shared<ChangeVelocityCommand>(world.Ref(0), Vector(1, 0)));
+    coalescer.AddCommand(std::make_shared<BurnFuelCommand>(world.Ref(0), 1));
+    world.RemoveShip(world.Handle(0));
+    ASSERT_EQ(&world.Ship(2), removed);  // Корабль 2 переехал на место удаленного
+    coalescer.AddCommand(std::make_shared<BurnFuelCommand>(world.Ref(2), 1));
+    coalescer.AddCommand(std::make_shared<ChangeVelocityCommand>(world.Ref(2), Vector(0, 1)));
+    world.AddShip(Vector(9, 9), 0);  // Номер 0 выдан снова; рост массива тоже переносит корабли
+    coalescer.AddCommand(std::make_shared<BurnFuelCommand>(world.Ref(2), 0.5));
+
+    EXPECT_EQ(coalescer.Merged(), 0u);
+    EXPECT_EQ(coalescer.Superseded(), 0u);
+    EXPECT_EQ(coalescer.Flush(), 5u);
+    std::stringstream errors;
+    auto* old = std::cerr.rdbuf(errors.rdbuf());
+    queue.ProcessCommands();  // Команды удаленного корабля — устаревший хэндл, в журнал ошибок
+    std::cerr.rdbuf(old);
+
+    EXPECT_EQ(world.Ship(2).getVelocity(), Vector(0, 1));
+    EXPECT_EQ(world.Ship(2).getFuel(), 0.5);
+}
+
+TEST(ComponentTests, SparseSetJoinsOnlyMatchingEntities) {
+    ComponentRegistry registry;
+    EntityId asteroid = registry.Create();
+    EntityId ship = registry.Create();
+    EntityId probe = registry.Create();
+    registry.Add(asteroid, PositionComponent{Vector(0, 0)});
+    registry.Add(ship, PositionComponent{Vector(10, 10)});
+    registry.Add(ship, VelocityComponent{Vector(1, 2)});
+    registry.Add(ship, FuelComponent{1});
+    registry.Add(probe, VelocityComponent{Vector(5, 5)});  // Без положения: системой движения не сдвигается
+    registry.Add(probe, PositionComponent{Vector(0, 0)});
+    registry.Remove<PositionComponent>(asteroid);  // Последний элемент переносится на место удаленного
+    registry.Add(asteroid, PositionComponent{Vector(7, 7)});
+
+    Movement::MoveAll(registry);
+    EXPECT_EQ(registry.Get<PositionComponent>(asteroid).value, Vector(7, 7));
+    EXPECT_EQ(registry.Get<PositionComponent>(ship).value, Vector(11, 12));
+    EXPECT_EQ(registry.Get<PositionComponent>(probe).value, Vector(5, 5));
+
+    std::vector<EntityId> lacking;
+    EXPECT_EQ(MoveWithFuelCommand::MoveAll(registry, 1, &lacking), 1u);  // У зонда нет топлива — не участвует
+    EXPECT_EQ(MoveWithFuelCommand::MoveAll(registry, 1, &lacking), 0u);
+    EXPECT_EQ(lacking, std::vector<EntityId>{ship});
+    EXPECT_EQ(registry.Get<PositionComponent>(ship).value, Vector(12, 14));
+
+    registry.Destroy(ship);
+    EXPECT_FALSE(registry.Has<VelocityComponent>(ship));
+    EXPECT_EQ(registry.Create(), ship);  // Номер переиспользуется
+    EXPECT_FALSE(registry.Has<PositionComponent>(ship));
+}
+
+TEST(ComponentTests, SystemsMatchShipCommands) {
+    SpaceShip ship(Vector(3, 4), 30);
+    ship.setVelocity(Vector(2, 1));
+    ship.setFuel(5);
+    ComponentRegistry registry;
+    EntityId id = registry.Create();
+    registry.Add(id, PositionComponent{Vector(3, 4)});
+    registry.Add(id, VelocityComponent{Vector(2, 1)});
+    registry.Add(id, RotationComponent{30});
+    registry.Add(id, FuelComponent{5});
+
+    RotateAndChangeVelocity(ship, 45, Vector()).Execute();
+    RotateAndChangeVelocity::RotateAll(registry, 45);
+    BurnFuelCommand(ship, 2).Execute();
+    EXPECT_EQ(BurnFuelCommand::BurnAll(registry, 2), 1u);
+    MoveWithFuelCommand(ship, 1).Execute();
+    MoveWithFuelCommand::MoveAll(registry, 1);
+
+    EXPECT_EQ(registry.Get<PositionComponent>(id).value, ship.getPosition());
+    EXPECT_EQ(registry.Get<VelocityComponent>(id).value, ship.getVelocity());
+    EXPECT_EQ(registry.Get<RotationComponent>(id).angle, ship.getRotation());
+    EXPECT_EQ(registry.Get<FuelComponent>(id).amount, ship.getFuel());
+
+    std::vector<EntityId> lacking;
+    EXPECT_EQ(CheckFuelCommand::CheckAll(registry, 3, lacking), 1u);
+    EXPECT_THROW(CheckFuelCommand(ship, 3).Execute(), std::runtime_error);
+
+    ship.setDirectionsNumber(8);  // 75 градусов округляются до направления 2
+    ASSERT_EQ(ship.getDirection(), 2);
+    registry.Get<RotationComponent>(id) = RotationComponent{90, 2, 8};
+    RotateAndChangeVelocity(ship, DirectionSteps(3), Vector()).Execute();
+    RotateAndChangeVelocity::RotateAll(registry, DirectionSteps(3));
+    EXPECT_EQ(registry.Get<RotationComponent>(id).direction, ship.getDirection());
+    EXPECT_EQ(registry.Get<VelocityComponent>(id).value, ship.getVelocity());
+}
+
+TEST(ComponentTests, ShipFuelStartsAtZero) {
+    SpaceShip ship(Vector(0, 0), 0);
+    EXPECT_EQ(ship.getFuel(), 0.0);
+}
+
+TEST(CommandScriptTests, MatchesMacroCommand) {
+    SpaceShip scripted(Vector(3, 4), 30);
+    SpaceShip macro(Vector(3, 4), 30);
+    for (SpaceShip* ship : {&scripted, &macro}) {
+        ship->setVelocity(Vector(2, 1));
+        ship->setFuel(10);
+    }
+    CompiledScript script = ScriptCompiler::Compile(R"(
+        # Разворот и три шага с топливом
+        check_fuel 3
+        rotate 45
+        repeat 3
+            move_with_fuel 1
+        end
+        velocity 0.5 -1
+        move
+    )");
+    EXPECT_GT(ScriptInterpreter::Run(script, scripted), 0u);
+
+    MacroCommand({std::make_shared<CheckFuelCommand>(macro, 3),
+                  std::make_shared<RotateAndChangeVelocity>(macro, 45, Vector()),
+                  std::make_shared<MoveWithFuelCommand>(macro, 1), std::make_shared<MoveWithFuelCommand>(macro, 1),
+                  std::make_shared<MoveWithFuelCommand>(macro, 1),
+                  std::make_shared<ChangeVelocityCommand>(macro, Vector(0.5, -1))})
+        .Execute();
+    Movement::Move(macro);
+
+    EXPECT_EQ(scripted.getPosition(), macro.getPosition());
+    EXPECT_EQ(scripted.getVelocity(), macro.getVelocity());
+    EXPECT_EQ(scripted.getRotation(), macro.getRotation());
+    EXPECT_EQ(scripted.getFuel(), macro.getFuel());
+}
+
+TEST(CommandScriptTests, ConditionsLoopsAndVariables) {
+    SpaceShip ship(Vector(0, 0), 0);
+    ship.setFuel(5);
+    CompiledScript script = ScriptCompiler::Compile(R"(
+        set step 1
+        while fuel >= step
+            burn step
+            add step 1
+        end
+        if fuel < 1
+            velocity 1 0
+        else
+            velocity 0 1
+        end
+        set n 2.5
+        repeat n
+            move
+        end
+        repeat 0
+            move
+        end
+    )");
+    ScriptInterpreter::Run(script, ship);
+    EXPECT_EQ(ship.getFuel(), 2.0);  // Сожжено 1 + 2, на 3 топлива не хватило
+    EXPECT_EQ(ship.getVelocity(), Vector(0, 1));
+    EXPECT_EQ(ship.getPosition(), Vector(0, 2));  // repeat 2.5 — два шага, repeat 0 — ни одного
+}
+
+TEST(CommandScriptTests, VariableSetOnlyInSkippedBranchIsZero) {
+    SpaceShip ship(Vector(0, 0), 0);
+    ship.setFuel(10);
+    CompiledScript dirty = ScriptCompiler::Compile("set v 3\nburn v");  // Оставляет на стеке ненулевой регистр
+    CompiledScript script = ScriptCompiler::Compile(R"(
+        if fuel > 100
+            set v 1
+        end
+        burn v
+    )");
+    ScriptInterpreter::Run(dirty, ship);
+    EXPECT_EQ(ship.getFuel(), 7.0);
+    ScriptInterpreter::Run(script, ship);
+    EXPECT_EQ(ship.getFuel(), 7.0);
+}
+
+TEST(CommandScriptTests, ErrorsStopScript) {
+    SpaceShip ship(Vector(0, 0), 0);
+    ship.setFuel(1);
+    auto script = std::make_shared<const CompiledScript>(ScriptCompiler::Compile("burn 1\ncheck_fuel 1\nmove"));
+    ship.setVelocity(Vector(1, 1));
+    ScriptCommand command(script, ship);
+    EXPECT_THROW(command.Execute(), std::runtime_error);
+    EXPECT_EQ(ship.getFuel(), 0.0);  // Команды до ошибки выполнены, после — нет
+    EXPECT_EQ(ship.getPosition(), Vector(0, 0));
+    EXPECT_EQ(command.GetTarget(), &ship);
+
+    CompiledScript endless = ScriptCompiler::Compile("while 0 < 1\nmove\nend");
+    EXPECT_THROW(ScriptInterpreter::Run(endless, ship, 1000), std::range_error);
+
+    EXPECT_THROW(ScriptCompiler::Compile("repeat 2\nmove"), std::invalid_argument);
+    EXPECT_THROW(ScriptCompiler::Compile("burn unknown"), std::invalid_argument);
+    EXPECT_THROW(ScriptCompiler::Compile("else"), std::invalid_argument);
+    EXPECT_THROW(ScriptCompiler::Compile("velocity 1"), std::invalid_argument);
+    EXPECT_THROW(ScriptCompiler::Compile("jump 3"), std::invalid_argument);
+    EXPECT_THROW(ScriptCompiler::Compile("set fuel 3"), std::invalid_argument);
+    EXPECT_THROW(ScriptCompiler::Compile("add n 1"), std::invalid_argument);
+}
+
+TEST(TrajectoryPredictorTests, MatchesWorldSteps) {
+    World world;
+    EntityId drifting = world.AddShip(Vector(1, 2), 0);
+    EntityId turning = world.AddShip(Vector(-3, 0.5), 0);
+    EntityId removed = world.AddShip(Vector(9, 9), 0);
+    EntityId discrete = world.AddShip(Vector(0, 0), 0);
+    world.Ship(drifting).setVelocity(Vector(0.1, -0.3));
+    world.Ship(turning).setVelocity(Vector(1, 0));
+    world.Ship(discrete).setDirectionsNumber(8);
+    world.Ship(discrete).setVelocity(Vector(2, 0));
+    world.RemoveShip(world.Handle(removed));
+
+    CommandQueue queue;
+    queue.AddCommand(std::make_shared<ChangeVelocityCommand>(world.Ref(turning), Vector(0.5, 0.25)));
+    queue.AddCommand(std::make_shared<RotateAndChangeVelocity>(world.Ref(turning), 30, Vector()));
+    queue.AddCommand(std::make_shared<MacroCommand>(std::vector<std::shared_ptr<Command>>{
+        std::make_shared<RotateAndChangeVelocity>(world.Ref(discrete), DirectionSteps(3), Vector())}));
+    // Проверка топлива бросит исключение: макрокоманда остановится, последняя скорость не применится
+    queue.AddCommand(std::make_shared<MacroCommand>(std::vector<std::shared_ptr<Command>>{
+        std::make_shared<ChangeVelocityCommand>(world.Ref(drifting), Vector(0.2, 0.1)),
+        std::make_shared<CheckFuelCommand>(world.Ref(drifting), 5),
+        std::make_shared<ChangeVelocityCommand>(world.Ref(drifting), Vector(9, 9))}));
+
+    const size_t ticks = 20;
+    TrajectoryPredictor predictor;
+    predictor.Predict(world, ticks, queue);
+    ASSERT_EQ(predictor.Ticks(), ticks);
+    ASSERT_EQ(predictor.Ships(), world.Size());
+    EXPECT_EQ(world.Ship(turning).getVelocity(), Vector(1, 0));  // Живое состояние не меняется
+    EXPECT_EQ(predictor.At(ticks, removed), Vector(0, 0));
+    EXPECT_EQ(predictor.Velocity(drifting), Vector(0.2, 0.1));
+
+    std::stringstream errors;
+    auto* old = std::cerr.rdbuf(errors.rdbuf());
+    queue.ProcessCommands();
+    std::cerr.rdbuf(old);
+    for (size_t tick = 1; tick <= ticks; ++tick) {
+        world.MoveShips();
+        for (EntityId id : {drifting, turning, discrete}) {
+            EXPECT_EQ(predictor.At(tick, id), world.Ship(id).getPosition()) << "tick " << tick << " ship " << id;
+        }
+    }
+    EXPECT_EQ(predictor.Velocity(discrete), world.Ship(discrete).getVelocity());
+
+    // Повторный вызов переиспользует буферы
+    const double* row = predictor.X(1);
+    predictor.Predict(world, ticks);
+    EXPECT_EQ(predictor.X(1), row);
+    EXPECT_EQ(predictor.At(1, drifting), world.Ship(drifting).getPosition() + world.Ship(drifting).getVelocity());
+    EXPECT_EQ(world.Ship(drifting).getVelocity(), Vector(0.2, 0.1));
+}
+
+TEST(FuelTests, ConcurrentBurnersNeverOverspend) {
+    const int threadsNumber = 32;
+    const int attempts = 2000;
+    SpaceShip ship(Vector(0, 0), 0);
+    ship.setFuel(10000.5);
+    const int64_t initial = ship.getFuelUnits();
+
+    std::atomic<int64_t> burnedUnits{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadsNumber; ++t) {
+        threads.emplace_back([&, t] {
+            // Половина потоков — команды, половина — прямой вызов с другой порцией
+            double amount = t % 2 == 0 ? 1 : 0.25;
+            BurnFuelCommand burn(ship, amount);
+            for (int i = 0; i < attempts; ++i) {
+                if (t % 2 == 0) {
+                    try {
+                        burn.Execute();
+                    } catch (const std::runtime_error&) {
+                        continue;
+                    }
+                } else if (!ship.tryBurnFuel(amount)) {
+                    continue;
+                }
+                burnedUnits.fetch_add(SpaceShip::toFuelUnits(amount));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_GE(ship.getFuelUnits(), 0);
+    EXPECT_EQ(initial - ship.getFuelUnits(), burnedUnits.load());  // Ни одна порция не списана дважды
+    EXPECT_LT(ship.getFuel(), 1.0);  // Спрос (40000) больше запаса: остаток меньше большей порции
+}
+
+TEST(FuelTests, FixedPointFuel) {
+    SpaceShip ship(Vector(0, 0), 0);
+    ship.setFuel(3.5);
+    EXPECT_EQ(ship.getFuelUnits(), static_cast<int64_t>(3.5 * SpaceShip::FuelScale));
+    EXPECT_TRUE(ship.hasFuel(3.5));
+    EXPECT_FALSE(ship.tryBurnFuel(4));
+    EXPECT_EQ(ship.getFuel(), 3.5);  // Неудачная попытка не меняет запас
+    EXPECT_THROW(MoveWithFuelCommand(ship, 4).Execute(), std::runtime_error);
+    EXPECT_TRUE(ship.tryBurnFuel(3.5));
+    EXPECT_EQ(ship.getFuel(), 0.0);
+
+    ship.setFuel(0.1);  // Не двоичная дробь: хранится с точностью до единицы фиксированной точки
+    EXPECT_NEAR(ship.getFuel(), 0.1, 1 / SpaceShip::FuelScale);
+    EXPECT_THROW(ship.setFuel(1e20), std::out_of_range);
+
+    SpaceShip copy(ship);
+    EXPECT_EQ(copy.getFuelUnits(), ship.getFuelUnits());
+}
+
+TEST(AdapterGeneratorTests, ParsesAllInterfaces) {
+    const std::string header = R"(
+        #pragma once
+        #include "vector.h"
+        /* class Commented { public: virtual void hidden() = 0; }; */
+        class Shape {
+        public:
+            virtual double area() const = 0;  // class Fake { virtual void f() = 0; };
+            virtual Shape& scale(double factor, const std::string& = "x") = 0;
+            virtual void reset(int, std::map<int, int> table) = 0;
+            virtual ~Shape() = default;
+        private:
+            virtual void hidden() = 0;
+        };
+        struct Point {
+            int x = 0;
+            explicit Point(int x) : x(x) {}
+            virtual void draw() {}
+        };
+        enum class Mode { A, B };
+        struct Named {
+            virtual std::string name() const = 0;
+        };
+    )";
+    std::vector<InterfaceInfo> interfaces = InterfaceParser::Parse(HeaderTokenizer::Tokenize(header));
+    ASSERT_EQ(interfaces.size(), 2u);
+    EXPECT_EQ(interfaces[0].name, "Shape");
+    ASSERT_EQ(interfaces[0].methods.size(), 3u);  // Закрытые методы и деструктор не входят
+    const InterfaceMethod& scale = interfaces[0].methods[1];
+    EXPECT_EQ(scale.returnType, "Shape&");
+    EXPECT_FALSE(scale.isConst);
+    ASSERT_EQ(scale.params.size(), 2u);
+    EXPECT_EQ(scale.params[1].type, "const std::string&");
+    EXPECT_EQ(scale.params[1].name, "arg1");
+    const InterfaceMethod& reset = interfaces[0].methods[2];
+    ASSERT_EQ(reset.params.size(), 2u);
+    EXPECT_EQ(reset.params[1].type, "std::map<int, int>");
+    EXPECT_EQ(reset.params[1].name, "table");
+    EXPECT_TRUE(interfaces[0].methods[0].isConst);
+    EXPECT_EQ(interfaces[1].name, "Named");
+    EXPECT_EQ(interfaces[1].methods[0].returnType, "std::string");
+}
+
+TEST(AdapterGeneratorTests, RegeneratesOnlyChangedInterfaces) {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "spaceship_adapters_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    std::string header = (dir / "shapes.h").string();
+    auto writeHeader = [&](const std::string& extra) {
+        std::ofstream(header) << "class A { public: virtual int a() const = 0; };\n"
+                                 "class B { public: virtual void b(int value) = 0;" << extra << " };\n";
+    };
+    AdapterOptions options{(dir / "out").string(), "Target", "target.h"};
+
+    writeHeader("");
+    GeneratorResult first = AdapterGenerator::Run({header}, options);
+    EXPECT_TRUE(first.errors.empty());
+    EXPECT_EQ(first.written, 2u);
+    GeneratorResult second = AdapterGenerator::Run({header}, options);
+    EXPECT_EQ(second.written, 0u);
+    EXPECT_EQ(second.unchanged, 2u);
+
+    writeHeader(" virtual B& c() = 0;");
+    GeneratorResult third = AdapterGenerator::Run({header}, options);
+    EXPECT_EQ(third.written, 1u);
+    EXPECT_EQ(third.unchanged, 1u);
+
+    // Строка хэша цела, но тело адаптера испорчено: файл сравнивается целиком и пишется заново
+    std::filesystem::path adapter = dir / "out" / AdapterGenerator::FileName("A");
+    std::string original;
+    {
+        std::ifstream in(adapter);
+        original.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    std::ofstream(adapter, std::ios::app) << "// edited\n";
+    GeneratorResult fourth = AdapterGenerator::Run({header}, options);
+    EXPECT_EQ(fourth.written, 1u);
+    EXPECT_EQ(fourth.unchanged, 1u);
+    std::ifstream restored(adapter);
+    EXPECT_EQ(std::string(std::istreambuf_iterator<char>(restored), std::istreambuf_iterator<char>()), original);
+
+    GeneratorResult missing = AdapterGenerator::Run({(dir / "missing.h").string()}, options);
+    EXPECT_EQ(missing.errors.size(), 1u);
+    std::filesystem::remove_all(dir);
+}
+
+TEST(AdapterGeneratorTests, GeneratedAdapterResolvesThroughIoC) {
+    IoC ioc;
+    ioc.Register<Rotation>("SpaceShip::getRotation", [](std::vector<void*> args) -> Rotation* {
+        return new Rotation(static_cast<SpaceShip*>(args[0])->getRotation());
+    });
+    ioc.Register<void>("SpaceShip::setRotation", [](std::vector<void*> args) -> void* {
+        static_cast<SpaceShip*>(args[0])->setRotation(*static_cast<Rotation*>(args[1]));
+        return nullptr;
+    });
+    SpaceShip ship(Vector(0, 0), 10);
+    AutoGenerated_RotatableAdapter adapter(&ioc, "SpaceShip", &ship);
+    EXPECT_EQ(adapter.getRotation(), 10);
+    RotationHandler::Rotate(adapter, 35);
+    EXPECT_EQ(ship.getRotation(), 45);
+}
+
+TEST(SharedRingTests, FeedsCommandsAcrossProcesses) {
+    World world;
+    EntityId steered = world.AddShip(Vector(0, 0), 0);
+    EntityId fueled = world.AddShip(Vector(5, 5), 0);
+    EntityId removed = world.AddShip(Vector(9, 9), 0);
+    world.Ship(fueled).setFuel(10);
+    world.Ship(fueled).setVelocity(Vector(1, 2));
+    ShipHandle stale = world.Handle(removed);
+    world.RemoveShip(stale);
+
+    const std::string name = "/spaceship_ring_test_" + std::to_string(getpid());
+    SharedCommandRing ring;
+    ASSERT_TRUE(ring.Create(name, 64, RingMode::SingleProducer));
+    const int velocities = 1000;  // Больше емкости: кольцо проходится много раз
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        SharedCommandRing shared;
+        if (!shared.Open(name)) {
+            _exit(1);
+        }
+        {
+            RingProducer producer(shared, 8);
+            for (int i = 0; i < velocities; ++i) {
+                producer.Push(CommandRecord::ChangeVelocity(ShipHandle{steered, 0}, Vector(i, 1)));
+            }
+            producer.Push(CommandRecord::Fuel(JournalBurnFuel, world.Handle(fueled), 2.5));
+            producer.Push(CommandRecord::Move(world.Handle(fueled)));
+            producer.Push(CommandRecord::Fuel(JournalBurnFuel, stale, 1));
+        }
+        _exit(0);
+    }
+
+    CommandQueue queue;
+    RingCommandFeeder feeder(ring, world);
+    size_t added = 0;
+    uint32_t spins = 0;
+    while (added + feeder.Dropped() < velocities + 3u) {
+        added += feeder.Feed(queue);
+        SharedCommandRing::Wait(spins);
+    }
+    int status = 0;
+    ASSERT_EQ(waitpid(child, &status, 0), child);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    SharedCommandRing::Unlink(name);
+
+    EXPECT_EQ(added, velocities + 2u);
+    EXPECT_EQ(feeder.Dropped(), 1u);  // Хэндл удаленного корабля
+    EXPECT_EQ(ring.Pending(), 0u);
+    queue.ProcessCommands();
+    EXPECT_EQ(world.Ship(steered).getVelocity(), Vector(velocities - 1, 1));
+    EXPECT_EQ(world.Ship(fueled).getFuel(), 7.5);
+    EXPECT_EQ(world.Ship(fueled).getPosition(), Vector(6, 7));
+}
+
+TEST(SharedRingTests, DecodedMoveFollowsRelocatedShip) {
+    World world;
+    EntityId first = world.AddShip(Vector(0, 0), 0);
+    EntityId moving = world.AddShip(Vector(5, 5), 0);
+    world.Ship(moving).setVelocity(Vector(1, 2));
+    std::shared_ptr<Command> move = RingCommandFeeder::Decode(CommandRecord::Move(world.Handle(moving)), world);
+    ASSERT_TRUE(move);
+
+    // Удаление первого корабля переносит последний на его место, рост мира — весь массив
+    world.RemoveShip(world.Handle(first));
+    for (int i = 0; i < 100; ++i) {
+        world.AddShip(Vector(i, i), 0);
+    }
+    EXPECT_EQ(move->GetTarget(), &world.Ship(moving));
+    move->Execute();
+    EXPECT_EQ(world.Ship(moving).getPosition(), Vector(6, 7));
+}
+
+TEST(SharedRingTests, BatchedPublicationAndMultipleProducers) {
+    const std::string name = "/spaceship_ring_test_mp_" + std::to_string(getpid());
+    {
+        SharedCommandRing ring;
+        ASSERT_TRUE(ring.Create(name, 16, RingMode::SingleProducer));
+        RingProducer producer(ring, 4);
+        RingConsumer consumer(ring);
+        auto ignore = [](const CommandRecord&) {};
+        for (int i = 0; i < 3; ++i) {
+            EXPECT_TRUE(producer.TryPush(CommandRecord::Move(ShipHandle{0, 0})));
+        }
+        EXPECT_EQ(consumer.Poll(ignore), 0u);  // Хвост еще не опубликован
+        producer.Flush();
+        EXPECT_EQ(consumer.Poll(ignore), 3u);
+        for (int i = 0; i < 16; ++i) {
+            EXPECT_TRUE(producer.TryPush(CommandRecord::Move(ShipHandle{0, 0})));
+        }
+        EXPECT_FALSE(producer.TryPush(CommandRecord::Move(ShipHandle{0, 0})));
+        EXPECT_EQ(consumer.Poll(ignore, 5), 5u);
+        EXPECT_TRUE(producer.TryPush(CommandRecord::Move(ShipHandle{0, 0})));
+        EXPECT_THROW(ring.Create(name, 12, RingMode::SingleProducer), std::invalid_argument);
+    }
+
+    SharedCommandRing ring;
+    ASSERT_TRUE(ring.Create(name, 256, RingMode::MultiProducer));
+    SharedCommandRing::Unlink(name);  // Отображение остается
+    const int producers = 4;
+    const int records = 20000;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&ring, p] {
+            RingProducer producer(ring, 16);
+            for (int i = 0; i < records; ++i) {
+                CommandRecord record = CommandRecord::Move(ShipHandle{static_cast<EntityId>(p), 0});
+                record.steps = i;
+                producer.Push(record);
+                if (i % 1000 == 999) {
+                    producer.Flush();  // Неполный блок дополняется пустыми записями
+                }
+            }
+        });
+    }
+
+    RingConsumer consumer(ring);
+    std::vector<int> expected(producers, 0);
+    size_t received = 0;
+    bool ordered = true;
+    uint32_t spins = 0;
+    while (received < static_cast<size_t>(producers) * records) {
+        received += consumer.Poll([&](const CommandRecord& record) {
+            ordered = ordered && record.steps == expected[record.ship]++;
+        });
+        SharedCommandRing::Wait(spins);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_TRUE(ordered);  // Записи одного производителя приходят по порядку, каждая один раз
+    EXPECT_EQ(expected, std::vector<int>(producers, records));
+    EXPECT_EQ(consumer.Poll([](const CommandRecord&) {}), 0u);
+}
+
+TEST(SharedRingTests, RecreateLeavesAttachedRingIntact) {
+    const std::string name = "/spaceship_ring_test_re_" + std::to_string(getpid());
+    SharedCommandRing creator;
+    ASSERT_TRUE(creator.Create(name, 64, RingMode::SingleProducer));
+    SharedCommandRing attached;
+    ASSERT_TRUE(attached.Open(name));
+    {
+        RingProducer producer(attached, 1);
+        producer.Push(CommandRecord::Move(ShipHandle{7, 0}));
+    }
+
+    // Пересоздание меньшего кольца: старое отображение не усекается, запись в нем сохраняется
+    ASSERT_TRUE(creator.Create(name, 16, RingMode::MultiProducer));
+    EXPECT_EQ(attached.Capacity(), 64u);
+    EXPECT_EQ(attached.Pending(), 1u);
+    attached.At(63).record.ship = 1;  // Последняя ячейка старого кольца доступна
+    EXPECT_EQ(attached.At(0).record.ship, 7u);
+    EXPECT_EQ(creator.Pending(), 0u);
+
+    SharedCommandRing reopened;
+    ASSERT_TRUE(reopened.Open(name));
+    EXPECT_EQ(reopened.Capacity(), 16u);
+    EXPECT_EQ(reopened.Mode(), RingMode::MultiProducer);
+    SharedCommandRing::Unlink(name);
+
+    EXPECT_FALSE(reopened.Open(name));
+    EXPECT_NE(reopened.Error().find(name), std::string::npos);
+    EXPECT_FALSE(creator.Create("/bad/ring/name", 16, RingMode::SingleProducer));
+    EXPECT_NE(creator.Error().find("Cannot create shared memory"), std::string::npos);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
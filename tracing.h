@@ -0,0 +1,260 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#include "commandStats.h"
+
+// Событие трассировки: интервал выполнения задачи или команды
+struct TraceEvent {
+    const std::string* name = nullptr;  // Указывает в кэш имен буфера потока
+    const char* category = "";
+    uint64_t begin = 0;                 // Тики StatsClock
+    uint64_t end = 0;
+};
+
+// Кольцевой буфер событий одного потока. При переполнении перезаписываются самые старые события.
+class TraceBuffer {
+public:
+    TraceBuffer(uint32_t threadId, size_t capacity) : threadId(threadId), events(capacity) {}
+
+    template <typename NameFn>
+    const std::string* NameOf(const std::type_info& type, NameFn&& name) {
+        for (const auto& entry : names) {
+            if (entry.first == &type) {
+                return entry.second.get();
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        names.emplace_back(&type, std::make_unique<std::string>(name()));
+        return names.back().second.get();
+    }
+
+    void Record(const TraceEvent& event) {
+        std::lock_guard<std::mutex> lock(mutex);
+        events[next] = event;
+        if (++next == events.size()) {
+            next = 0;
+            wrapped = true;
+        }
+    }
+
+    void SetThreadName(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        threadName = name;
+    }
+
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        next = 0;
+        wrapped = false;
+    }
+
+    // Новая емкость; накопленные события при этом отбрасываются
+    void Resize(size_t capacity) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (events.size() == capacity) {
+            return;
+        }
+        events.assign(capacity, TraceEvent());
+        next = 0;
+        wrapped = false;
+    }
+
+    size_t Capacity() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return events.size();
+    }
+
+    // События в хронологическом порядке
+    template <typename Visitor>
+    void Visit(Visitor&& visit) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t count = wrapped ? events.size() : next;
+        size_t first = wrapped ? next : 0;
+        for (size_t i = 0; i < count; ++i) {
+            visit(events[(first + i) % events.size()]);
+        }
+    }
+
+    uint32_t ThreadId() const { return threadId; }
+
+    std::string ThreadName() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return threadName;
+    }
+
+private:
+    uint32_t threadId;
+    std::string threadName;
+    std::vector<TraceEvent> events;
+    size_t next = 0;
+    bool wrapped = false;
+    std::vector<std::pair<const std::type_info*, std::unique_ptr<std::string>>> names;
+    mutable std::mutex mutex;  // Захватывается только владельцем и выгрузкой, без конкуренции на записи
+};
+
+// Трассировщик выполнения задач SafeQueue и команд CommandQueue.
+// Включается во время работы; выключенный стоит одну relaxed-загрузку флага на задачу.
+// Выгружает события в формате Chrome trace-event (chrome://tracing, Perfetto).
+class Tracer {
+public:
+    static Tracer& Instance() {
+        static Tracer instance;
+        return instance;
+    }
+
+    // eventsPerThread — емкость буфера каждого потока (не меньше 1). Буферы уже зарегистрированных
+    // потоков получают новую емкость; если она изменилась, их события отбрасываются
+    void Enable(size_t eventsPerThread = 1 << 16) {
+        eventsPerThread = std::max<size_t>(eventsPerThread, 1);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            capacity.store(eventsPerThread, std::memory_order_relaxed);
+            for (const auto& buffer : buffers) {
+                buffer->Resize(eventsPerThread);
+            }
+        }
+        enabled.store(true, std::memory_order_release);
+    }
+
+    void Disable() { enabled.store(false, std::memory_order_release); }
+
+    bool Enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // Файл, в который трасса выгружается автоматически при мягкой остановке SafeQueue
+    void SetOutputPath(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        outputPath = path;
+    }
+
+    TraceBuffer& Local() {
+        static thread_local TraceBuffer* local = nullptr;
+        if (!local) {
+            local = Register();
+        }
+        return *local;
+    }
+
+    void SetThreadName(const std::string& name) { Local().SetThreadName(name); }
+
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& buffer : buffers) {
+            buffer->Clear();
+        }
+    }
+
+    bool DumpChromeTrace(const std::string& path) const {
+        std::ofstream out(path, std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Cannot open trace file: " << path << std::endl;
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        // Метки времени считаются от самого раннего события трассы
+        uint64_t origin = UINT64_MAX;
+        for (const auto& buffer : buffers) {
+            buffer->Visit([&](const TraceEvent& event) { origin = std::min(origin, event.begin); });
+        }
+
+        const double microsPerTick = StatsClock::NanosPerTick() / 1000.0;
+        bool first = true;
+        auto separator = [&]() -> std::ostream& {
+            out << (first ? "\n" : ",\n");
+            first = false;
+            return out;
+        };
+
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        for (const auto& buffer : buffers) {
+            std::string threadName = buffer->ThreadName();
+            if (!threadName.empty()) {
+                separator() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->ThreadId()
+                            << ",\"args\":{\"name\":\"" << Escape(threadName) << "\"}}";
+            }
+            buffer->Visit([&](const TraceEvent& event) {
+                separator() << "{\"name\":\"" << Escape(*event.name) << "\",\"cat\":\"" << event.category
+                            << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->ThreadId()
+                            << ",\"ts\":" << (event.begin - origin) * microsPerTick
+                            << ",\"dur\":" << (event.end - event.begin) * microsPerTick << "}";
+            });
+        }
+        out << "\n]}\n";
+        return static_cast<bool>(out);
+    }
+
+    // Выгрузка в заданный SetOutputPath файл, если трассировка включена
+    void DumpOnStop() const {
+        std::string path;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            path = outputPath;
+        }
+        if (Enabled() && !path.empty()) {
+            DumpChromeTrace(path);
+        }
+    }
+
+private:
+    Tracer() = default;
+
+    TraceBuffer* Register() {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffers.push_back(std::make_unique<TraceBuffer>(static_cast<uint32_t>(buffers.size() + 1),
+                                                        capacity.load(std::memory_order_relaxed)));
+        return buffers.back().get();
+    }
+
+    static std::string Escape(const std::string& text) {
+        std::string result;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+            }
+            result += c;
+        }
+        return result;
+    }
+
+    std::atomic<bool> enabled{false};
+    std::atomic<size_t> capacity{1 << 16};
+    std::string outputPath;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    mutable std::mutex mutex;
+};
+
+// Интервал трассировки: начало в конструкторе, запись события в деструкторе
+class TraceScope {
+public:
+    template <typename NameFn>
+    TraceScope(const char* category, const std::type_info& type, NameFn&& name) {
+        if (Tracer::Instance().Enabled()) {
+            buffer = &Tracer::Instance().Local();
+            event.name = buffer->NameOf(type, name);
+            event.category = category;
+            event.begin = StatsClock::Now();
+        }
+    }
+
+    ~TraceScope() {
+        if (buffer) {
+            event.end = StatsClock::Now();
+            buffer->Record(event);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    TraceBuffer* buffer = nullptr;
+    TraceEvent event;
+};
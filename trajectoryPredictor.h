@@ -0,0 +1,201 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+#include "world.h"
+#include "exception_queue.h"
+#include "changeVelocity.h"
+#include "rotateAndChangeVelocity.h"
+#include "macroCommand.h"
+#include "coalescer.h"
+
+// Предсказание положений всех кораблей на K тиков вперед (ИИ, уклонение от столкновений).
+// Состояние мира копируется в плотные массивы по номеру корабля; ожидающие команды скорости
+// и поворота применяются к копии скоростей, затем все тики считаются построчно:
+// строка тика — сложения подряд идущих элементов без ветвлений. Живые корабли не меняются.
+// Результат побитово совпадает с шагами World::MoveShips: сложения те же и в том же порядке.
+// Другие команды (топливо, повторяющиеся, корутины) не учитываются. Успех такой команды предсказать нельзя,
+// поэтому макрокоманда применяется только до первой из них: дальше она может остановиться исключением
+class TrajectoryPredictor {
+public:
+    // Без ожидающих команд: корабли летят с текущими скоростями
+    void Predict(const World& world, size_t ticks) {
+        Load(world);
+        Advance(ticks);
+    }
+
+    // С командами, которые очередь выполнит в начале следующего тика, до шага движения
+    void Predict(const World& world, size_t ticks, const CommandQueue& queue) {
+        Load(world);
+        queue.ForEachPending([&](const std::shared_ptr<Command>& cmd) { Apply(world, *cmd); });
+        Advance(ticks);
+    }
+
+    void Predict(const World& world, size_t ticks, const std::vector<std::shared_ptr<Command>>& pending) {
+        Load(world);
+        for (const auto& cmd : pending) {
+            Apply(world, *cmd);
+        }
+        Advance(ticks);
+    }
+
+    size_t Ticks() const {
+        return ticks;
+    }
+
+    // Граница номеров на момент предсказания (World::Size); у удаленных кораблей — нули
+    size_t Ships() const {
+        return ships;
+    }
+
+    // Положение после tick шагов движения, tick — от 1 до Ticks()
+    Vector At(size_t tick, EntityId id) const {
+        size_t index = (tick - 1) * ships + id;
+        return Vector(xs[index], ys[index]);
+    }
+
+    // Строки буфера K × N: координаты всех кораблей после tick шагов
+    const double* X(size_t tick) const {
+        return xs.data() + (tick - 1) * ships;
+    }
+
+    const double* Y(size_t tick) const {
+        return ys.data() + (tick - 1) * ships;
+    }
+
+    // Скорость после ожидающих команд
+    Vector Velocity(EntityId id) const {
+        return Vector(vx[id], vy[id]);
+    }
+
+private:
+    enum Kind : uint8_t {
+        Other,
+        ChangeVelocity,
+        Rotate,
+        Macro,
+        Coalesced,
+        Retry,
+    };
+
+    size_t ticks = 0;
+    size_t ships = 0;
+    // Буферы переиспользуются между вызовами: память выделяется, только если мир или горизонт выросли
+    std::vector<double> startX, startY, vx, vy;
+    std::vector<int> directions;  // Число направлений дискретного режима, 0 — непрерывный поворот
+    std::vector<int> headings;    // Направление дискретного режима после ожидающих команд
+    std::vector<double> xs, ys;   // K × N, строка на тик
+    TypeKindCache<Kind> kinds{Other,
+                              {{&typeid(ChangeVelocityCommand), ChangeVelocity},
+                               {&typeid(RotateAndChangeVelocity), Rotate},
+                               {&typeid(MacroCommand), Macro},
+                               {&typeid(CoalescedCommand), Coalesced},
+                               {&typeid(RetryCommand), Retry}}};
+
+    void Load(const World& world) {
+        ships = world.Size();
+        startX.resize(ships);
+        startY.resize(ships);
+        vx.resize(ships);
+        vy.resize(ships);
+        directions.resize(ships);
+        headings.resize(ships);
+        for (EntityId id = 0; id < ships; ++id) {
+            if (!world.IsAlive(id)) {
+                startX[id] = startY[id] = vx[id] = vy[id] = 0;
+                directions[id] = headings[id] = 0;
+                continue;
+            }
+            const SpaceShip& ship = world.Ship(id);
+            Vector position = ship.getPosition();
+            Vector velocity = ship.getVelocity();
+            startX[id] = position.X;
+            startY[id] = position.Y;
+            vx[id] = velocity.X;
+            vy[id] = velocity.Y;
+            directions[id] = ship.getDirectionsNumber();
+            headings[id] = directions[id] != 0 ? ship.getDirection() : 0;
+        }
+    }
+
+    // Действие команды на копию скорости — как RotateAndChangeVelocity::Execute и ChangeVelocityCommand::Execute.
+    // false — команда бросит исключение или ее исход неизвестен (MacroCommand на ней остановится)
+    bool Apply(const World& world, const Command& cmd) {
+        Kind kind = kinds.Get(typeid(cmd));
+        if (kind == Macro) {
+            for (const auto& inner : static_cast<const MacroCommand&>(cmd).GetCommands()) {
+                if (!Apply(world, *inner)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        if (kind == Coalesced) {  // Ошибка вложенной команды не останавливает следующие
+            bool succeeded = true;
+            for (const auto& inner : static_cast<const CoalescedCommand&>(cmd).GetCommands()) {
+                succeeded = Apply(world, *inner) && succeeded;
+            }
+            return succeeded;
+        }
+        if (kind == Retry) {
+            return Apply(world, *static_cast<const RetryCommand&>(cmd).GetOriginal());
+        }
+        EntityId id;
+        if (kind == Other || !world.IdOf(cmd.GetTarget(), id)) {
+            return false;
+        }
+        if (kind == ChangeVelocity) {
+            const Vector& velocity = static_cast<const ChangeVelocityCommand&>(cmd).GetVelocity();
+            vx[id] = velocity.X;
+            vy[id] = velocity.Y;
+            return true;
+        }
+        const auto& rotate = static_cast<const RotateAndChangeVelocity&>(cmd);
+        int count = directions[id];
+        if (rotate.IsDiscrete() && count == 0) {
+            return false;  // Дискретный поворот вне дискретного режима бросает исключение и скорость не меняет
+        }
+        // В дискретном режиме угол в градусах округляется до шагов, скорость поворачивается по таблице
+        DirectionSteps turn = rotate.GetSteps();
+        if (!rotate.IsDiscrete() && count != 0) {
+            turn = RotateAndChangeVelocity::DiscreteSteps(headings[id] * 360.0 / count, headings[id],
+                                                          rotate.GetAngle(), count);
+        }
+        if (count != 0) {
+            headings[id] = DirectionTables::Normalize(headings[id] + turn.value, count);
+        }
+        Vector velocity(vx[id], vy[id]);
+        if (velocity == Vector(0, 0)) {
+            return true;
+        }
+        velocity = count != 0 ? RotationHandler::RotateVector(velocity, turn, count)
+                              : RotateAndChangeVelocity::RotateVector(velocity, rotate.GetAngle());
+        vx[id] = velocity.X;
+        vy[id] = velocity.Y;
+        return true;
+    }
+
+    // Строка тика — предыдущая строка плюс скорости: независимые сложения подряд идущих элементов.
+    // Предыдущая строка только что записана и еще в кэше
+    void Advance(size_t horizon) {
+        ticks = horizon;
+        xs.resize(ticks * ships);
+        ys.resize(ticks * ships);
+        const double* __restrict velocityX = vx.data();
+        const double* __restrict velocityY = vy.data();
+        for (size_t tick = 0; tick < ticks; ++tick) {
+            const double* __restrict previousX = tick == 0 ? startX.data() : xs.data() + (tick - 1) * ships;
+            const double* __restrict previousY = tick == 0 ? startY.data() : ys.data() + (tick - 1) * ships;
+            double* __restrict nextX = xs.data() + tick * ships;
+            double* __restrict nextY = ys.data() + tick * ships;
+            for (size_t i = 0; i < ships; ++i) {
+                nextX[i] = previousX[i] + velocityX[i];
+            }
+            for (size_t i = 0; i < ships; ++i) {
+                nextY[i] = previousY[i] + velocityY[i];
+            }
+        }
+    }
+};
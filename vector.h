@@ -12,6 +12,14 @@ public:
         return Vector(X + vec.X, Y + vec.Y);
     }
 
+    Vector operator-(const Vector& vec) const {
+        return Vector(X - vec.X, Y - vec.Y);
+    }
+
+    Vector operator*(double factor) const {
+        return Vector(X * factor, Y * factor);
+    }
+
     bool operator==(const Vector& vec) const {
         return X == vec.X && Y == vec.Y;
     }
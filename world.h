@@ -0,0 +1,407 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "spaceship.h"
+#include "movement.h"
+#include "components.h"
+
+// Хэндл корабля: номер и поколение ячейки. Удаление корабля увеличивает поколение,
+// поэтому старый хэндл перестает разрешаться, а не указывает на корабль, занявший ячейку
+struct ShipHandle {
+    EntityId index = 0;
+    uint32_t generation = 0;  // 0 — пустой хэндл
+
+    bool operator==(const ShipHandle&) const = default;
+};
+
+class ShipRef;
+
+// Отметка в маске ForEachDirty: корабль с этим номером удален после ClearDirty.
+// Остальные биты маски при этом — поля нового корабля, если номер уже выдан снова
+constexpr uint8_t ShipRemoved = 1 << 7;
+
+// Игровой мир: владеет кораблями и отмечает, какие поля каких кораблей изменились за тик.
+// На каждое поле — битовое множество с битом на корабль.
+// Корабли лежат в одном массиве без дыр и при росте мира или удалении переезжают,
+// поэтому команды держат хэндлы (ShipRef), а не ссылки на корабли.
+// Номер корабля (EntityId) постоянен, пока корабль жив; номера удаленных выдаются снова
+class World : public ShipObserver {
+private:
+    static constexpr uint32_t NoShip = UINT32_MAX;
+
+    struct Slot {
+        uint32_t dense = NoShip;  // Индекс в ships; NoShip — ячейка свободна
+        uint32_t generation = 1;
+    };
+
+    std::vector<SpaceShip> ships;
+    std::vector<EntityId> owners;  // owners[i] — номер корабля ships[i]
+    std::vector<Slot> slots;       // По номеру корабля
+    std::vector<EntityId> freeSlots;
+    std::array<std::vector<uint64_t>, ShipFieldCount> dirty;
+    std::vector<uint64_t> removed;  // Бит на номер: корабль удален после ClearDirty
+    uint64_t slotChanges = 0;       // Удаления и повторные выдачи номеров
+
+    // Активное множество: корабли, которым нужен шаг движения (MotionMode::Stepping).
+    // Обновляется при смене скорости, поэтому стоящие корабли шаг не обходит.
+    // Смена режима приходит и из полос параллельной очереди, поэтому наблюдатель только отмечает
+    // корабль (атомарный бит), а множество перестраивается последовательно перед шагом движения
+    std::vector<EntityId> stepping;
+    std::vector<uint32_t> steppingIndex;  // По номеру: позиция в stepping или NoShip
+    std::vector<uint64_t> motionChanged;  // Бит на номер: режим сменился после последнего обновления
+    std::atomic<bool> motionPending{false};
+
+    // Ленивое движение: номер шага движения и корабли, летящие по инерции (бит на номер)
+    bool lazyMotion = false;
+    uint64_t motionTick = 0;
+    std::vector<uint64_t> coasting;
+
+    EntityId NewSlot() {
+        EntityId id = static_cast<EntityId>(slots.size());
+        slots.push_back(Slot());
+        for (auto& bits : dirty) {
+            bits.resize(slots.size() / 64 + 1, 0);
+        }
+        removed.resize(slots.size() / 64 + 1, 0);
+        coasting.resize(slots.size() / 64 + 1, 0);
+        motionChanged.resize(slots.size() / 64 + 1, 0);
+        steppingIndex.push_back(NoShip);
+        return id;
+    }
+
+    SpaceShip& Place(EntityId id, const Vector& position, Rotation rotation) {
+        slots[id].dense = static_cast<uint32_t>(ships.size());
+        ships.emplace_back(position, rotation);
+        owners.push_back(id);
+        ships.back().setObserver(this, id);
+        if (lazyMotion) {
+            ships.back().setMotionClock(&motionTick);
+        }
+        onShipChanged(id, PositionField | VelocityField | RotationField | FuelField);
+        return ships.back();
+    }
+
+    // Перенос отмеченных смен режима в активное множество и биты инерции; вызывается последовательно.
+    // Полосы параллельной очереди к этому моменту завершены (ParallelExecutor::Run ждет их)
+    void ApplyMotionChanges() {
+        if (!motionPending.load(std::memory_order_relaxed)) {
+            return;
+        }
+        motionPending.store(false, std::memory_order_relaxed);
+        for (size_t word = 0; word < motionChanged.size(); ++word) {
+            uint64_t bits = motionChanged[word];
+            motionChanged[word] = 0;
+            while (bits) {
+                EntityId id = static_cast<EntityId>(word * 64 + __builtin_ctzll(bits));
+                bits &= bits - 1;
+                UpdateMotion(id, IsAlive(id) ? ships[slots[id].dense].getMotionMode() : MotionMode::Idle);
+            }
+        }
+    }
+
+    void UpdateMotion(EntityId entity, MotionMode mode) {
+        uint64_t bit = uint64_t(1) << (entity & 63);
+        coasting[entity >> 6] = mode == MotionMode::Coasting ? coasting[entity >> 6] | bit
+                                                              : coasting[entity >> 6] & ~bit;
+        bool active = steppingIndex[entity] != NoShip;
+        if (mode == MotionMode::Stepping && !active) {
+            steppingIndex[entity] = static_cast<uint32_t>(stepping.size());
+            stepping.push_back(entity);
+        } else if (mode != MotionMode::Stepping && active) {
+            uint32_t index = steppingIndex[entity];
+            stepping[index] = stepping.back();
+            steppingIndex[stepping[index]] = index;
+            stepping.pop_back();
+            steppingIndex[entity] = NoShip;
+        }
+    }
+
+    [[noreturn]] static void ThrowNoShip(EntityId id) {
+        throw std::out_of_range("No ship with id " + std::to_string(id));
+    }
+
+public:
+    World() = default;
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+
+    EntityId AddShip(const Vector& position, Rotation rotation) {
+        EntityId id;
+        if (freeSlots.empty()) {
+            id = NewSlot();
+        } else {
+            id = freeSlots.back();
+            freeSlots.pop_back();
+            ++slotChanges;
+        }
+        Place(id, position, rotation);
+        return id;
+    }
+
+    // Корабль с заданным номером; недостающие корабли до него создаются. Для клиента и повтора журнала,
+    // которые повторяют номера сервера
+    SpaceShip& EnsureShip(EntityId id) {
+        while (slots.size() <= id) {
+            Place(NewSlot(), Vector(), 0);
+        }
+        if (slots[id].dense == NoShip) {
+            freeSlots.erase(std::find(freeSlots.begin(), freeSlots.end(), id));
+            ++slotChanges;
+            return Place(id, Vector(), 0);
+        }
+        return ships[slots[id].dense];
+    }
+
+    // Номер id свободен: живой корабль с ним удаляется, недостающие номера до него создаются свободными.
+    // Для клиента, получившего удаление от сервера
+    void EnsureRemoved(EntityId id) {
+        if (IsAlive(id)) {
+            RemoveShip(Handle(id));
+            return;
+        }
+        while (slots.size() <= id) {
+            freeSlots.push_back(NewSlot());
+        }
+    }
+
+    // Удаление корабля: на его место переезжает последний. false — хэндл устарел
+    bool RemoveShip(ShipHandle handle) {
+        if (!Resolve(handle)) {
+            return false;
+        }
+        EntityId id = handle.index;
+        uint32_t index = slots[id].dense;
+        if (index + 1 != ships.size()) {
+            ships[index] = std::move(ships.back());
+            owners[index] = owners.back();
+            slots[owners[index]].dense = index;
+        }
+        ships.pop_back();
+        owners.pop_back();
+        slots[id].dense = NoShip;
+        slots[id].generation = slots[id].generation == UINT32_MAX ? 1 : slots[id].generation + 1;
+        for (auto& bits : dirty) {
+            bits[id >> 6] &= ~(uint64_t(1) << (id & 63));
+        }
+        removed[id >> 6] |= uint64_t(1) << (id & 63);
+        ++slotChanges;
+        onMotionChanged(id, MotionMode::Idle);
+        freeSlots.push_back(id);
+        return true;
+    }
+
+    ShipHandle Handle(EntityId id) const {
+        if (!IsAlive(id)) {
+            ThrowNoShip(id);
+        }
+        return ShipHandle{id, slots[id].generation};
+    }
+
+    // Ссылка для команд: разрешается при выполнении
+    ShipRef Ref(EntityId id);
+
+    // nullptr — корабль удален (хэндл устарел)
+    SpaceShip* Resolve(ShipHandle handle) {
+        if (handle.index >= slots.size()) {
+            return nullptr;
+        }
+        const Slot& slot = slots[handle.index];
+        return slot.generation == handle.generation && slot.dense != NoShip ? &ships[slot.dense] : nullptr;
+    }
+
+    bool IsAlive(EntityId id) const {
+        return id < slots.size() && slots[id].dense != NoShip;
+    }
+
+    SpaceShip& Ship(EntityId id) {
+        if (!IsAlive(id)) {
+            ThrowNoShip(id);
+        }
+        return ships[slots[id].dense];
+    }
+
+    const SpaceShip& Ship(EntityId id) const {
+        if (!IsAlive(id)) {
+            ThrowNoShip(id);
+        }
+        return ships[slots[id].dense];
+    }
+
+    // Номер корабля по его текущему адресу; false — корабль не из этого мира
+    bool IdOf(const void* address, EntityId& id) const {
+        std::less<const void*> less;
+        if (ships.empty() || less(address, ships.data()) || !less(address, ships.data() + ships.size())) {
+            return false;
+        }
+        id = owners[static_cast<const SpaceShip*>(address) - ships.data()];
+        return true;
+    }
+
+    // Граница номеров: номера живых кораблей меньше Size(), но не все номера заняты (IsAlive)
+    size_t Size() const {
+        return slots.size();
+    }
+
+    // Количество живых кораблей
+    size_t Count() const {
+        return ships.size();
+    }
+
+    // Поколение номера: растет при каждом удалении корабля с этим номером
+    uint32_t Generation(EntityId id) const {
+        return slots[id].generation;
+    }
+
+    // Счетчик удалений кораблей и повторных выдач номеров. Пока он не изменился, номера
+    // меньше Size() принадлежат тем же кораблям (журнал проверяет номера только после его изменения)
+    uint64_t SlotChanges() const {
+        return slotChanges;
+    }
+
+    // Ленивое движение: корабли с постоянной скоростью не пишут положение каждый шаг,
+    // а считают его при чтении. Результат побитово совпадает с пошаговым движением:
+    // режим включается только для кораблей, у которых все сложения точны (SpaceShip::setMotionClock)
+    void SetLazyMotion(bool enabled) {
+        lazyMotion = enabled;
+        for (auto& ship : ships) {
+            ship.setMotionClock(enabled ? &motionTick : nullptr);
+        }
+    }
+
+    // Количество кораблей, которые шаг движения обходит по одному
+    size_t SteppingCount() {
+        ApplyMotionChanges();
+        return stepping.size();
+    }
+
+    // Шаг движения: обходятся только корабли из активного множества, стоящие не стоят ничего.
+    // Летящие по инерции сдвигаются увеличением счетчика, их положения отмечаются целыми словами
+    void MoveShips() {
+        ApplyMotionChanges();
+        for (EntityId id : stepping) {
+            Movement::Move(ships[slots[id].dense]);
+        }
+        ++motionTick;
+        if (lazyMotion) {
+            std::vector<uint64_t>& positions = dirty[__builtin_ctz(PositionField)];
+            for (size_t word = 0; word < coasting.size(); ++word) {
+                positions[word] |= coasting[word];
+            }
+        }
+    }
+
+    // Режим читается у корабля при обновлении множества, поэтому здесь он не нужен
+    void onMotionChanged(uint32_t entity, MotionMode) override {
+        uint64_t bit = uint64_t(1) << (entity & 63);
+        std::atomic_ref<uint64_t> word(motionChanged[entity >> 6]);
+        if (!(word.load(std::memory_order_relaxed) & bit)) {
+            word.fetch_or(bit, std::memory_order_relaxed);
+        }
+        if (!motionPending.load(std::memory_order_relaxed)) {
+            motionPending.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    // Вызывается и из полос параллельной очереди: в одном слове биты 64 кораблей из разных полос,
+    // поэтому бит ставится атомарно (и только если его еще нет — без лишней записи в общую линию)
+    void onShipChanged(uint32_t entity, uint8_t fields) override {
+        uint64_t bit = uint64_t(1) << (entity & 63);
+        for (int field = 0; field < ShipFieldCount; ++field) {
+            if (fields & (1 << field)) {
+                std::atomic_ref<uint64_t> word(dirty[field][entity >> 6]);
+                if (!(word.load(std::memory_order_relaxed) & bit)) {
+                    word.fetch_or(bit, std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    bool IsDirty(EntityId id, ShipField field) const {
+        int index = __builtin_ctz(field);
+        return (dirty[index][id >> 6] >> (id & 63)) & 1;
+    }
+
+    // Обход измененных кораблей по возрастанию номера: visit(id, маска измененных полей).
+    // Удаленные корабли обходятся с отметкой ShipRemoved
+    template <typename Visitor>
+    void ForEachDirty(Visitor&& visit) const {
+        size_t words = dirty[0].size();
+        for (size_t word = 0; word < words; ++word) {
+            uint64_t any = removed[word];
+            for (const auto& bits : dirty) {
+                any |= bits[word];
+            }
+            while (any) {
+                int bit = __builtin_ctzll(any);
+                any &= any - 1;
+                EntityId id = static_cast<EntityId>(word * 64 + bit);
+                uint8_t fields = 0;
+                for (int field = 0; field < ShipFieldCount; ++field) {
+                    fields |= ((dirty[field][word] >> bit) & 1) << field;
+                }
+                if ((removed[word] >> bit) & 1) {
+                    fields |= ShipRemoved;
+                }
+                visit(id, fields);
+            }
+        }
+    }
+
+    // Сброс отметок в конце тика (после рассылки изменений)
+    void ClearDirty() {
+        for (auto& bits : dirty) {
+            std::fill(bits.begin(), bits.end(), 0);
+        }
+        std::fill(removed.begin(), removed.end(), 0);
+    }
+};
+
+// Цель команды: корабль мира по хэндлу или отдельный корабль по ссылке.
+// Хэндл проверяется при каждом обращении: удаленный корабль дает nullptr или исключение
+class ShipRef {
+private:
+    void* pointer;       // World* для хэндла, SpaceShip* для прямой ссылки
+    ShipHandle handle;   // generation == 0 — прямая ссылка
+
+public:
+    ShipRef(SpaceShip& ship) : pointer(&ship) {}
+
+    ShipRef(World& world, ShipHandle handle) : pointer(&world), handle(handle) {}
+
+    bool IsHandle() const {
+        return handle.generation != 0;
+    }
+
+    ShipHandle Handle() const {
+        return handle;
+    }
+
+    // Ключ цели команд: мир и хэндл (прямая ссылка — адрес корабля). Не меняется при переезде корабля
+    TargetKey Key() const {
+        return {pointer, (static_cast<uint64_t>(handle.generation) << 32) | handle.index};
+    }
+
+    SpaceShip* TryGet() const {
+        return IsHandle() ? static_cast<World*>(pointer)->Resolve(handle) : static_cast<SpaceShip*>(pointer);
+    }
+
+    // Устаревший хэндл — std::out_of_range: CommandQueue не повторяет такие команды, а логирует
+    SpaceShip& Get() const {
+        SpaceShip* ship = TryGet();
+        if (!ship) {
+            throw std::out_of_range("Stale ship handle " + std::to_string(handle.index) + "/" +
+                                    std::to_string(handle.generation));
+        }
+        return *ship;
+    }
+};
+
+inline ShipRef World::Ref(EntityId id) {
+    return ShipRef(*this, Handle(id));
+}
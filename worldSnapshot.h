@@ -0,0 +1,174 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "world.h"
+
+// Состояние корабля на конец тика (только данные, без наблюдателя и виртуальных методов)
+struct ShipState {
+    Vector position;
+    Vector velocity;
+    Rotation rotation = 0;
+    double fuel = 0;
+    bool alive = false;  // false — номер свободен (корабль удален)
+};
+
+// Согласованное состояние мира на конец одного тика
+struct WorldSnapshot {
+    uint64_t tick = 0;
+    std::vector<ShipState> ships;
+};
+
+class SnapshotBuffer;
+
+// Доступ читателя к снимку. Пока объект жив, буфер снимка не переписывается
+class SnapshotView {
+private:
+    const WorldSnapshot* snapshot = nullptr;
+    std::atomic<uint32_t>* readers = nullptr;
+
+    friend class SnapshotBuffer;
+
+    SnapshotView(const WorldSnapshot* snapshot, std::atomic<uint32_t>* readers)
+        : snapshot(snapshot), readers(readers) {}
+
+public:
+    SnapshotView() = default;
+
+    SnapshotView(SnapshotView&& other) noexcept : snapshot(other.snapshot), readers(other.readers) {
+        other.snapshot = nullptr;
+        other.readers = nullptr;
+    }
+
+    SnapshotView& operator=(SnapshotView&& other) noexcept {
+        if (this != &other) {
+            Release();
+            snapshot = other.snapshot;
+            readers = other.readers;
+            other.snapshot = nullptr;
+            other.readers = nullptr;
+        }
+        return *this;
+    }
+
+    SnapshotView(const SnapshotView&) = delete;
+    SnapshotView& operator=(const SnapshotView&) = delete;
+
+    ~SnapshotView() {
+        Release();
+    }
+
+    void Release() {
+        if (readers) {
+            readers->fetch_sub(1, std::memory_order_release);
+            readers = nullptr;
+            snapshot = nullptr;
+        }
+    }
+
+    explicit operator bool() const {
+        return snapshot != nullptr;
+    }
+
+    const WorldSnapshot& operator*() const {
+        return *snapshot;
+    }
+
+    const WorldSnapshot* operator->() const {
+        return snapshot;
+    }
+};
+
+// Многобуферное состояние мира для читателей из других потоков (ИИ, сеть, аналитика).
+// Поток симуляции в конце тика копирует мир в свободный буфер и публикует его номер;
+// читатели берут последний опубликованный снимок без блокировок.
+// Буфер свободен, если он не последний опубликованный и у него нет читателей.
+// Если все буферы заняты медленными читателями, публикация тика пропускается:
+// симуляция никогда не ждет читателей.
+class SnapshotBuffer {
+public:
+    static constexpr size_t MaxBuffers = 8;
+
+    // buffers: 2 — двойная буферизация, 3 — тройная (по умолчанию), больше — для медленных читателей
+    explicit SnapshotBuffer(size_t buffers = 3)
+        : count(buffers < 2 ? 2 : (buffers > MaxBuffers ? MaxBuffers : buffers)) {}
+
+    SnapshotBuffer(const SnapshotBuffer&) = delete;
+    SnapshotBuffer& operator=(const SnapshotBuffer&) = delete;
+
+    // Вызывается только потоком симуляции. false — свободного буфера нет, тик не опубликован
+    bool Publish(const World& world, uint64_t tick) {
+        size_t current = latest.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < count; ++i) {
+            if (i == current || slots[i].readers.load(std::memory_order_seq_cst) != 0) {
+                continue;
+            }
+            Capture(world, tick, slots[i].snapshot);
+            latest.store(i, std::memory_order_seq_cst);
+            published.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        skipped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Последний опубликованный снимок; пустой view, если публикаций еще не было.
+    // Читатель отмечается в буфере и проверяет, что буфер все еще последний:
+    // иначе писатель мог успеть занять его, и попытка повторяется
+    SnapshotView Acquire() const {
+        while (true) {
+            size_t index = latest.load(std::memory_order_seq_cst);
+            if (index == NoSnapshot) {
+                return SnapshotView();
+            }
+            std::atomic<uint32_t>& readers = slots[index].readers;
+            readers.fetch_add(1, std::memory_order_seq_cst);
+            if (latest.load(std::memory_order_seq_cst) == index) {
+                return SnapshotView(&slots[index].snapshot, &readers);
+            }
+            readers.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    size_t Buffers() const {
+        return count;
+    }
+
+    uint64_t Published() const {
+        return published.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Skipped() const {
+        return skipped.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr size_t NoSnapshot = MaxBuffers;
+
+    struct alignas(64) Slot {
+        WorldSnapshot snapshot;
+        std::atomic<uint32_t> readers{0};
+    };
+
+    static void Capture(const World& world, uint64_t tick, WorldSnapshot& snapshot) {
+        snapshot.tick = tick;
+        snapshot.ships.resize(world.Size());
+        for (EntityId id = 0; id < world.Size(); ++id) {
+            if (!world.IsAlive(id)) {
+                snapshot.ships[id] = ShipState();
+                continue;
+            }
+            const SpaceShip& ship = world.Ship(id);
+            snapshot.ships[id] = ShipState{ship.getPosition(), ship.getVelocity(), ship.getRotation(), ship.getFuel(),
+                                           true};
+        }
+    }
+
+    size_t count;
+    mutable std::array<Slot, MaxBuffers> slots;
+    std::atomic<size_t> latest{NoSnapshot};
+    std::atomic<uint64_t> published{0};
+    std::atomic<uint64_t> skipped{0};
+};